@@ -0,0 +1,107 @@
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <vector>
+#include "autodiff.hpp"
+#include "cg.hpp"
+#include "compile.hpp"
+#include "linalg.hpp"
+#include "spatial.hpp"
+
+using namespace tenkai;
+
+// same transform chain as bench_simple_spatial
+auto gen_graph() {
+  std::vector<Operation::Ptr> inputs;
+  for (size_t i = 0; i < 7; i++) {
+    inputs.push_back(Operation::make_var());
+  }
+  auto& x = inputs;
+  auto trans = Vector({Operation::make_constant(0.1), Operation::make_constant(0.2),
+                       Operation::make_constant(0.3)});
+  auto tf1 = SpatialTransform(Matrix::RotX(x[0]), trans);
+  auto tf2 = SpatialTransform(Matrix::RotY(x[1]), trans);
+  auto tf3 = SpatialTransform(Matrix::RotZ(x[2]), trans);
+  auto tf4 = SpatialTransform(Matrix::RotX(x[3]), trans);
+  auto tf5 = SpatialTransform(Matrix::RotY(x[4]), trans);
+  auto tf6 = SpatialTransform(Matrix::RotZ(x[5]), trans);
+  auto tf7 = SpatialTransform(Matrix::RotX(x[6]), trans);
+  auto tf8 = tf4 * tf3 * tf2 * tf1;
+  auto tf9 = tf7 * tf6 * tf5 * tf1;
+  auto tf10 = tf9 * tf8;
+  return std::make_pair(inputs, tf10.trans.elements);
+}
+
+int main() {
+  auto [inputs, values] = gen_graph();
+  auto jac = jacobian(values, inputs);
+  auto fused_outputs = values;
+  fused_outputs.insert(fused_outputs.end(), jac.elements.begin(), jac.elements.end());
+
+  auto f_value = compiler::compile(inputs, values);
+  auto f_fused = compiler::compile(inputs, fused_outputs);
+
+  size_t n_inputs = inputs.size();
+  size_t n_outputs = values.size();
+  size_t n_trials = 1000000;
+  std::mt19937 gen(0);
+  std::uniform_real_distribution<double> dis(-M_PI, M_PI);
+  std::vector<double> input(n_inputs);
+  for (auto& value : input) {
+    value = dis(gen);
+  }
+
+  // values and jacobian by finite differences over repeated calls
+  std::vector<double> output(n_outputs);
+  std::vector<double> output_perturbed(n_outputs);
+  std::vector<double> jac_fd(n_outputs * n_inputs);
+  double eps = 1e-7;
+  auto finite_difference = [&]() {
+    f_value(input.data(), output.data(), nullptr);
+    for (size_t j = 0; j < n_inputs; j++) {
+      double original = input[j];
+      input[j] = original + eps;
+      f_value(input.data(), output_perturbed.data(), nullptr);
+      input[j] = original;
+      for (size_t i = 0; i < n_outputs; i++) {
+        jac_fd[i + j * n_outputs] = (output_perturbed[i] - output[i]) / eps;
+      }
+    }
+  };
+
+  // values and jacobian by one fused kernel
+  std::vector<double> output_fused(fused_outputs.size());
+  auto fused = [&]() { f_fused(input.data(), output_fused.data(), nullptr); };
+
+  finite_difference();
+  fused();
+  double max_error = 0.0;
+  for (size_t k = 0; k < jac_fd.size(); k++) {
+    max_error = std::max(max_error, std::abs(jac_fd[k] - output_fused[n_outputs + k]));
+  }
+  std::cout << "max |fd - ad|: " << max_error << std::endl;
+
+  auto start = std::chrono::high_resolution_clock::now();
+  double sum_fd = 0.0;
+  for (size_t i = 0; i < n_trials; i++) {
+    finite_difference();
+    sum_fd += jac_fd[0];
+  }
+  auto end = std::chrono::high_resolution_clock::now();
+  std::cout << "finite difference: "
+            << std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count() / n_trials
+            << " ns" << std::endl;
+  std::cout << sum_fd << std::endl;
+
+  start = std::chrono::high_resolution_clock::now();
+  double sum_ad = 0.0;
+  for (size_t i = 0; i < n_trials; i++) {
+    fused();
+    sum_ad += output_fused[n_outputs];
+  }
+  end = std::chrono::high_resolution_clock::now();
+  std::cout << "fused value+jacobian: "
+            << std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count() / n_trials
+            << " ns" << std::endl;
+  std::cout << sum_ad << std::endl;
+}
@@ -0,0 +1,75 @@
+#include <chrono>
+#include <format>
+#include <iostream>
+#include <random>
+#include <vector>
+#include "bytecode.hpp"
+#include "cg.hpp"
+#include "compile.hpp"
+#include "random_graph.hpp"
+
+using namespace tenkai;
+
+// mean time in nanoseconds of f() over n_repeats runs
+template <typename F>
+double time_ns(F&& f, size_t n_repeats) {
+  auto start = std::chrono::high_resolution_clock::now();
+  for (size_t i = 0; i < n_repeats; ++i) {
+    f();
+  }
+  auto end = std::chrono::high_resolution_clock::now();
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count() /
+         static_cast<double>(n_repeats);
+}
+
+// Cost of building and calling the bytecode and the native kernels. Up to the break-even
+// number of evaluations, building a BytecodeKernel and calling it is cheaper than
+// compiler::compile and calling the native code.
+int main() {
+  std::cout << std::format("{:>8} {:>12} {:>12} {:>12} {:>12} {:>12}", "nodes", "build bc",
+                           "build native", "call bc", "call native", "break-even")
+            << std::endl;
+  for (size_t n_nodes : {10, 30, 100, 300, 1000, 3000, 10000}) {
+    RandomGraphConfig config;
+    config.n_nodes = n_nodes;
+    config.n_inputs = 8;
+    config.n_outputs = 8;
+    config.depth = std::min<size_t>(16, n_nodes / 2);
+    auto graph = make_random_graph(config);
+
+    // native kernels are never unmapped, so keep their number small
+    size_t n_builds = std::max<size_t>(2, 20000 / n_nodes);
+    double build_bytecode = time_ns(
+        [&] { compiler::BytecodeKernel kernel(graph.inputs, graph.outputs); }, n_builds);
+    double build_native =
+        time_ns([&] { compiler::compile(graph.inputs, graph.outputs); }, n_builds);
+
+    compiler::BytecodeKernel kernel(graph.inputs, graph.outputs);
+    auto func = compiler::compile(graph.inputs, graph.outputs);
+    std::mt19937 gen(0);
+    std::uniform_real_distribution<double> dis(-1.0, 1.0);
+    std::vector<double> input(config.n_inputs);
+    for (auto& value : input) {
+      value = dis(gen);
+    }
+    std::vector<double> output(config.n_outputs);
+    size_t n_calls = std::max<size_t>(100, 10000000 / n_nodes);
+    kernel(input.data(), output.data(), nullptr);  // warm-up
+    func(input.data(), output.data(), nullptr);
+    double call_bytecode =
+        time_ns([&] { kernel(input.data(), output.data(), nullptr); }, n_calls);
+    double call_native = time_ns([&] { func(input.data(), output.data(), nullptr); }, n_calls);
+
+    std::string break_even = "never";
+    if (build_native <= build_bytecode) {
+      break_even = "0";
+    } else if (call_bytecode > call_native) {
+      break_even =
+          std::format("{:.0f}", (build_native - build_bytecode) / (call_bytecode - call_native));
+    }
+    std::cout << std::format("{:>8} {:>10.0f}ns {:>10.0f}ns {:>10.0f}ns {:>10.0f}ns {:>12}",
+                             n_nodes, build_bytecode, build_native, call_bytecode, call_native,
+                             break_even)
+              << std::endl;
+  }
+}
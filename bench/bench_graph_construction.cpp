@@ -0,0 +1,107 @@
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <vector>
+#include "cg.hpp"
+#include "linalg.hpp"
+
+using namespace tenkai;
+
+// block diagonal of 3x3 rotations, i.e. the structure of stacked rigid transforms
+Matrix block_rotation(size_t n) {
+  std::vector<Operation::Ptr> elements(n * n, Operation::make_zero());
+  for (size_t b = 0; b + 3 <= n; b += 3) {
+    auto rot = Matrix::RotZ(Operation::make_var());
+    for (size_t i = 0; i < 3; i++) {
+      for (size_t j = 0; j < 3; j++) {
+        elements[(b + i) + (b + j) * n] = rot(i, j);
+      }
+    }
+  }
+  for (size_t i = n - n % 3; i < n; i++) {
+    elements[i + i * n] = Operation::make_one();
+  }
+  return Matrix(elements, n, n);
+}
+
+template <typename F>
+double measure_us(F&& build, size_t n_trials) {
+  build();  // warm-up, the allocator may have returned the memory of the previous case
+  auto start = std::chrono::high_resolution_clock::now();
+  for (size_t i = 0; i < n_trials; i++) {
+    build();
+  }
+  auto end = std::chrono::high_resolution_clock::now();
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count() /
+         (1000.0 * n_trials);
+}
+
+// product of n_links rotations about fresh variables, the sub-graph of one link or sensor
+Matrix rotation_chain(size_t n_links) {
+  auto m = Matrix::RotZ(Operation::make_var());
+  for (size_t i = 1; i < n_links; i++) {
+    auto angle = Operation::make_var();
+    m = m * (i % 2 == 0 ? Matrix::RotZ(angle) : Matrix::RotX(angle));
+  }
+  return m;
+}
+
+// builds n_graphs independent chains, each in its own id stream, and merges them by summing
+// their first elements. A stream is opened once per process, so every call takes new ones
+Operation::Ptr build_chains(size_t n_graphs, size_t n_links, size_t n_threads) {
+  static std::atomic<uint64_t> next_stream{0};
+  const uint64_t first_stream = next_stream.fetch_add(n_graphs);
+  std::vector<Operation::Ptr> roots(n_graphs);
+  auto build = [&](size_t first) {
+    for (size_t k = first; k < n_graphs; k += n_threads) {
+      NodeIdStream stream(first_stream + k);
+      roots[k] = rotation_chain(n_links)(0, 0);
+    }
+  };
+  std::vector<std::thread> threads;
+  for (size_t t = 1; t < n_threads; t++) {
+    threads.emplace_back(build, t);
+  }
+  build(0);
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  auto merged = roots[0];
+  for (size_t k = 1; k < n_graphs; k++) {
+    merged = merged + roots[k];
+  }
+  return merged;
+}
+
+int main() {
+  size_t n_vars = 1000000;
+  double t_var = measure_us(
+      [n_vars]() {
+        for (size_t i = 0; i < n_vars; i++) {
+          Operation::make_var();
+        }
+      },
+      1);
+  std::cout << "make_var: " << n_vars / t_var << " M nodes/s" << std::endl;
+
+  std::cout << "threads, 64 chains of 32 links [us]" << std::endl;
+  for (size_t n_threads : {1, 2, 4, 8}) {
+    double t = measure_us([n_threads]() { return build_chains(64, 32, n_threads); }, 20);
+    std::cout << n_threads << ", " << t << std::endl;
+  }
+
+  std::cout << "n, dense [us], identity [us], block rotation [us]" << std::endl;
+  for (size_t n : {3, 4, 8, 16, 32, 64}) {
+    size_t n_trials = std::max<size_t>(1, 20000 / (n * n * n / 27));
+    auto a = Matrix::Var(n, n);
+    auto b = Matrix::Var(n, n);
+    auto identity = Matrix::Identity(n);
+    auto rot_a = block_rotation(n);
+    auto rot_b = block_rotation(n);
+    double t_dense = measure_us([&]() { return a * b; }, n_trials);
+    double t_identity = measure_us([&]() { return identity * b; }, n_trials);
+    double t_block = measure_us([&]() { return rot_a * rot_b; }, n_trials);
+    std::cout << n << ", " << t_dense << ", " << t_identity << ", " << t_block << std::endl;
+  }
+}
@@ -0,0 +1,179 @@
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <iostream>
+#include <numeric>
+#include <random>
+#include <utility>
+#include <vector>
+#include "cg.hpp"
+#include "compile.hpp"
+#include "kinematics.hpp"
+#include "linalg.hpp"
+#include "spatial.hpp"
+#include "bench_tree.hpp"
+#include "bench_kernels.hpp"
+
+using namespace tenkai;
+
+double measure_ns(const std::vector<JitFunc<double>>& funcs,
+                  const std::vector<size_t>& output_sizes,
+                  const std::vector<double>& input,
+                  size_t n_trials,
+                  double& sum) {
+  size_t n_outputs = 0;
+  for (auto size : output_sizes) {
+    n_outputs += size;
+  }
+  std::vector<double> output(n_outputs);
+  std::vector<double> input_copy = input;
+  auto start = std::chrono::high_resolution_clock::now();
+  for (size_t i = 0; i < n_trials; i++) {
+    double* out = output.data();
+    for (size_t k = 0; k < funcs.size(); k++) {
+      funcs[k](input_copy.data(), out, nullptr);
+      out += output_sizes[k];
+    }
+    sum += output[n_outputs - 1];
+  }
+  auto end = std::chrono::high_resolution_clock::now();
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count() /
+         static_cast<double>(n_trials);
+}
+
+int main() {
+  auto tree = make_tree();
+  std::cout << "links: " << tree.n_links() << ", joints: " << tree.n_joints() << std::endl;
+
+  // all links in a single kernel
+  auto f_tree = tree.compile("g++");
+
+  // one kernel per link, each composing its own chain from the root
+  std::vector<JitFunc<double>> f_per_link;
+  std::vector<size_t> per_link_sizes;
+  for (size_t i = 0; i < tree.n_links(); i++) {
+    auto joint_values = Vector::Var(tree.n_joints()).elements;
+    auto pose = tree.link_poses(joint_values)[i];
+    std::vector<Operation::Ptr> outputs = pose.rot.elements;
+    outputs.insert(outputs.end(), pose.trans.elements.begin(), pose.trans.elements.end());
+    f_per_link.push_back(jit_compile<double>(joint_values, outputs, "g++"));
+    per_link_sizes.push_back(12);
+  }
+
+  std::mt19937 gen(0);
+  std::uniform_real_distribution<double> dis(-M_PI, M_PI);
+  std::vector<double> input(tree.n_joints());
+  for (auto& value : input) {
+    value = dis(gen);
+  }
+
+  size_t n_trials = 1000000;
+  double sum_tree = 0.0;
+  double sum_per_link = 0.0;
+  measure_ns({f_tree}, {12 * tree.n_links()}, input, n_trials / 10, sum_tree);  // warm-up
+  double ns_tree = measure_ns({f_tree}, {12 * tree.n_links()}, input, n_trials, sum_tree);
+  double ns_per_link = measure_ns(f_per_link, per_link_sizes, input, n_trials, sum_per_link);
+  std::cout << "single kernel: " << ns_tree << " ns" << std::endl;
+  std::cout << "kernel per link: " << ns_per_link << " ns" << std::endl;
+
+  // the same kernel compiled ahead of time by add_tenkai_kernels, inlined by LTO
+  static_assert(bench_kernels::forward_kinematics_n_outputs == 12 * 14);
+  double sum_library = 0.0;
+  {
+    std::vector<double> output(bench_kernels::forward_kinematics_n_outputs);
+    auto start = std::chrono::high_resolution_clock::now();
+    for (size_t i = 0; i < n_trials; i++) {
+      bench_kernels::forward_kinematics(input.data(), output.data(), nullptr);
+      sum_library += output.back();
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    std::cout << "kernel library: "
+              << std::chrono::duration<double, std::nano>(end - start).count() / n_trials << " ns"
+              << std::endl;
+  }
+
+  // native kernel with entries for all the links, the hand only and the tip of one finger
+  auto joint_values = Vector::Var(tree.n_joints()).elements;
+  auto elements = tree.pose_elements(joint_values);
+  auto pose_indices = [](std::vector<size_t> links) {
+    std::vector<size_t> indices;
+    for (auto link : links) {
+      for (size_t i = 0; i < 12; i++) {
+        indices.push_back(12 * link + i);
+      }
+    }
+    return indices;
+  };
+  std::vector<size_t> all_links(tree.n_links());
+  std::iota(all_links.begin(), all_links.end(), 0);
+  size_t hand = 7;
+  auto entries = compiler::compile_entries(
+      joint_values, elements,
+      {pose_indices(all_links), pose_indices({hand}),
+       pose_indices({tree.n_links() - 4})});
+  double sum_entries = 0.0;
+  // every entry writes its poses at their place in the poses of all the links
+  for (auto [name, e] : {std::pair{"all links", 0}, std::pair{"hand", 1},
+                         std::pair{"fingertip", 2}}) {
+    double ns = measure_ns({entries[e]}, {12 * tree.n_links()}, input, n_trials, sum_entries);
+    std::cout << "native entry, " << name << ": " << ns << " ns" << std::endl;
+  }
+
+  // joint angles read from the robot state and poses written into the link structures, by
+  // staging copies around a dense kernel or in place with the layout of the structures
+  struct JointState {
+    double position;
+    double velocity;
+    double effort;
+  };
+  struct LinkState {
+    double pose[12];
+    uint64_t stamp;
+  };
+  std::vector<JointState> joints(tree.n_joints());
+  for (size_t i = 0; i < joints.size(); i++) {
+    joints[i].position = input[i];
+  }
+  std::vector<LinkState> links(tree.n_links());
+  auto f_dense = compiler::compile(joint_values, elements);
+  compiler::CompileOptions options;
+  options.layout.input_offsets = compiler::IoLayout::strided(
+      tree.n_joints(), offsetof(JointState, position), sizeof(JointState));
+  for (size_t link = 0; link < tree.n_links(); link++) {
+    for (size_t i = 0; i < 12; i++) {
+      options.layout.output_offsets.push_back(link * sizeof(LinkState) +
+                                              offsetof(LinkState, pose) + i * sizeof(double));
+    }
+  }
+  auto f_layout = compiler::compile(joint_values, elements, options);
+  double sum_layout = 0.0;
+  std::vector<double> staged_input(tree.n_joints());
+  std::vector<double> staged_output(12 * tree.n_links());
+  auto start = std::chrono::high_resolution_clock::now();
+  for (size_t trial = 0; trial < n_trials; trial++) {
+    for (size_t i = 0; i < joints.size(); i++) {
+      staged_input[i] = joints[i].position;
+    }
+    f_dense(staged_input.data(), staged_output.data(), nullptr);
+    for (size_t link = 0; link < links.size(); link++) {
+      std::copy_n(staged_output.data() + 12 * link, 12, links[link].pose);
+    }
+    sum_layout += links.back().pose[11];
+  }
+  auto end = std::chrono::high_resolution_clock::now();
+  std::cout << "native with staging copies: "
+            << std::chrono::duration<double, std::nano>(end - start).count() / n_trials << " ns"
+            << std::endl;
+  start = std::chrono::high_resolution_clock::now();
+  for (size_t trial = 0; trial < n_trials; trial++) {
+    f_layout(reinterpret_cast<double*>(joints.data()), reinterpret_cast<double*>(links.data()),
+             nullptr);
+    sum_layout += links.back().pose[11];
+  }
+  end = std::chrono::high_resolution_clock::now();
+  std::cout << "native with layout: "
+            << std::chrono::duration<double, std::nano>(end - start).count() / n_trials << " ns"
+            << std::endl;
+  std::cout << sum_tree << " " << sum_per_link << " " << sum_library << " " << sum_entries << " "
+            << sum_layout << std::endl;
+}
@@ -0,0 +1,77 @@
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <vector>
+#include "cg.hpp"
+#include "compile.hpp"
+#include "linalg.hpp"
+
+using namespace tenkai;
+
+auto gen_graph() {
+  auto p = Vector::Var(3);
+  auto q = Vector::Var(3);
+  auto quat = Vector::Var(4);
+
+  // point-to-point distance and direction
+  auto diff = p + (-q);
+  auto dist = sqrt(diff.sqnorm());
+  auto dir = diff * (Operation::make_one() / dist);
+
+  // quaternion normalization and its rotation angle
+  auto qnorm = sqrt(quat.sqnorm());
+  auto qw = quat(3) / qnorm;
+  auto qv_norm = sqrt(quat(0) * quat(0) + quat(1) * quat(1) + quat(2) * quat(2)) / qnorm;
+  auto angle = Operation::make_constant(2.0) * atan2(qv_norm, qw);
+
+  // soft distance penalty
+  auto penalty = log(Operation::make_one() + exp(Operation::make_constant(0.5) - dist));
+  auto decay = pow(dist, Operation::make_constant(1.5));
+
+  std::vector<Operation::Ptr> inputs;
+  inputs.insert(inputs.end(), p.elements.begin(), p.elements.end());
+  inputs.insert(inputs.end(), q.elements.begin(), q.elements.end());
+  inputs.insert(inputs.end(), quat.elements.begin(), quat.elements.end());
+  std::vector<Operation::Ptr> outputs = {dist, dir(0), dir(1), dir(2), angle, penalty, decay};
+  return std::make_pair(inputs, outputs);
+}
+
+double run(JitFunc<double> func, std::vector<double>& inputs, size_t n_inputs, double& sum) {
+  std::vector<double> output(7);
+  size_t n_samples = inputs.size() / n_inputs;
+  auto start = std::chrono::high_resolution_clock::now();
+  for (size_t i = 0; i < n_samples; ++i) {
+    func(inputs.data() + i * n_inputs, output.data(), nullptr);
+    sum += output[0] + output[4] + output[5];
+  }
+  auto end = std::chrono::high_resolution_clock::now();
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count() /
+         static_cast<double>(n_samples);
+}
+
+int main() {
+  auto [inputs, outputs] = gen_graph();
+  auto f_native = compiler::compile(inputs, outputs);
+  auto f_gcc = jit_compile<double>(inputs, outputs, "g++");
+
+  // sample inputs outside of the timed region
+  size_t n_samples = 1000000;
+  std::mt19937 gen(0);
+  std::uniform_real_distribution<double> dis(-1.0, 1.0);
+  std::vector<double> samples(n_samples * inputs.size());
+  for (auto& value : samples) {
+    value = dis(gen);
+  }
+
+  double sum_native = 0.0;
+  double sum_gcc = 0.0;
+  run(f_native, samples, inputs.size(), sum_native);  // warm-up
+  run(f_gcc, samples, inputs.size(), sum_gcc);
+  double ns_native = run(f_native, samples, inputs.size(), sum_native);
+  double ns_gcc = run(f_gcc, samples, inputs.size(), sum_gcc);
+
+  std::cout << "native: " << ns_native << " ns" << std::endl;
+  std::cout << "g++: " << ns_gcc << " ns" << std::endl;
+  std::cout << "native/g++ ratio: " << ns_native / ns_gcc << std::endl;
+  std::cout << "checksum diff: " << sum_native - sum_gcc << std::endl;
+}
@@ -0,0 +1,172 @@
+// Scaling benchmark on random graphs (see random_graph.hpp) of growing size.
+//
+//   ./bench_scaling [max_nodes=1000000] [gcc_max_nodes=10000] > scaling.csv
+//
+// prints one CSV row per size, to be plotted against n_nodes e.g. by
+//   gnuplot -e "set datafile separator ','; set logscale xy; set key autotitle columnhead;
+//               plot 'scaling.csv' using 1:5 with linespoints" -p
+// Each size runs in a forked process so that peak_rss_mb is the peak of that size alone.
+// The native results are checked against the g++ backend up to gcc_max_nodes.
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <unordered_set>
+#include <variant>
+#include <vector>
+#include "cg.hpp"
+#include "compile.hpp"
+#include "operation_scheduler.hpp"
+#include "random_graph.hpp"
+#include "register_alloc.hpp"
+
+using namespace tenkai;
+
+double elapsed_ms(std::chrono::steady_clock::time_point start) {
+  auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+// distinct nodes reachable from the outputs, by pointer and by hash_id. More pointers than
+// hash_ids means nodes merged by CSE, either legitimately (e.g. a + b and b + a) or by
+// hash collision
+std::pair<size_t, size_t> count_reachable(const std::vector<Operation::Ptr>& outputs) {
+  std::unordered_set<const Operation*> pointers;
+  std::unordered_set<int32_t> hash_ids;
+  std::vector<const Operation*> stack;
+  for (const auto& output : outputs) {
+    stack.push_back(output.get());
+  }
+  while (!stack.empty()) {
+    auto op = stack.back();
+    stack.pop_back();
+    if (!pointers.insert(op).second) {
+      continue;
+    }
+    hash_ids.insert(op->hash_id);
+    for (const auto& arg : op->args) {
+      stack.push_back(arg.get());
+    }
+  }
+  return {pointers.size(), hash_ids.size()};
+}
+
+void run(size_t n_nodes, size_t gcc_max_nodes) {
+  RandomGraphConfig config;
+  config.n_nodes = n_nodes;
+  config.n_inputs = 64;
+  config.n_outputs = 64;
+  config.depth = std::max<size_t>(4, static_cast<size_t>(std::sqrt(n_nodes)));
+  config.sharing = 0.2;
+  config.weight_extcall = 0.5;
+  config.seed = 0;
+
+  auto start = std::chrono::steady_clock::now();
+  auto graph = make_random_graph(config);
+  double build_ms = elapsed_ms(start);
+  auto [n_reachable, n_hash_ids] = count_reachable(graph.outputs);
+
+  // the stages of the native compiler, timed separately
+  start = std::chrono::steady_clock::now();
+  auto opseq = compiler::DepthFirstScheduler().flatten(graph.inputs, graph.outputs);
+  double schedule_ms = elapsed_ms(start);
+  start = std::chrono::steady_clock::now();
+  register_alloc::RegisterAllocator allocator(opseq, graph.inputs, graph.outputs);
+  auto transset_seq = allocator.allocate();
+  double allocate_ms = elapsed_ms(start);
+  size_t n_spills = 0;
+  for (const auto& transset : transset_seq) {
+    for (const auto& trans : transset) {
+      if (std::holds_alternative<register_alloc::RawTransition>(trans) &&
+          std::get<register_alloc::RawTransition>(trans).dst.type ==
+              register_alloc::LocationType::STACK) {
+        n_spills++;
+      }
+    }
+  }
+
+  start = std::chrono::steady_clock::now();
+  auto code = compiler::generate_code(graph.inputs, graph.outputs);
+  double codegen_ms = elapsed_ms(start);
+  auto f_native = compiler::compile(graph.inputs, graph.outputs);
+
+  // C++ source of the g++ backend
+  start = std::chrono::steady_clock::now();
+  std::ostringstream source;
+  flatten("kernel", graph.inputs, graph.outputs, source, "double");
+  double flatten_ms = elapsed_ms(start);
+
+  // differential check against g++ on a few random inputs
+  double gcc_ms = std::nan("");
+  double max_rel_error = std::nan("");
+  if (n_nodes <= gcc_max_nodes) {
+    start = std::chrono::steady_clock::now();
+    auto f_gcc = jit_compile<double>(graph.inputs, graph.outputs, "g++");
+    gcc_ms = elapsed_ms(start);
+
+    void* extfns[] = {reinterpret_cast<void*>(&random_graph_ext_func)};
+    std::mt19937 gen(0);
+    std::uniform_real_distribution<double> dis(-1.0, 1.0);
+    std::vector<double> input(graph.inputs.size());
+    std::vector<double> output_native(graph.outputs.size());
+    std::vector<double> output_gcc(graph.outputs.size());
+    max_rel_error = 0.0;
+    for (size_t trial = 0; trial < 8; trial++) {
+      for (auto& value : input) {
+        value = dis(gen);
+      }
+      f_native(input.data(), output_native.data(), extfns);
+      f_gcc(input.data(), output_gcc.data(), extfns);
+      for (size_t i = 0; i < output_native.size(); i++) {
+        double a = output_native[i];
+        double b = output_gcc[i];
+        if (a == b || (std::isnan(a) && std::isnan(b))) {
+          continue;
+        }
+        double rel_error = std::abs(a - b) / std::max({1.0, std::abs(a), std::abs(b)});
+        max_rel_error = std::max(max_rel_error, std::isnan(rel_error) ? INFINITY : rel_error);
+      }
+    }
+  }
+
+  rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  std::cout << n_nodes << "," << n_reachable << "," << n_reachable - n_hash_ids << ","
+            << build_ms << "," << schedule_ms << "," << allocate_ms << "," << codegen_ms << ","
+            << code.size() << "," << n_spills << "," << allocator.get_stack_size() << ","
+            << flatten_ms << "," << source.tellp() << "," << gcc_ms << "," << max_rel_error << "," << usage.ru_maxrss / 1024.0 << std::endl;
+}
+
+int main(int argc, char** argv) {
+  size_t max_nodes = argc > 1 ? std::atol(argv[1]) : 1000000;
+  size_t gcc_max_nodes = argc > 2 ? std::atol(argv[2]) : 10000;
+
+  std::cout << "n_nodes,reachable_nodes,merged_nodes,build_ms,schedule_ms,allocate_ms,"
+            << "native_compile_ms,code_bytes,spills,stack_slots,flatten_ms,source_bytes,"
+            << "gcc_compile_ms,max_rel_error,"
+            << "peak_rss_mb" << std::endl;
+  for (size_t n_nodes = 100; n_nodes <= max_nodes; n_nodes *= 10) {
+    for (size_t n : {n_nodes, n_nodes * 3}) {
+      if (n > max_nodes) {
+        break;
+      }
+      pid_t pid = fork();
+      if (pid == 0) {
+        try {
+          run(n, gcc_max_nodes);
+        } catch (const std::exception& e) {
+          std::cerr << "n_nodes=" << n << ": " << e.what() << std::endl;
+          std::_Exit(1);
+        }
+        std::_Exit(0);
+      }
+      int status;
+      waitpid(pid, &status, 0);
+    }
+  }
+}
@@ -1,16 +1,18 @@
 #include <iostream>
+#include <limits>
 #include <random>
 #include <Eigen/Core>
 #include <Eigen/Geometry>
 #include <chrono>
 #include <vector>
 #include "cg.hpp"
+#include "compile.hpp"
 #include "linalg.hpp"
 #include "spatial.hpp"
 
 using namespace tenkai;
 
-auto get_jit_func() {
+auto make_chain() {
   auto x0 = Operation::make_var();
   auto x1 = Operation::make_var();
   auto x2 = Operation::make_var();
@@ -33,12 +35,65 @@ auto get_jit_func() {
 
   std::vector<Operation::Ptr> inputs = {x0, x1, x2, x3, x4, x5, x6};
   auto outputs = tf10.trans.elements;
+  return std::make_pair(inputs, outputs);
+}
+
+auto get_jit_func() {
+  auto [inputs, outputs] = make_chain();
   // flatten("flattened", inputs, outputs, std::cout, "double"); // debug
   bool disassemble = true;
   auto f_jit = jit_compile<double>(inputs, outputs, "g++", disassemble);
   return f_jit;
 }
 
+// same chain with the quaternion representation
+auto make_chain_quat() {
+  std::vector<Operation::Ptr> inputs;
+  for (size_t i = 0; i < 7; i++) {
+    inputs.push_back(Operation::make_var());
+  }
+  auto& x = inputs;
+  auto trans = Vector({Operation::make_constant(0.1), Operation::make_constant(0.2), Operation::make_constant(0.3)});
+  auto tf1 = QuatTransform(Quaternion::RotX(x[0]), trans);
+  auto tf2 = QuatTransform(Quaternion::RotY(x[1]), trans);
+  auto tf3 = QuatTransform(Quaternion::RotZ(x[2]), trans);
+  auto tf4 = QuatTransform(Quaternion::RotX(x[3]), trans);
+  auto tf5 = QuatTransform(Quaternion::RotY(x[4]), trans);
+  auto tf6 = QuatTransform(Quaternion::RotZ(x[5]), trans);
+  auto tf7 = QuatTransform(Quaternion::RotX(x[6]), trans);
+  auto tf8 = tf4 * tf3 * tf2 * tf1;
+  auto tf9 = tf7 * tf6 * tf5 * tf1;
+  auto tf10 = tf9 * tf8;
+
+  auto outputs = tf10.trans.elements;
+  return std::make_pair(inputs, outputs);
+}
+
+auto get_jit_func_quat() {
+  auto [inputs, outputs] = make_chain_quat();
+  auto f_jit = jit_compile<double>(inputs, outputs, "g++");
+  return f_jit;
+}
+
+// minimum over 10 rounds of n_trials / 10 calls, to filter out the noise of other processes
+double measure_ns(JitFunc<double> func, std::vector<double>& input, size_t n_trials, double& sum) {
+  std::vector<double> output(3);
+  func(input.data(), output.data(), nullptr);  // warm-up
+  double best = std::numeric_limits<double>::infinity();
+  size_t n_round_trials = n_trials / 10;
+  for (size_t round = 0; round < 10; round++) {
+    auto start = std::chrono::high_resolution_clock::now();
+    for (size_t i = 0; i < n_round_trials; i++) {
+      func(input.data(), output.data(), nullptr);
+      sum += output[0];
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    best = std::min(best,
+                    std::chrono::duration<double, std::nano>(end - start).count() / n_round_trials);
+  }
+  return best;
+}
+
 
 struct QuatTrans {
   Eigen::Quaterniond quat;
@@ -107,6 +162,18 @@ int main() {
   std::cout << "jit: " << std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count() / n_trials << " ns" << std::endl;
   std::cout << sum << std::endl;
 
+  auto f_jit_quat = get_jit_func_quat();
+  f_jit_quat(input.data(), output.data(), nullptr);
+  start = std::chrono::high_resolution_clock::now();
+  double sum_quat = 0;
+  for(int i = 0; i < n_trials; i++) {
+    f_jit_quat(input.data(), output.data(), nullptr);
+    sum_quat += output[0];
+  }
+  end = std::chrono::high_resolution_clock::now();
+  std::cout << "jit (quaternion): " << std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count() / n_trials << " ns" << std::endl;
+  std::cout << sum_quat << std::endl;
+
   eigen_counterpart(input.data(), output_eigen.data());
   start = std::chrono::high_resolution_clock::now();
   double sum_eigen = 0.0;
@@ -117,4 +184,22 @@ int main() {
   end = std::chrono::high_resolution_clock::now();
   std::cout << "eigen: " << std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count() / n_trials << " ns" << std::endl;
   std::cout << sum_eigen << std::endl;
+
+  // native kernels scheduled depth first and by ListScheduler
+  double sum_native = 0.0;
+  for (auto [name, graph] : {std::pair{"matrix", make_chain()},
+                             std::pair{"quaternion", make_chain_quat()}}) {
+    auto f_depth_first = compiler::compile(graph.first, graph.second);
+    compiler::CompileOptions options;
+    options.machine_model = compiler::MachineModel();
+    auto f_list = compiler::compile(graph.first, graph.second, options);
+    options.machine_model = compiler::MachineModel::zen4();
+    auto f_list_zen4 = compiler::compile(graph.first, graph.second, options);
+    std::cout << "native " << name
+              << ", depth first: " << measure_ns(f_depth_first, input, n_trials, sum_native)
+              << " ns, list: " << measure_ns(f_list, input, n_trials, sum_native)
+              << " ns, list (zen4 model): " << measure_ns(f_list_zen4, input, n_trials, sum_native)
+              << " ns" << std::endl;
+  }
+  std::cout << sum_native << std::endl;
 }
@@ -0,0 +1,190 @@
+// Benchmark suite on a serial chain of n rigid transforms, parameterized over n.
+//
+//   ./bench_suite --benchmark_out=result.json --benchmark_out_format=json
+//
+// writes machine-readable results, which can be compared between two versions with
+// compare.py shipped with Google Benchmark.
+#include <benchmark/benchmark.h>
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+#include <random>
+#include <vector>
+#include "cg.hpp"
+#include "compile.hpp"
+#include "linalg.hpp"
+#include "spatial.hpp"
+
+using namespace tenkai;
+
+constexpr size_t kBatchSize = 4096;
+
+struct Chain {
+  std::vector<Operation::Ptr> inputs;
+  std::vector<Operation::Ptr> outputs;
+};
+
+// joint axes cycle through X, Y and Z, and every link has the same constant offset
+Chain make_chain(size_t n_joints) {
+  Chain chain;
+  chain.inputs = Vector::Var(n_joints).elements;
+  auto trans = Vector({Operation::make_constant(0.1), Operation::make_constant(0.2),
+                       Operation::make_constant(0.3)});
+  auto rotation = [](size_t i, const Operation::Ptr& angle) {
+    switch (i % 3) {
+      case 0:
+        return Matrix::RotX(angle);
+      case 1:
+        return Matrix::RotY(angle);
+      default:
+        return Matrix::RotZ(angle);
+    }
+  };
+  auto tf = SpatialTransform(rotation(0, chain.inputs[0]), trans);
+  for (size_t i = 1; i < n_joints; i++) {
+    tf = tf * SpatialTransform(rotation(i, chain.inputs[i]), trans);
+  }
+  chain.outputs = tf.trans.elements;
+  return chain;
+}
+
+void eigen_chain(const double* input, double* output, size_t n_joints) {
+  Eigen::Quaterniond quat = Eigen::Quaterniond::Identity();
+  Eigen::Vector3d trans = Eigen::Vector3d::Zero();
+  const Eigen::Vector3d offset(0.1, 0.2, 0.3);
+  for (size_t i = 0; i < n_joints; i++) {
+    Eigen::Vector3d axis = Eigen::Vector3d::Unit(i % 3);
+    trans = quat * offset + trans;
+    quat = quat * Eigen::Quaterniond(Eigen::AngleAxisd(input[i], axis));
+  }
+  output[0] = trans.x();
+  output[1] = trans.y();
+  output[2] = trans.z();
+}
+
+// input samples are drawn before the timed region
+std::vector<double> make_samples(size_t n_joints, size_t n_samples) {
+  std::mt19937 gen(0);
+  std::uniform_real_distribution<double> dis(-M_PI, M_PI);
+  std::vector<double> samples(n_joints * n_samples);
+  for (auto& value : samples) {
+    value = dis(gen);
+  }
+  return samples;
+}
+
+JitFunc<double> compile_chain(const Chain& chain, bool native) {
+  if (native) {
+    return compiler::compile(chain.inputs, chain.outputs);
+  }
+  return jit_compile<double>(chain.inputs, chain.outputs, "g++");
+}
+
+// graph construction is not included, only the compilation
+void BM_Compile(benchmark::State& state, bool native) {
+  auto chain = make_chain(state.range(0));
+  for (auto _ : state) {
+    auto func = compile_chain(chain, native);
+    benchmark::DoNotOptimize(func);
+  }
+}
+
+void BM_Call(benchmark::State& state, bool native) {
+  size_t n_joints = state.range(0);
+  auto func = compile_chain(make_chain(n_joints), native);
+  auto input = make_samples(n_joints, 1);
+  double output[3];
+  for (auto _ : state) {
+    func(input.data(), output, nullptr);
+    benchmark::DoNotOptimize(output);
+  }
+}
+
+void BM_Throughput(benchmark::State& state, bool native) {
+  size_t n_joints = state.range(0);
+  auto func = compile_chain(make_chain(n_joints), native);
+  auto samples = make_samples(n_joints, kBatchSize);
+  std::vector<double> outputs(3 * kBatchSize);
+  for (auto _ : state) {
+    for (size_t i = 0; i < kBatchSize; i++) {
+      func(samples.data() + i * n_joints, outputs.data() + i * 3, nullptr);
+    }
+    benchmark::DoNotOptimize(outputs.data());
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * kBatchSize);
+}
+
+// the samples are transposed to one column per joint, as the batch kernel takes them
+void BM_ThroughputBatch(benchmark::State& state, const char* flags) {
+  size_t n_joints = state.range(0);
+  auto chain = make_chain(n_joints);
+  JitOptions options;
+  options.flags = flags;
+  auto func = jit_compile_batch<double>(chain.inputs, chain.outputs, options);
+  auto samples = make_samples(n_joints, kBatchSize);
+  std::vector<double> columns(n_joints * kBatchSize);
+  for (size_t i = 0; i < kBatchSize; i++) {
+    for (size_t j = 0; j < n_joints; j++) {
+      columns[j * kBatchSize + i] = samples[i * n_joints + j];
+    }
+  }
+  std::vector<const double*> input(n_joints);
+  for (size_t j = 0; j < n_joints; j++) {
+    input[j] = columns.data() + j * kBatchSize;
+  }
+  std::vector<double> outputs(3 * kBatchSize);
+  double* output[3] = {outputs.data(), outputs.data() + kBatchSize,
+                       outputs.data() + 2 * kBatchSize};
+  for (auto _ : state) {
+    func(input.data(), output, nullptr, kBatchSize);
+    benchmark::DoNotOptimize(outputs.data());
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * kBatchSize);
+}
+
+void BM_CallEigen(benchmark::State& state) {
+  size_t n_joints = state.range(0);
+  auto input = make_samples(n_joints, 1);
+  double output[3];
+  for (auto _ : state) {
+    eigen_chain(input.data(), output, n_joints);
+    benchmark::DoNotOptimize(output);
+  }
+}
+
+void BM_ThroughputEigen(benchmark::State& state) {
+  size_t n_joints = state.range(0);
+  auto samples = make_samples(n_joints, kBatchSize);
+  std::vector<double> outputs(3 * kBatchSize);
+  for (auto _ : state) {
+    for (size_t i = 0; i < kBatchSize; i++) {
+      eigen_chain(samples.data() + i * n_joints, outputs.data() + i * 3, n_joints);
+    }
+    benchmark::DoNotOptimize(outputs.data());
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * kBatchSize);
+}
+
+// compile latency is measured in wall time as g++ runs in a child process.
+// every compilation leaves its code mapped, so the number of g++ compilations is kept small
+BENCHMARK_CAPTURE(BM_Compile, native, true)->RangeMultiplier(2)->Range(1, 16)
+    ->Unit(benchmark::kMicrosecond)->UseRealTime();
+BENCHMARK_CAPTURE(BM_Compile, gcc, false)->RangeMultiplier(2)->Range(1, 16)
+    ->Unit(benchmark::kMillisecond)->Iterations(3)->UseRealTime();
+BENCHMARK_CAPTURE(BM_Call, native, true)->RangeMultiplier(2)->Range(1, 16);
+BENCHMARK_CAPTURE(BM_Call, gcc, false)->RangeMultiplier(2)->Range(1, 16);
+BENCHMARK(BM_CallEigen)->RangeMultiplier(2)->Range(1, 16);
+BENCHMARK_CAPTURE(BM_Throughput, native, true)->RangeMultiplier(2)->Range(1, 16)
+    ->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_Throughput, gcc, false)->RangeMultiplier(2)->Range(1, 16)
+    ->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_ThroughputBatch, gcc, "-O3")->RangeMultiplier(2)->Range(1, 16)
+    ->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_ThroughputBatch, gcc_fast_math,
+                  "-O3 -march=native -ffast-math -fdisable-tree-sincos")
+    ->RangeMultiplier(2)->Range(1, 16)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_ThroughputEigen)->RangeMultiplier(2)->Range(1, 16)->Unit(benchmark::kMicrosecond);
+
+BENCHMARK_MAIN();
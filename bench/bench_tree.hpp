@@ -0,0 +1,29 @@
+#pragma once
+#include <optional>
+#include <vector>
+#include "kinematics.hpp"
+
+namespace tenkai {
+
+// 7 dof arm with a hand carrying two 3 dof fingers
+inline KinematicTree make_tree() {
+  KinematicTree tree;
+  std::vector<Axis> arm_axes = {Axis::Z, Axis::Y, Axis::Z, Axis::Y, Axis::Z, Axis::Y, Axis::Z};
+  std::optional<size_t> parent = std::nullopt;
+  for (auto axis : arm_axes) {
+    parent = tree.add_link(parent, JointType::REVOLUTE, axis,
+                           KinematicTree::make_offset({0.0, 0.05, 0.3}, {0.1, 0.0, 0.0}));
+  }
+  auto hand = tree.add_link(parent, JointType::FIXED, Axis::X,
+                            KinematicTree::make_offset({0.0, 0.0, 0.1}));
+  for (double side : {-1.0, 1.0}) {
+    std::optional<size_t> finger = hand;
+    for (size_t i = 0; i < 3; i++) {
+      finger = tree.add_link(finger, JointType::REVOLUTE, Axis::X,
+                             KinematicTree::make_offset({0.0, 0.02 * side, 0.04}));
+    }
+  }
+  return tree;
+}
+
+}  // namespace tenkai
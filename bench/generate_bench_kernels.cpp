@@ -0,0 +1,19 @@
+// generator of the bench_kernels library (see add_tenkai_kernels in CMakeLists.txt)
+#include <iostream>
+#include "bench_tree.hpp"
+#include "kernel_library.hpp"
+#include "linalg.hpp"
+
+using namespace tenkai;
+
+int main(int argc, char** argv) {
+  if (argc != 3) {
+    std::cerr << "usage: " << argv[0] << " <output dir> <library name>" << std::endl;
+    return 1;
+  }
+  KernelLibrary library(argv[2]);
+  auto tree = make_tree();
+  auto joint_values = Vector::Var(tree.n_joints()).elements;
+  library.add("forward_kinematics", joint_values, tree.pose_elements(joint_values));
+  library.write(argv[1]);
+}
@@ -0,0 +1,29 @@
+#pragma once
+#include "cg.hpp"
+#include "linalg.hpp"
+
+namespace tenkai {
+
+// Automatic differentiation over the operation graph.
+// The derivative nodes are built on top of the given graph (e.g. the derivative of sin(x)
+// uses the cos(x) node if it already exists), so compiling them together with the original
+// outputs evaluates values and derivatives in one kernel sharing the forward computation.
+
+// d output / d inputs[i] for each i
+std::vector<Operation::Ptr> gradient(const Operation::Ptr& output,
+                                     const std::vector<Operation::Ptr>& inputs);
+
+// n_outputs x n_inputs matrix whose (i, j) element is d outputs[i] / d inputs[j]
+Matrix jacobian(const std::vector<Operation::Ptr>& outputs,
+                const std::vector<Operation::Ptr>& inputs);
+
+// Forward-mode Jacobian-vector products for K seed directions at once.
+// seeds[k] is a direction over the inputs, typically fresh variables passed as additional
+// inputs of the kernel. Returns tangents[k][i] = sum_j d outputs[i] / d inputs[j] * seeds[k][j]
+// Cheaper than jacobian() when there are few directions and many outputs.
+std::vector<std::vector<Operation::Ptr>> jvp(
+    const std::vector<Operation::Ptr>& outputs,
+    const std::vector<Operation::Ptr>& inputs,
+    const std::vector<std::vector<Operation::Ptr>>& seeds);
+
+}  // namespace tenkai
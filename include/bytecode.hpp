@@ -0,0 +1,68 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "cg.hpp"
+
+namespace tenkai {
+
+namespace compiler {
+
+// Interpreted kernel for the expressions that are evaluated only a few times, for which
+// generating and mapping native code costs more than the evaluations. It is built from the
+// operation sequence of DepthFirstScheduler into a register-based bytecode, and is called
+// like a JitFunc<double> with the same function table and parameter slot.
+//
+// The constants and the inputs are copied into the first registers on entry, so they cost no
+// instruction, and a register is reused once its value has no remaining use. Each output is
+// stored as soon as its value is computed. Calls are reentrant and thread-safe.
+class BytecodeKernel {
+ public:
+  BytecodeKernel(const std::vector<Operation::Ptr>& inputs,
+                 const std::vector<Operation::Ptr>& outputs);
+  void operator()(const double* input, double* output, void** extfns) const;
+
+  size_t n_instructions() const { return code_.size(); }
+  size_t n_registers() const { return n_registers_; }
+
+  // external functions with more arguments are rejected by the constructor
+  static constexpr size_t max_ext_args = 16;
+
+ private:
+  enum class Opcode : uint8_t {
+    ADD,
+    SUB,
+    MUL,
+    DIV,
+    NEGATE,
+    SQRT,
+    SIN,
+    COS,
+    EXP,
+    LOG,
+    ATAN2,
+    POW,
+    PARAM,  // dst <- params[a]
+    CALL,   // dst <- extfns[a](registers operands_[b], ..., operands_[b + n_args - 1])
+    STORE,  // output[dst] <- a
+    RETURN
+  };
+  // registers are dst, a and b unless noted otherwise
+  struct Instruction {
+    Opcode opcode;
+    uint8_t n_args;
+    uint32_t dst;
+    uint32_t a;
+    uint32_t b;
+  };
+
+  std::vector<Instruction> code_;
+  std::vector<uint32_t> operands_;  // arguments of the calls
+  std::vector<double> constants_;   // initial values of the registers [0, constants_.size())
+  size_t n_inputs_;                 // in the registers that follow the constants
+  size_t n_registers_;
+  size_t param_slot_;
+  bool has_params_;
+};
+
+}  // namespace compiler
+}  // namespace tenkai
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstdint>
 #include <memory>
 #include <optional>
 #include <ostream>
@@ -10,7 +11,60 @@ namespace tenkai {
 
 std::string generate_random_string(size_t length);
 
-enum class OpKind { NIL, ADD, SUB, MUL, COS, SIN, NEGATE, LOAD, ZERO, ONE, CONSTANT, EXTCALL };
+// Variables and external calls get a pseudo-random hash_id, from which the ids of the
+// expressions built on them are computed. The compilers merge the nodes of equal hash_id, so
+// the ids of distinct variables must not repeat within a process. They are drawn from a
+// per-thread stream (a counter scrambled by splitmix64), so a node costs no system call.
+// Constants take an id computed from their value.
+//
+// A thread outside of any NodeIdStream draws from a default stream, numbered in the order the
+// threads create their first node and salted once per process, so its ids differ from run to
+// run and from those of the nodes built by other processes (see graph_file.hpp).
+//
+// To build independent sub-graphs on several threads reproducibly, give each one its own
+// stream, e.g. the index of the sub-graph:
+//
+//   threads.emplace_back([&, k] { NodeIdStream stream(k); graphs[k] = build(k); });
+//
+// Only the constants are shared safely between threads: a sub-graph must not use the other
+// nodes of a sub-graph being built on another thread.
+class NodeIdStream {
+ public:
+  // the ids drawn on this thread until destruction depend only on `stream` and their order,
+  // so they are the same on every run. A stream is opened at most once per process, and the
+  // numbers with the top bit set belong to the default streams: both throw
+  explicit NodeIdStream(uint64_t stream);
+  ~NodeIdStream();  // the thread resumes the stream it was drawing from
+  NodeIdStream(const NodeIdStream&) = delete;
+  NodeIdStream& operator=(const NodeIdStream&) = delete;
+
+ private:
+  uint64_t saved_base_;
+  uint64_t saved_counter_;
+  bool saved_initialized_;
+};
+
+enum class OpKind {
+  NIL,
+  ADD,
+  SUB,
+  MUL,
+  DIV,
+  COS,
+  SIN,
+  SQRT,
+  EXP,
+  LOG,
+  ATAN2,
+  POW,
+  NEGATE,
+  LOAD,
+  ZERO,
+  ONE,
+  CONSTANT,
+  EXTCALL,
+  PARAM
+};
 constexpr std::string to_string(OpKind kind) {  // for debug
   // clang-format off
   switch (kind) {
@@ -18,19 +72,61 @@ constexpr std::string to_string(OpKind kind) {  // for debug
     case OpKind::ADD: return "ADD";
     case OpKind::SUB: return "SUB";
     case OpKind::MUL: return "MUL";
+    case OpKind::DIV: return "DIV";
     case OpKind::COS: return "COS";
     case OpKind::SIN: return "SIN";
+    case OpKind::SQRT: return "SQRT";
+    case OpKind::EXP: return "EXP";
+    case OpKind::LOG: return "LOG";
+    case OpKind::ATAN2: return "ATAN2";
+    case OpKind::POW: return "POW";
     case OpKind::NEGATE: return "NEGATE";
     case OpKind::LOAD: return "LOAD";
     case OpKind::ZERO: return "ZERO";
     case OpKind::ONE: return "ONE";
     case OpKind::CONSTANT: return "CONSTANT";
     case OpKind::EXTCALL: return "EXTCALL";
+    case OpKind::PARAM: return "PARAM";
     default: throw std::runtime_error("unknown OpKind");
   }
   // clang-format on
 }
 
+// operations that are lowered to a call into libm by the native compiler
+constexpr bool is_libm_call(OpKind kind) {
+  return kind == OpKind::SIN || kind == OpKind::COS || kind == OpKind::EXP ||
+         kind == OpKind::LOG || kind == OpKind::ATAN2 || kind == OpKind::POW;
+}
+
+// operations that are lowered to a function call by the native compiler
+constexpr bool is_call(OpKind kind) {
+  return is_libm_call(kind) || kind == OpKind::EXTCALL;
+}
+
+// number of operands of an operation of this kind, or nullopt for EXTCALL, which takes any
+constexpr std::optional<size_t> arity(OpKind kind) {
+  switch (kind) {
+    case OpKind::ADD:
+    case OpKind::SUB:
+    case OpKind::MUL:
+    case OpKind::DIV:
+    case OpKind::ATAN2:
+    case OpKind::POW:
+      return 2;
+    case OpKind::COS:
+    case OpKind::SIN:
+    case OpKind::SQRT:
+    case OpKind::EXP:
+    case OpKind::LOG:
+    case OpKind::NEGATE:
+      return 1;
+    case OpKind::EXTCALL:
+      return std::nullopt;
+    default:
+      return 0;
+  }
+}
+
 struct Operation : std::enable_shared_from_this<Operation> {
   using Ptr = std::shared_ptr<Operation>;
   using WeakPtr = std::weak_ptr<Operation>;
@@ -39,10 +135,18 @@ struct Operation : std::enable_shared_from_this<Operation> {
   void to_cpp_expr(std::ostream& strm) const;
   static Operation::Ptr create(OpKind kind, std::vector<Operation::Ptr>&& args, int32_t hash_id);
   static Operation::Ptr make_var();
+  // ZERO and ONE are singletons and constants are interned by value, so these do not allocate
+  // for values that already exist. Being shared, they do not register their callers.
   static Operation::Ptr make_zero();
   static Operation::Ptr make_one();
   static Operation::Ptr make_ext_func(std::string&& name, std::vector<Operation::Ptr>&& args);
   static Operation::Ptr make_constant(double value);
+  // ZERO or ONE for the values +0.0 and 1.0, so that the operators simplify them away, and
+  // make_constant otherwise. The operators fold constant operands into such constants
+  static Operation::Ptr make_canonical_constant(double value);
+  // value read from the parameter buffer at run time (see param_slot), so that it can be
+  // changed without recompiling the kernel. Unlike a constant, it is never folded
+  static Operation::Ptr make_param(size_t index);
   std::vector<Operation::Ptr> get_leafs();
   inline bool is_nullaryop() const { return args.size() == 0; }
   inline bool is_unaryop() const { return args.size() == 1; }
@@ -57,30 +161,90 @@ struct Operation : std::enable_shared_from_this<Operation> {
   std::vector<WeakPtr> callers;
   std::optional<std::string> ext_func_name;  // used only for EXTCALL kind
   std::optional<double> constant_value;      // used only for zero, one, constant
+  std::optional<size_t> param_index;         // used only for PARAM
 };
 
+// External functions are passed to the compiled function through `void** extfns`.
+// The slot of each function is its position in this table, which is the sorted list of
+// distinct ext_func_name found in the graph.
+std::vector<std::string> ext_func_table(const std::vector<Operation::Ptr>& outputs);
+
+// The parameter buffer (make_param(i) reads element i) is passed in the slot of `void** extfns`
+// that follows the external functions, i.e. extfns[ext_func_table(outputs).size()]. Its
+// element type is the one of the kernel. The buffer is read on every call, so updating it
+// takes effect on the next call.
+size_t param_slot(const std::vector<Operation::Ptr>& outputs);
+// number of elements of the parameter buffer read by the graph, the largest param_index + 1,
+// or 0 if the graph has no parameter
+size_t param_count(const std::vector<Operation::Ptr>& outputs);
+
 void flatten(const std::string& func_name,
              const std::vector<Operation::Ptr>& inputs,
              const std::vector<Operation::Ptr>& outputs,
              std::ostream& strm,
              const std::string& type_name);
 
+// Same as flatten but the function evaluates n points at once. The inputs and outputs are
+// column-major (structure of arrays): input[k][i] is the k-th input of the i-th point. The loop
+// over the points is marked `#pragma omp simd`, so the compiler vectorizes it across points.
+void flatten_batch(const std::string& func_name,
+                   const std::vector<Operation::Ptr>& inputs,
+                   const std::vector<Operation::Ptr>& outputs,
+                   std::ostream& strm,
+                   const std::string& type_name);
+
 template <typename T>
 using JitFunc = void (*)(T*, T*, void**);
 
+template <typename T>
+using BatchJitFunc = void (*)(const T* const* input, T* const* output, void** extfns, size_t n);
+
+struct JitOptions {
+  std::string compiler = "g++";
+  // e.g. "-O3 -march=native" to use the vector width of the host. The batch kernels call
+  // the vectorized sin, cos, exp, log and pow of glibc only with -ffast-math, and GCC stops
+  // vectorizing once it merges sin and cos of the same angle into sincos, which
+  // -fdisable-tree-sincos prevents
+  std::string flags = "-O3";
+  bool disas = false;  // print the disassembly of the kernel with objdump
+};
+
+template <typename T>
+JitFunc<T> jit_compile(const std::vector<Operation::Ptr>& inputs,
+                       const std::vector<Operation::Ptr>& outputs,
+                       const JitOptions& options);
+
 template <typename T>
 JitFunc<T> jit_compile(const std::vector<Operation::Ptr>& inputs,
                        const std::vector<Operation::Ptr>& outputs,
                        const std::string& backend = "g++",
                        bool disas = false);
 
+template <typename T>
+BatchJitFunc<T> jit_compile_batch(const std::vector<Operation::Ptr>& inputs,
+                                  const std::vector<Operation::Ptr>& outputs,
+                                  const JitOptions& options = {});
+
 Operation::Ptr operator+(Operation::Ptr lhs, Operation::Ptr rhs);
 Operation::Ptr operator-(Operation::Ptr lhs, Operation::Ptr rhs);
 Operation::Ptr operator*(Operation::Ptr lhs, Operation::Ptr rhs);
+Operation::Ptr operator/(Operation::Ptr lhs, Operation::Ptr rhs);
+Operation::Ptr atan2(Operation::Ptr y, Operation::Ptr x);
+Operation::Ptr pow(Operation::Ptr base, Operation::Ptr exponent);
 
 // unary operators
 Operation::Ptr cos(Operation::Ptr op);
 Operation::Ptr sin(Operation::Ptr op);
+Operation::Ptr sqrt(Operation::Ptr op);
+Operation::Ptr exp(Operation::Ptr op);
+Operation::Ptr log(Operation::Ptr op);
 Operation::Ptr operator-(Operation::Ptr op);
 
+// node of `kind` over `args` built through the operators above, so that it is folded and
+// simplified and takes the hash_id of the same expression written directly. ext_func_name is
+// the function of an EXTCALL, which gets a fresh id
+Operation::Ptr build_operation(OpKind kind,
+                               std::vector<Operation::Ptr> args,
+                               const std::string& ext_func_name = {});
+
 }  // namespace tenkai
@@ -1,15 +1,92 @@
 #pragma once
 #include "cg.hpp"
+#include <optional>
+#include "kernel_stats.hpp"
+#include "operation_scheduler.hpp"
 #include "xbyak.h"
 
 namespace tenkai {
 
 namespace compiler {
 
+// Byte offsets from `input` and `output` at which a native kernel reads each input and writes
+// each output, so that it works in place on the structures of the caller instead of dense
+// arrays, e.g. for the joints in an array of
+//   struct JointState { double position; double velocity; };
+// input_offsets = IoLayout::strided(n_joints, offsetof(JointState, position), sizeof(JointState))
+// The offsets become the displacements of the memory operands, so they cost nothing at run
+// time. An empty vector is the dense layout, where element k is at k * sizeof(double).
+// As with the dense layout, the outputs must not overlap the inputs.
+struct IoLayout {
+  std::vector<int32_t> input_offsets;
+  std::vector<int32_t> output_offsets;
+
+  // offset + k * stride for k < n. Throws if an offset does not fit in a 32-bit displacement
+  static std::vector<int32_t> strided(size_t n, int32_t offset, int32_t stride);
+  // whether the kernel reads and writes dense arrays
+  bool is_dense() const;
+};
+
+struct CompileOptions {
+  // name of the kernel in the profiler output and KernelRegistry. Defaults to tenkai_kernel_<n>
+  std::string name;
+  // register the kernel to perf (see perf_map.hpp)
+  bool perf_map = false;
+  bool jitdump = false;
+  // count the calls and their cycles into KernelRegistry under the name. Kernels compiled
+  // without it have no instrumentation code at all
+  bool instrument = false;
+  IoLayout layout;
+  // order the operations with ListScheduler for this model instead of depth first, which
+  // helps the kernels made of long dependent chains
+  std::optional<MachineModel> machine_model;
+};
+
+// absolute address embedded in the generated code as the 64-bit immediate at `offset`, which
+// has to be patched when the code is loaded into another process (see kernel_file.hpp)
+struct Relocation {
+  enum class Kind : uint32_t {
+    LIBM,      // address of libm_function_address(OpKind(target))
+    COUNTERS,  // KernelCounters of an instrumented kernel
+  };
+  Kind kind;
+  uint32_t target;
+  uint64_t offset;
+};
+
+void* libm_function_address(OpKind kind);
+
+// counters is non-null for an instrumented kernel. If relocations is non-null, the
+// embedded addresses are appended to it. ext_names is the function table giving the slots of
+// extfns, ext_func_table(outputs) if null. layout is the dense layout if null. The operations
+// are scheduled depth first if machine_model is null. If entries is non-null, the code starts
+// with one 16-byte entry point per element of entries, which computes and stores only the
+// outputs whose indices it lists (see compile_entries)
 std::vector<uint8_t> generate_code(const std::vector<Operation::Ptr>& inputs,
-                                   const std::vector<Operation::Ptr>& outputs);
+                                   const std::vector<Operation::Ptr>& outputs,
+                                   KernelCounters* counters = nullptr,
+                                   std::vector<Relocation>* relocations = nullptr,
+                                   const std::vector<std::string>* ext_names = nullptr,
+                                   const IoLayout* layout = nullptr,
+                                   const MachineModel* machine_model = nullptr,
+                                   const std::vector<std::vector<size_t>>* entries = nullptr);
 JitFunc<double> compile(const std::vector<Operation::Ptr>& inputs,
-                        const std::vector<Operation::Ptr>& outputs);
+                        const std::vector<Operation::Ptr>& outputs,
+                        const CompileOptions& options = {});
+
+// Kernel with one entry point per subset of the outputs, sharing a single body that computes
+// the outputs of all the entries. Entry e skips the operations that its outputs do not depend
+// on, and writes outputs[entries[e][k]] where the whole kernel would write it: at
+// output[entries[e][k]] with the dense layout and at output_offsets[entries[e][k]] otherwise,
+// leaving the other outputs untouched. The output buffer thus has the size of the whole
+// outputs. This avoids compiling and keeping a separate kernel for every combination of outputs
+// that callers need. All the entries take the function table and parameter slot of the whole
+// outputs. With instrument, the calls of every entry are counted under the name. At most 64
+// entries are supported
+std::vector<JitFunc<double>> compile_entries(const std::vector<Operation::Ptr>& inputs,
+                                             const std::vector<Operation::Ptr>& outputs,
+                                             const std::vector<std::vector<size_t>>& entries,
+                                             const CompileOptions& options = {});
 
 }  // namespace compiler
 
@@ -0,0 +1,91 @@
+#pragma once
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "cg.hpp"
+
+namespace tenkai {
+
+// Binary file of an operation graph, so that a graph built offline can be loaded without
+// re-running the code that built it.
+//
+// layout (little endian, every section 8-byte aligned):
+//   GraphFileHeader
+//   GraphFileNode[n_nodes]   inputs first, then in post-order from the outputs, so the table
+//                            is a valid evaluation order
+//   uint32_t operands[n_operands]  node indices, referred to by GraphFileNode::first_arg
+//   uint32_t inputs[n_inputs], outputs[n_outputs]  node indices
+//   char strings[strings_size]  null-terminated external function names
+// hash_id of each node is stored for inspection only. to_operations gives the variables and
+// external calls fresh ids and rebuilds the other nodes through the operators, so a loaded
+// graph is merged (CSE) by the compilers as the original one, but never shares an id with the
+// nodes of the loading process.
+constexpr uint32_t graph_file_version = 1;
+
+struct GraphFileHeader {
+  char magic[8];  // "TENKAIG\0"
+  uint32_t version;
+  uint32_t reserved;
+  uint64_t n_nodes;
+  uint64_t n_operands;
+  uint64_t n_inputs;
+  uint64_t n_outputs;
+  uint64_t strings_size;
+};
+
+struct GraphFileNode {
+  uint32_t kind;  // OpKind
+  uint32_t n_args;
+  uint32_t first_arg;  // index of the first operand in the operand table
+  int32_t hash_id;
+  uint32_t ext_func_name;  // offset in the string table, for EXTCALL
+  uint32_t param_index;    // for PARAM
+  double constant_value;  // for ZERO, ONE and CONSTANT
+};
+static_assert(sizeof(GraphFileNode) == 32);
+
+void save_graph(const std::string& path,
+                const std::vector<Operation::Ptr>& inputs,
+                const std::vector<Operation::Ptr>& outputs);
+
+struct OperationGraph {
+  std::vector<Operation::Ptr> inputs;
+  std::vector<Operation::Ptr> outputs;
+};
+
+// Read-only view of a graph file mapped into memory. The file is validated once on
+// construction, then the accessors read the mapped tables without copying.
+class GraphView {
+ public:
+  explicit GraphView(const std::string& path);
+  ~GraphView();
+  GraphView(const GraphView&) = delete;
+  GraphView& operator=(const GraphView&) = delete;
+
+  size_t n_nodes() const { return nodes_.size(); }
+  const GraphFileNode& node(size_t i) const { return nodes_[i]; }
+  OpKind kind(size_t i) const { return OpKind(nodes_[i].kind); }
+  std::span<const uint32_t> args(size_t i) const {
+    return operands_.subspan(nodes_[i].first_arg, nodes_[i].n_args);
+  }
+  std::string_view ext_func_name(size_t i) const { return strings_ + nodes_[i].ext_func_name; }
+  std::span<const uint32_t> inputs() const { return inputs_; }
+  std::span<const uint32_t> outputs() const { return outputs_; }
+
+  // builds the Operation nodes with fresh ids (see above). ZERO, ONE and constants are the
+  // shared nodes of the process
+  OperationGraph to_operations() const;
+
+ private:
+  void* mem_;
+  size_t size_;
+  std::span<const GraphFileNode> nodes_;
+  std::span<const uint32_t> operands_;
+  std::span<const uint32_t> inputs_;
+  std::span<const uint32_t> outputs_;
+  const char* strings_;
+};
+
+}  // namespace tenkai
@@ -0,0 +1,73 @@
+#pragma once
+#include <string>
+#include <vector>
+#include "cg.hpp"
+#include "compile.hpp"
+
+namespace tenkai {
+
+namespace compiler {
+
+// Native kernels saved to disk, so that a process loads them instead of compiling.
+//
+// layout (little endian):
+//   KernelFileHeader
+//   Relocation[n_relocations]
+//   int32_t input_offsets[n_input_offsets], int32_t output_offsets[n_output_offsets]
+//     (IoLayout of the kernel, each empty for the dense layout)
+//   strings: kernel name, then the external function names, each null-terminated
+//   padding to kernel_file_page_size
+//   machine code (code_size bytes)
+// Constants are immediates of the code, so no separate constant pool is needed. The addresses
+// of libm functions and of the counters of an instrumented kernel are patched on load.
+constexpr uint32_t kernel_file_version = 3;
+constexpr uint64_t kernel_file_page_size = 4096;
+
+// instruction set extensions used by the generated code
+enum KernelIsa : uint32_t {
+  ISA_AVX = 1 << 0,  // VEX encoded scalar double operations
+};
+
+struct KernelFileHeader {
+  char magic[8];  // "TENKAIK\0"
+  uint32_t version;
+  uint32_t isa;
+  uint64_t n_inputs;
+  uint64_t n_outputs;
+  uint64_t n_params;  // elements of the parameter buffer read by the kernel
+  uint64_t n_relocations;
+  uint64_t n_input_offsets;   // 0 or n_inputs
+  uint64_t n_output_offsets;  // 0 or n_outputs
+  uint64_t n_ext_funcs;
+  uint64_t strings_size;
+  uint64_t code_offset;
+  uint64_t code_size;
+  uint32_t instrumented;
+  uint32_t reserved;
+};
+
+struct LoadedKernel {
+  JitFunc<double> func;
+  std::string name;
+  size_t n_inputs;
+  size_t n_outputs;
+  // elements of the parameter buffer, which follows the function table in extfns
+  size_t n_params;
+  // the order of the function table to be passed as the third argument
+  std::vector<std::string> ext_func_names;
+  // where the kernel reads its inputs and writes its outputs. Callers that pass dense arrays,
+  // such as evaluate_stream, have to check that it is the dense layout (see is_dense)
+  IoLayout layout;
+};
+
+// compiles the kernel (options.name, instrument, layout and machine_model are used) and
+// writes it to path
+void save_kernel(const std::string& path, const std::vector<Operation::Ptr>& inputs,
+                 const std::vector<Operation::Ptr>& outputs, const CompileOptions& options = {});
+
+// maps the code of the file, patches the relocations and makes it executable. Throws if the
+// file is not a kernel of this version or the CPU lacks the required instructions
+LoadedKernel load_kernel(const std::string& path);
+
+}  // namespace compiler
+}  // namespace tenkai
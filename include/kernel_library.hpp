@@ -0,0 +1,38 @@
+#pragma once
+#include <string>
+#include <vector>
+#include "cg.hpp"
+
+namespace tenkai {
+
+// C++ sources of kernels generated ahead of time, for the kernels known at build time.
+// A generator program adds the kernels and writes <dir>/<name>.hpp and <dir>/<name>.cpp,
+// which add_tenkai_kernels in CMakeLists.txt compiles into a static library:
+//
+//   int main(int argc, char** argv) {  // invoked as: generator <dir> <name>
+//     KernelLibrary library(argv[2]);
+//     library.add("forward_kinematics", inputs, outputs);
+//     library.write(argv[1]);
+//   }
+//
+// Each kernel is an extern "C" function <name>_<kernel> with the signature of JitFunc<double>
+// (input is const). The header refers to it as <name>::<kernel>, along with
+// <name>::<kernel>_n_inputs and <name>::<kernel>_n_outputs.
+class KernelLibrary {
+ public:
+  // name is the file name and namespace of the generated header
+  explicit KernelLibrary(std::string name);
+  void add(const std::string& kernel_name,
+           const std::vector<Operation::Ptr>& inputs,
+           const std::vector<Operation::Ptr>& outputs);
+  // files are rewritten only if their content changes, so unchanged kernels are not rebuilt
+  void write(const std::string& dir) const;
+
+ private:
+  std::string name_;
+  std::string declarations_;  // of the C symbols
+  std::string header_;
+  std::string source_;
+};
+
+}  // namespace tenkai
@@ -0,0 +1,72 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace tenkai {
+
+namespace compiler {
+
+// Counters updated by the prologue/epilogue of an instrumented kernel (see
+// CompileOptions::instrument) with lock-prefixed instructions, so concurrent calls from
+// several threads are counted without a lock. Cycles are rdtsc deltas.
+// histogram[b] counts the calls that took [2^b, 2^(b+1)) cycles (b = 0 includes 0 cycle), so
+// the number of calls is the sum of the histogram rather than another atomic update per call.
+constexpr size_t n_latency_buckets = 64;
+
+struct KernelCounters {
+  std::atomic<uint64_t> total_cycles = 0;
+  std::array<std::atomic<uint64_t>, n_latency_buckets> histogram{};
+};
+
+// the generated code addresses the counters by these offsets
+static_assert(sizeof(std::atomic<uint64_t>) == 8);
+static_assert(offsetof(KernelCounters, total_cycles) == 0);
+static_assert(offsetof(KernelCounters, histogram) == 8);
+
+// point-in-time copy of the counters of a kernel
+struct KernelProfile {
+  std::string name;
+  uint64_t calls = 0;
+  uint64_t total_cycles = 0;
+  std::array<uint64_t, n_latency_buckets> histogram{};
+
+  double mean_cycles() const;
+  // upper bound (2^(b+1)) of the bucket that contains the given quantile, in [0, 1]
+  uint64_t quantile_cycles(double q) const;
+};
+
+// Process-wide registry of the instrumented kernels. Counters are never unregistered, as the
+// code of a kernel is never unmapped either, except those of a kernel that failed to load.
+class KernelRegistry {
+ public:
+  static KernelRegistry& instance();
+
+  // the returned counters stay valid for the lifetime of the process
+  KernelCounters* add(const std::string& name);
+  // unregisters counters returned by add that no code refers to
+  void remove(const KernelCounters* counters);
+  std::vector<KernelProfile> snapshot() const;
+  // profiles of the kernels with the given name (a name may be registered more than once)
+  std::vector<KernelProfile> find(const std::string& name) const;
+  void reset();
+
+ private:
+  struct Entry {
+    std::string name;
+    KernelCounters counters;
+  };
+  mutable std::mutex mutex_;
+  std::vector<std::unique_ptr<Entry>> entries_;
+};
+
+// rdtsc frequency, measured once against steady_clock on first use
+double tsc_cycles_per_ns();
+
+}  // namespace compiler
+}  // namespace tenkai
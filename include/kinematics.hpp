@@ -0,0 +1,51 @@
+#pragma once
+
+#include <array>
+#include <optional>
+#include "cg.hpp"
+#include "spatial.hpp"
+
+namespace tenkai {
+
+enum class JointType { FIXED, REVOLUTE, PRISMATIC };
+enum class Axis { X, Y, Z };
+
+struct Link {
+  std::optional<size_t> parent;  // nullopt for a root link
+  JointType joint_type;
+  Axis axis;
+  // fixed transform from the parent link frame to the joint frame, applied before the joint motion
+  SpatialTransform offset;
+};
+
+// Kinematic tree whose links are stored so that every parent comes before its children.
+// The pose of each link is built once on top of its parent's pose, so all the links sharing a
+// prefix of the tree share its computation and the whole tree is compiled into a single kernel.
+struct KinematicTree {
+  std::vector<Link> links;
+
+  // offset built from constant translation and rotation about X, Y and Z (applied in this order)
+  static SpatialTransform make_offset(const std::array<double, 3>& translation,
+                                      const std::array<double, 3>& rpy = {0.0, 0.0, 0.0});
+
+  // returns the index of the added link. parent must be an already added link
+  size_t add_link(std::optional<size_t> parent,
+                  JointType joint_type,
+                  Axis axis,
+                  const SpatialTransform& offset);
+  inline size_t n_links() const { return links.size(); }
+  size_t n_joints() const;  // number of movable joints, i.e. the number of kernel inputs
+
+  // poses of all the links in the root frame. joint_values are ordered by link index skipping
+  // the fixed joints. revolute joints rotate in the same direction as Matrix::RotX etc.
+  std::vector<SpatialTransform> link_poses(const std::vector<Operation::Ptr>& joint_values) const;
+
+  // flattened link poses, 12 values per link: rotation (column major) followed by translation
+  std::vector<Operation::Ptr> pose_elements(const std::vector<Operation::Ptr>& joint_values) const;
+
+  // kernel mapping n_joints() joint values to 12 * n_links() pose values (see pose_elements).
+  // backend is either "native" or the compiler command passed to jit_compile
+  JitFunc<double> compile(const std::string& backend = "g++") const;
+};
+
+}  // namespace tenkai
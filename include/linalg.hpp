@@ -7,13 +7,20 @@ namespace tenkai {
 // because these struct are used for code generation, we dont need to support
 // neither static sizes nor static asserts
 
+// Structural sparsity mask: false where the element is the ZERO node.
+// Products use it to skip the known-zero terms instead of building and folding them,
+// so elements must not be replaced after construction.
+std::vector<bool> structural_nonzeros(const std::vector<Operation::Ptr>& elements);
+
 struct Vector {
   // variables
   std::vector<Operation::Ptr> elements;
+  std::vector<bool> nonzero;
   inline size_t size() const { return elements.size(); }
 
   // methods
-  Vector(std::vector<Operation::Ptr> elements) : elements(elements) {}
+  Vector(std::vector<Operation::Ptr> elements)
+      : elements(elements), nonzero(structural_nonzeros(this->elements)) {}
   static Vector Zero(size_t n);
   static Vector Var(size_t n);
   inline Operation::Ptr operator()(size_t i) const { return elements[i]; }
@@ -27,12 +34,16 @@ struct Vector {
 struct Matrix {
   // variables
   std::vector<Operation::Ptr> elements;
+  std::vector<bool> nonzero;
   size_t n_rows;
   size_t n_cols;
 
   // methods
   Matrix(std::vector<Operation::Ptr> elements, size_t n_rows, size_t n_cols)
-      : elements(elements), n_rows(n_rows), n_cols(n_cols) {}
+      : elements(elements),
+        nonzero(structural_nonzeros(this->elements)),
+        n_rows(n_rows),
+        n_cols(n_cols) {}
   static Matrix Identity(size_t n);
   static Matrix RotX(Operation::Ptr angle);
   static Matrix RotY(Operation::Ptr angle);
@@ -43,6 +54,7 @@ struct Matrix {
   Matrix operator*(Operation::Ptr scalar);
   Matrix transpose();
   inline Operation::Ptr operator()(size_t i, size_t j) const { return elements[i + j * n_rows]; };
+  inline bool is_nonzero(size_t i, size_t j) const { return nonzero[i + j * n_rows]; };
 };
 
 }  // namespace tenkai
@@ -1,3 +1,5 @@
+#pragma once
+#include <cstdint>
 #include "cg.hpp"
 
 namespace tenkai {
@@ -16,6 +18,43 @@ class DepthFirstScheduler : public SchedulerInterface {
                                       const std::vector<Operation::Ptr>& outputs) override;
 };
 
+// Costs of the operations on the target core for ListScheduler, in cycles. The defaults are
+// those of Intel Skylake; tune them for other cores, e.g. from the instruction tables of the
+// vendor or by measuring the kernels.
+struct MachineModel {
+  uint32_t add_latency = 4;     // ADD, SUB and NEGATE
+  uint32_t mul_latency = 4;
+  uint32_t div_latency = 14;    // DIV and SQRT
+  uint32_t div_throughput = 4;  // cycles between two DIV or SQRT, as the divider is not pipelined
+  // libm and external calls, which also cost the spills of the values live across them
+  uint32_t call_latency = 40;
+  uint32_t issue_width = 4;  // operations issued per cycle
+  uint32_t fp_ports = 2;     // ADD, SUB, MUL and NEGATE issued per cycle
+  // values kept in registers at once, beyond which the scheduler favors the operations that
+  // end live ranges. The native compiler allocates 15 xmm registers
+  size_t register_budget = 12;
+  // ready operations considered at each step, earliest in depth-first order
+  size_t lookahead = 32;
+
+  static MachineModel zen4();
+};
+
+// Reorders the operations of DepthFirstScheduler by simulating their issue on a machine model.
+// At each step it issues the ready operation that does not stall, or stalls the least, and
+// has the longest latency path to the outputs, so independent chains are interleaved to
+// hide the latencies that depth-first order exposes on long serial chains. Calls are issued
+// as soon as their operands are ready, when the fewest values have to be spilled around them.
+// Loads and constants are placed right before their first use.
+class ListScheduler : public SchedulerInterface {
+ public:
+  explicit ListScheduler(const MachineModel& model = {}) : model_(model) {}
+  std::vector<Operation::Ptr> flatten(const std::vector<Operation::Ptr>& inputs,
+                                      const std::vector<Operation::Ptr>& outputs) override;
+
+ private:
+  MachineModel model_;
+};
+
 class ExtCallFirstScheduler : public SchedulerInterface {
  public:
   std::vector<Operation::Ptr> flatten(const std::vector<Operation::Ptr>& inputs,
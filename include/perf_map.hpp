@@ -0,0 +1,22 @@
+#pragma once
+#include <cstddef>
+#include <string>
+
+namespace tenkai {
+
+namespace compiler {
+
+// Registration of JIT code to the Linux perf profiler, so that samples are attributed to
+// each kernel instead of anonymous memory.
+//
+// perf map: appends "<start> <size> <name>" to /tmp/perf-<pid>.map, which `perf report`
+// reads to symbolize the samples.
+void write_perf_map_entry(const void* code, size_t code_size, const std::string& name);
+
+// jitdump: appends a JIT_CODE_LOAD record (name and code bytes) to /tmp/jit-<pid>.dump.
+// Record with `perf record -k mono`, then `perf inject --jit` turns the records into ELF
+// images so that `perf annotate` shows the instructions of each kernel.
+void write_jitdump_entry(const void* code, size_t code_size, const std::string& name);
+
+}  // namespace compiler
+}  // namespace tenkai
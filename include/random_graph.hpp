@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdint>
+#include "cg.hpp"
+
+namespace tenkai {
+
+// Seeded random DAG for scaling and stress tests. The operation nodes are split into `depth`
+// layers of the same size and the operands of a node are drawn from the previous layer (the
+// inputs for the first layer), or from all the earlier nodes with probability `sharing`.
+// The same config (including seed) gives the same graph with the same standard library.
+struct RandomGraphConfig {
+  size_t n_nodes = 1000;  // number of operation nodes, excluding inputs
+  size_t n_inputs = 16;
+  size_t n_outputs = 16;  // drawn from the last layer
+  size_t depth = 16;
+  double sharing = 0.1;
+  // relative frequency of each operation kind
+  double weight_add = 4.0;
+  double weight_sub = 2.0;
+  double weight_mul = 3.0;
+  double weight_negate = 1.0;
+  double weight_sin = 1.0;
+  double weight_cos = 1.0;
+  double weight_extcall = 0.0;  // calls random_graph_ext_func_name
+  uint64_t seed = 0;
+};
+
+struct RandomGraph {
+  std::vector<Operation::Ptr> inputs;
+  std::vector<Operation::Ptr> outputs;
+};
+
+RandomGraph make_random_graph(const RandomGraphConfig& config);
+
+// EXTCALL nodes of the random graph call this binary function, whose address has to be passed
+// as the only entry of the function table
+inline const std::string random_graph_ext_func_name = "random_graph_ext";
+double random_graph_ext_func(double x, double y);
+
+}  // namespace tenkai
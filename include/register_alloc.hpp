@@ -1,4 +1,7 @@
+#pragma once
+#include <functional>
 #include <optional>
+#include <queue>
 #include <tuple>
 #include <unordered_map>
 #include <unordered_set>
@@ -11,7 +14,9 @@ namespace tenkai {
 namespace register_alloc {
 
 using HashType = int32_t;
-enum class LocationType { REGISTER, STACK, INPUT, OUTPUT };
+// OUTGOING is the stack area for call arguments that do not fit in xmm0-xmm7.
+// PARAM is an element of the parameter buffer
+enum class LocationType { REGISTER, STACK, INPUT, OUTPUT, OUTGOING, PARAM };
 struct Location {
   LocationType type;
   size_t idx;
@@ -44,16 +49,24 @@ std::ostream& operator<<(std::ostream& os, const Transition& trans);
 using TransitionSet = std::vector<Transition>;
 
 struct AllocState {
-  AllocState(const std::vector<Operation::Ptr>& inputs, size_t T, size_t n_xmm);
+  AllocState(const std::vector<Operation::Ptr>& inputs, size_t n_xmm);
 
   // query
   std::optional<size_t> get_available_xmm() const;
   size_t get_available_stack() const;
 
+  // update
+  void occupy_stack(size_t idx, HashType hash_id);
+  void release_stack(size_t idx);
+
   // members
   std::vector<std::optional<HashType>> xmm_usages_;
-  std::vector<std::optional<HashType>> stack_usages_;
+  std::vector<std::optional<HashType>> stack_usages_;  // grows as needed
+  // released stack slots, lowest first to keep the frame small
+  std::priority_queue<size_t, std::vector<size_t>, std::greater<size_t>> free_stacks_;
   std::unordered_map<HashType, Location> locations_;
+  size_t max_stack_usage_ = 0;
+  size_t max_outgoing_usage_ = 0;
 };
 
 struct LiveRange {
@@ -79,24 +92,47 @@ class RegisterAllocator {
         inputs_(inputs),
         outputs_(outputs),
         disappear_hashid_table_(compute_disappear_hashid_table(opseq)),
-        alloc_state_(inputs, opseq.size(), n_xmm - 1),
+        alloc_state_(inputs, n_xmm - 1),
         transition_sets_(opseq.size()),
         t_(0),
-        temp_xmm_idx_(n_xmm - 1) {}
+        temp_xmm_idx_(n_xmm - 1) {
+    for (size_t i = 0; i < inputs.size(); ++i) {
+      input_indices_[inputs[i]->hash_id] = i;
+    }
+    for (size_t i = 0; i < outputs.size(); ++i) {
+      output_indices_[outputs[i]->hash_id].push_back(i);
+    }
+    for (const auto& op : opseq) {
+      if (op->kind == OpKind::PARAM) {
+        param_indices_[op->hash_id] = op->param_index.value();
+      }
+    }
+  }
 
   std::vector<TransitionSet> allocate();
+  // number of 8-byte slots the generated code must reserve in its frame
+  size_t get_stack_size() const { return alloc_state_.max_stack_usage_; }
+  size_t get_outgoing_size() const { return alloc_state_.max_outgoing_usage_; }
 
  private:
+  void allocate_call(const Operation::Ptr& op);
+  void marshal_call_arguments(const std::vector<std::pair<HashType, Location>>& args);
+  void release_if_unused(const Operation::Ptr& op);
+  void release_disappearing_values();
+  void store_if_output(const Operation::Ptr& op, const Location& loc_src);
   void spill_xmm(size_t idx);
   void prepare_value_on_xmm(HashType hash_id, size_t dst_xmm_idx);
   size_t spill_and_prepare_xmm();
-  size_t determine_spill_xmm() const;
+  size_t determine_spill_xmm(const std::vector<size_t>& pinned_xmms = {}) const;
   void step() { ++t_; }
 
   std::vector<Operation::Ptr> opseq_;
   std::unordered_map<HashType, LiveRange> live_ranges_;
   std::vector<Operation::Ptr> inputs_;
+  std::unordered_map<HashType, size_t> input_indices_;
+  std::unordered_map<HashType, size_t> param_indices_;
   std::vector<Operation::Ptr> outputs_;
+  std::unordered_map<HashType, std::vector<size_t>> output_indices_;
   std::vector<std::unordered_set<HashType>> disappear_hashid_table_;
   AllocState alloc_state_;
   std::vector<TransitionSet> transition_sets_;
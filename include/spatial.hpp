@@ -30,4 +30,44 @@ struct SpatialTransform {
   }
 };
 
+// Unit quaternion (Hamilton convention) as a cheaper representation of 3D rotation.
+// Product of two quaternions costs 16 mul and 12 add, compared to 27 mul and 18 add of
+// 3x3 matrix product, and the elementary rotations are built from half-angle sin/cos.
+struct Quaternion {
+  Operation::Ptr w;
+  Operation::Ptr x;
+  Operation::Ptr y;
+  Operation::Ptr z;
+
+  Quaternion(Operation::Ptr w, Operation::Ptr x, Operation::Ptr y, Operation::Ptr z)
+      : w(w), x(x), y(y), z(z) {}
+  static Quaternion Identity();
+  // same rotations as Matrix::RotX, RotY and RotZ
+  static Quaternion RotX(Operation::Ptr angle);
+  static Quaternion RotY(Operation::Ptr angle);
+  static Quaternion RotZ(Operation::Ptr angle);
+  // assumes rotation angle less than pi (i.e. w > 0) as graph has no branch
+  static Quaternion FromMatrix(const Matrix& rot);
+  Quaternion operator*(const Quaternion& other) const;
+  Quaternion conjugate() const;  // equal to inverse as it is unit quaternion
+  Vector rotate(const Vector& v) const;
+  Matrix to_matrix() const;
+};
+
+struct QuatTransform {
+  Quaternion rot;
+  Vector trans;
+
+  QuatTransform(Quaternion rotation, Vector translation) : rot(rotation), trans(translation) {
+    if (translation.size() != 3) {
+      throw std::runtime_error("Vector must be 3D");
+    }
+  }
+  static QuatTransform FromSpatialTransform(const SpatialTransform& tf);
+  QuatTransform operator*(const QuatTransform& other) const;
+  Vector operator*(const Vector& v) const;
+  QuatTransform inverse() const;
+  SpatialTransform to_spatial_transform() const;
+};
+
 };  // namespace tenkai
@@ -0,0 +1,45 @@
+#pragma once
+#include <map>
+#include <mutex>
+#include <vector>
+#include "cg.hpp"
+
+namespace tenkai {
+
+// Partial evaluation of a graph for inputs whose values are known when compiling, e.g. locked
+// joints. fixed maps the index of an input to its value.
+// The graph is rebuilt through the operators with those inputs replaced by constants, so the
+// constant folding and the ZERO/ONE simplifications propagate through sin/cos and the linalg
+// products. A folded value of 0.0 or 1.0 becomes ZERO or ONE to keep simplifying.
+// The returned outputs still refer to the same input nodes, so a kernel compiled from them has
+// the same signature as the original one and ignores the fixed inputs.
+std::vector<Operation::Ptr> specialize(const std::vector<Operation::Ptr>& inputs,
+                                       const std::vector<Operation::Ptr>& outputs,
+                                       const std::map<size_t, double>& fixed);
+
+// Native kernels specialized for each set of fixed inputs and values, compiled on first use.
+// Thread-safe; the returned kernel stays valid as long as the process.
+// The code of a kernel is never released, so the cache holds at most `capacity` kernels: once
+// full, get returns for the sets it has not seen the kernel of the original graph, which reads
+// the fixed inputs. Callers whose fixed values take many values, e.g. a joint locked at the
+// current position, should pass them in the input array as well.
+class SpecializationCache {
+ public:
+  SpecializationCache(std::vector<Operation::Ptr> inputs,
+                      std::vector<Operation::Ptr> outputs,
+                      size_t capacity = 64);
+  JitFunc<double> get(const std::map<size_t, double>& fixed);
+  size_t size() const;  // number of specialized kernels, at most capacity
+
+ private:
+  // (input index, bit pattern of the value), in the order of the indices
+  using Key = std::vector<std::pair<size_t, uint64_t>>;
+  std::vector<Operation::Ptr> inputs_;
+  std::vector<Operation::Ptr> outputs_;
+  mutable std::mutex mutex_;
+  size_t capacity_;
+  std::map<Key, JitFunc<double>> kernels_;
+  JitFunc<double> generic_ = nullptr;  // compiled once the cache is full
+};
+
+}  // namespace tenkai
@@ -0,0 +1,36 @@
+#pragma once
+#include <string>
+#include "cg.hpp"
+
+namespace tenkai {
+
+// Evaluation of a kernel over datasets that do not fit in memory.
+// The input file is raw binary of n_inputs doubles per point, and the output file is written
+// with n_outputs doubles per point (native endianness, no header). Both files are mapped and
+// processed chunk by chunk: the next input chunk is read ahead while the current one is
+// evaluated, the finished output chunk is written back asynchronously, and the pages behind
+// are released, so the memory use is bounded by a few chunks whatever the size of the files.
+// func has to read and write dense arrays, i.e. be compiled without an IoLayout (see
+// LoadedKernel::layout).
+struct StreamOptions {
+  size_t chunk_size = size_t(16) << 20;  // bytes of input between the I/O requests
+  size_t prefetch_distance = 16;         // in points, for the software prefetch of the inputs
+  // write the outputs with non-temporal stores, so that they do not evict the inputs and the
+  // kernel's working set from the cache
+  bool non_temporal = true;
+};
+
+struct StreamResult {
+  size_t n_points;
+  double seconds;
+};
+
+StreamResult evaluate_stream(JitFunc<double> func,
+                             size_t n_inputs,
+                             size_t n_outputs,
+                             const std::string& input_path,
+                             const std::string& output_path,
+                             void** extfns = nullptr,
+                             const StreamOptions& options = {});
+
+}  // namespace tenkai
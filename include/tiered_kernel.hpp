@@ -0,0 +1,67 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "cg.hpp"
+
+namespace tenkai {
+
+struct TieredOptions {
+  // calls after which the optimized tier is compiled in the background
+  uint64_t promote_after = 1000;
+  // how the optimized tier is compiled by jit_compile
+  JitOptions jit;
+};
+
+// Kernel that is callable immediately with the native code of compiler::compile, and is
+// promoted to the code compiled by g++ once it turns out to be hot. The promotion runs on a
+// background thread and swaps the function pointer atomically, so no call ever waits for g++.
+// If the optimized compilation fails, the kernel keeps the native code (see error()).
+//
+// Calls may come from several threads. The call count is not exact under contention, as it is
+// kept without a locked instruction, which is enough to decide on the promotion.
+class TieredKernel {
+ public:
+  enum class Tier { NATIVE, OPTIMIZED };
+
+  TieredKernel(std::vector<Operation::Ptr> inputs,
+               std::vector<Operation::Ptr> outputs,
+               const TieredOptions& options = {});
+  ~TieredKernel();  // waits for the background compilation
+  TieredKernel(const TieredKernel&) = delete;
+  TieredKernel& operator=(const TieredKernel&) = delete;
+
+  void operator()(double* input, double* output, void** extfns) {
+    if (!promotion_started_.load(std::memory_order_relaxed)) {
+      count_call();
+    }
+    func_.load(std::memory_order_acquire)(input, output, extfns);
+  }
+
+  Tier tier() const;
+  uint64_t n_calls() const { return n_calls_.load(std::memory_order_relaxed); }
+  // blocks until the background compilation, if started, has finished
+  void wait();
+  // message of the failed optimized compilation, empty otherwise
+  std::string error() const;
+
+ private:
+  void count_call();
+
+  std::vector<Operation::Ptr> inputs_;
+  std::vector<Operation::Ptr> outputs_;
+  TieredOptions options_;
+  std::atomic<JitFunc<double>> func_;
+  std::atomic<Tier> tier_;
+  std::atomic<uint64_t> n_calls_ = 0;
+  std::atomic<bool> promotion_started_ = false;
+  std::mutex thread_mutex_;  // guards compiler_thread_
+  std::thread compiler_thread_;
+  mutable std::mutex error_mutex_;  // guards error_
+  std::string error_;
+};
+
+}  // namespace tenkai
@@ -0,0 +1,245 @@
+#include "autodiff.hpp"
+#include <format>
+#include <stack>
+#include <stdexcept>
+#include <unordered_map>
+#include <unordered_set>
+#include "cg.hpp"
+
+namespace tenkai {
+
+namespace {
+
+// nodes are identified by hash_id as the scheduler does for CSE
+using HashType = int32_t;
+
+// post-order (operands first) of the nodes reachable from the outputs
+std::vector<Operation::Ptr> topological_order(const std::vector<Operation::Ptr>& outputs) {
+  std::vector<Operation::Ptr> order;
+  std::unordered_set<HashType> visited;
+  std::stack<std::pair<Operation::Ptr, bool>> stack;  // (op, is_expanded)
+  for (auto it = outputs.rbegin(); it != outputs.rend(); ++it) {
+    stack.push({*it, false});
+  }
+  while (!stack.empty()) {
+    auto [op, is_expanded] = stack.top();
+    stack.pop();
+    if (is_expanded) {
+      order.push_back(op);
+      continue;
+    }
+    if (visited.find(op->hash_id) != visited.end()) {
+      continue;
+    }
+    visited.insert(op->hash_id);
+    stack.push({op, true});
+    for (auto it = op->args.rbegin(); it != op->args.rend(); ++it) {
+      if (visited.find((*it)->hash_id) == visited.end()) {
+        stack.push({*it, false});
+      }
+    }
+  }
+  return order;
+}
+
+// hash_ids of nodes whose value depends on any of the inputs
+std::unordered_set<HashType> compute_dependents(const std::vector<Operation::Ptr>& order,
+                                                const std::vector<Operation::Ptr>& inputs) {
+  std::unordered_set<HashType> dependents;
+  for (const auto& input : inputs) {
+    dependents.insert(input->hash_id);
+  }
+  for (const auto& op : order) {
+    for (const auto& arg : op->args) {
+      if (dependents.find(arg->hash_id) != dependents.end()) {
+        dependents.insert(op->hash_id);
+        break;
+      }
+    }
+  }
+  return dependents;
+}
+
+// reuse the existing unary node (e.g. cos(x) next to sin(x)) if any
+Operation::Ptr find_or_create_unary(OpKind kind, const Operation::Ptr& arg) {
+  for (const auto& caller_wptr : arg->callers) {
+    auto caller = caller_wptr.lock();
+    if (caller != nullptr && caller->kind == kind && caller->args[0] == arg) {
+      return caller;
+    }
+  }
+  switch (kind) {
+    case OpKind::SIN:
+      return sin(arg);
+    case OpKind::COS:
+      return cos(arg);
+    default:
+      throw std::runtime_error(std::format("unexpected kind {}", to_string(kind)));
+  }
+}
+
+// partial derivative of op's result w.r.t. its idx-th operand, multiplied by adj.
+// used as adj * d op / d arg in reverse mode and tangent * d op / d arg in forward mode
+Operation::Ptr local_derivative(const Operation::Ptr& op, size_t idx, const Operation::Ptr& adj) {
+  const auto& args = op->args;
+  switch (op->kind) {
+    case OpKind::ADD:
+      return adj;
+    case OpKind::SUB:
+      return idx == 0 ? adj : -adj;
+    case OpKind::MUL:
+      return adj * args[1 - idx];
+    case OpKind::DIV:
+      // d(a/b)/db = -(a/b)/b
+      return idx == 0 ? adj / args[1] : -(adj * op) / args[1];
+    case OpKind::NEGATE:
+      return -adj;
+    case OpKind::SIN:
+      return adj * find_or_create_unary(OpKind::COS, args[0]);
+    case OpKind::COS:
+      return -(adj * find_or_create_unary(OpKind::SIN, args[0]));
+    case OpKind::SQRT:
+      return (adj * Operation::make_constant(0.5)) / op;
+    case OpKind::EXP:
+      return adj * op;
+    case OpKind::LOG:
+      return adj / args[0];
+    case OpKind::ATAN2: {
+      // atan2(y, x)
+      auto denom = args[0] * args[0] + args[1] * args[1];
+      return idx == 0 ? (adj * args[1]) / denom : -(adj * args[0]) / denom;
+    }
+    case OpKind::POW: {
+      if (idx == 0) {
+        auto exponent_minus_one = args[1] - Operation::make_one();
+        return adj * args[1] * pow(args[0], exponent_minus_one);
+      }
+      return adj * op * log(args[0]);
+    }
+    case OpKind::EXTCALL:
+      throw std::runtime_error(std::format("cannot differentiate external function {}",
+                                           op->ext_func_name.value()));
+    default:
+      throw std::runtime_error(std::format("cannot differentiate {}", to_string(op->kind)));
+  }
+}
+
+// reverse sweep from output along the topological order
+std::vector<Operation::Ptr> reverse_sweep(const Operation::Ptr& output,
+                                          const std::vector<Operation::Ptr>& order,
+                                          const std::unordered_set<HashType>& dependents,
+                                          const std::vector<Operation::Ptr>& inputs) {
+  std::unordered_map<HashType, Operation::Ptr> adjoints;
+  adjoints[output->hash_id] = Operation::make_one();
+  for (auto it = order.rbegin(); it != order.rend(); ++it) {
+    const auto& op = *it;
+    auto it_adj = adjoints.find(op->hash_id);
+    if (it_adj == adjoints.end() || op->is_nullaryop()) {
+      continue;
+    }
+    if (dependents.find(op->hash_id) == dependents.end()) {
+      continue;
+    }
+    for (size_t i = 0; i < op->args.size(); ++i) {
+      const auto& arg = op->args[i];
+      if (dependents.find(arg->hash_id) == dependents.end()) {
+        continue;  // constant w.r.t. inputs
+      }
+      auto contribution = local_derivative(op, i, it_adj->second);
+      auto [it_arg, inserted] = adjoints.emplace(arg->hash_id, contribution);
+      if (!inserted) {
+        it_arg->second = it_arg->second + contribution;
+      }
+    }
+  }
+
+  std::vector<Operation::Ptr> grad;
+  for (const auto& input : inputs) {
+    auto it_adj = adjoints.find(input->hash_id);
+    grad.push_back(it_adj == adjoints.end() ? Operation::make_zero() : it_adj->second);
+  }
+  return grad;
+}
+
+// forward sweep along the topological order, propagating all the seed directions at once
+std::vector<std::vector<Operation::Ptr>> forward_sweep(
+    const std::vector<Operation::Ptr>& outputs,
+    const std::vector<Operation::Ptr>& order,
+    const std::unordered_set<HashType>& dependents,
+    const std::vector<Operation::Ptr>& inputs,
+    const std::vector<std::vector<Operation::Ptr>>& seeds) {
+  std::unordered_map<HashType, std::vector<Operation::Ptr>> tangents;
+  for (size_t j = 0; j < inputs.size(); ++j) {
+    std::vector<Operation::Ptr> tangent(seeds.size());
+    for (size_t k = 0; k < seeds.size(); ++k) {
+      tangent[k] = seeds[k][j];
+    }
+    tangents[inputs[j]->hash_id] = std::move(tangent);
+  }
+
+  for (const auto& op : order) {
+    if (op->is_nullaryop() || dependents.find(op->hash_id) == dependents.end() ||
+        tangents.find(op->hash_id) != tangents.end()) {
+      continue;
+    }
+    std::vector<Operation::Ptr> tangent(seeds.size(), Operation::make_zero());
+    for (size_t i = 0; i < op->args.size(); ++i) {
+      auto it_arg = tangents.find(op->args[i]->hash_id);
+      if (it_arg == tangents.end()) {
+        continue;  // constant w.r.t. inputs
+      }
+      for (size_t k = 0; k < seeds.size(); ++k) {
+        tangent[k] = tangent[k] + local_derivative(op, i, it_arg->second[k]);
+      }
+    }
+    tangents[op->hash_id] = std::move(tangent);
+  }
+
+  std::vector<std::vector<Operation::Ptr>> result(seeds.size());
+  for (size_t k = 0; k < seeds.size(); ++k) {
+    for (const auto& output : outputs) {
+      auto it = tangents.find(output->hash_id);
+      result[k].push_back(it == tangents.end() ? Operation::make_zero() : it->second[k]);
+    }
+  }
+  return result;
+}
+
+}  // namespace
+
+std::vector<Operation::Ptr> gradient(const Operation::Ptr& output,
+                                     const std::vector<Operation::Ptr>& inputs) {
+  auto order = topological_order({output});
+  auto dependents = compute_dependents(order, inputs);
+  return reverse_sweep(output, order, dependents, inputs);
+}
+
+Matrix jacobian(const std::vector<Operation::Ptr>& outputs,
+                const std::vector<Operation::Ptr>& inputs) {
+  auto order = topological_order(outputs);
+  auto dependents = compute_dependents(order, inputs);
+  std::vector<Operation::Ptr> elements(outputs.size() * inputs.size());
+  for (size_t i = 0; i < outputs.size(); ++i) {
+    auto grad = reverse_sweep(outputs[i], order, dependents, inputs);
+    for (size_t j = 0; j < inputs.size(); ++j) {
+      elements[i + j * outputs.size()] = grad[j];  // column major
+    }
+  }
+  return Matrix(elements, outputs.size(), inputs.size());
+}
+
+std::vector<std::vector<Operation::Ptr>> jvp(
+    const std::vector<Operation::Ptr>& outputs,
+    const std::vector<Operation::Ptr>& inputs,
+    const std::vector<std::vector<Operation::Ptr>>& seeds) {
+  for (const auto& seed : seeds) {
+    if (seed.size() != inputs.size()) {
+      throw std::runtime_error("seed direction must have the same size as inputs");
+    }
+  }
+  auto order = topological_order(outputs);
+  auto dependents = compute_dependents(order, inputs);
+  return forward_sweep(outputs, order, dependents, inputs, seeds);
+}
+
+}  // namespace tenkai
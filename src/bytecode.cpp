@@ -0,0 +1,262 @@
+#include "bytecode.hpp"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <format>
+#include <memory>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+#include "operation_scheduler.hpp"
+
+namespace tenkai {
+namespace compiler {
+
+namespace {
+
+template <size_t>
+using Double = double;
+
+// calls fn(args[0], ..., args[N - 1]) through a function type of N doubles, so that the
+// arguments are passed by the ABI of the external functions
+template <size_t N>
+double call_ext(void* fn, const double* args) {
+  return [&]<size_t... I>(std::index_sequence<I...>) {
+    return reinterpret_cast<double (*)(Double<I>...)>(fn)(args[I]...);
+  }(std::make_index_sequence<N>{});
+}
+
+using ExtCaller = double (*)(void*, const double*);
+
+constexpr auto ext_callers = []<size_t... N>(std::index_sequence<N...>) {
+  return std::array<ExtCaller, sizeof...(N)>{&call_ext<N>...};
+}(std::make_index_sequence<BytecodeKernel::max_ext_args + 1>{});
+
+}  // namespace
+
+BytecodeKernel::BytecodeKernel(const std::vector<Operation::Ptr>& inputs,
+                               const std::vector<Operation::Ptr>& outputs)
+    : n_inputs_(inputs.size()), n_registers_(0), param_slot_(0), has_params_(false) {
+  const auto& opseq = DepthFirstScheduler().flatten(inputs, outputs);
+  const auto ext_names = ext_func_table(outputs);
+  param_slot_ = ext_names.size();
+
+  // the values are identified by hash_id as in the scheduler and the register allocator
+  std::unordered_map<int32_t, size_t> last_use;
+  for (size_t t = 0; t < opseq.size(); ++t) {
+    for (const auto& arg : opseq[t]->args) {
+      last_use[arg->hash_id] = t;
+    }
+  }
+  std::unordered_map<int32_t, std::vector<uint32_t>> output_indices;
+  for (size_t i = 0; i < outputs.size(); ++i) {
+    output_indices[outputs[i]->hash_id].push_back(i);
+  }
+
+  std::unordered_map<int32_t, uint32_t> registers;
+  for (const auto& op : opseq) {
+    if (op->constant_value.has_value() && !registers.contains(op->hash_id)) {
+      registers[op->hash_id] = constants_.size();
+      constants_.push_back(op->constant_value.value());
+    }
+  }
+  std::vector<uint32_t> free_registers;  // reused last in, first out
+  n_registers_ = constants_.size() + inputs.size();
+  for (size_t i = 0; i < inputs.size(); ++i) {
+    if (inputs[i]->kind != OpKind::LOAD) {
+      throw std::runtime_error("kind is not VALIABLE");
+    }
+    uint32_t reg = constants_.size() + i;
+    if (last_use.contains(inputs[i]->hash_id) || output_indices.contains(inputs[i]->hash_id)) {
+      registers[inputs[i]->hash_id] = reg;
+    } else {
+      free_registers.push_back(reg);
+    }
+  }
+  auto allocate = [&]() -> uint32_t {
+    if (free_registers.empty()) {
+      return n_registers_++;
+    }
+    uint32_t reg = free_registers.back();
+    free_registers.pop_back();
+    return reg;
+  };
+
+  for (size_t t = 0; t < opseq.size(); ++t) {
+    const auto& op = opseq[t];
+    std::vector<uint32_t> args;
+    for (const auto& arg : op->args) {
+      args.push_back(registers.at(arg->hash_id));
+    }
+    // the operands are read before the result is written, so the result may take the
+    // register of an operand used for the last time
+    for (const auto& arg : op->args) {
+      auto it = registers.find(arg->hash_id);
+      if (it != registers.end() && last_use.at(arg->hash_id) == t) {
+        free_registers.push_back(it->second);
+        registers.erase(it);
+      }
+    }
+
+    Instruction instruction{};
+    switch (op->kind) {
+      // clang-format off
+      case OpKind::ADD: instruction.opcode = Opcode::ADD; break;
+      case OpKind::SUB: instruction.opcode = Opcode::SUB; break;
+      case OpKind::MUL: instruction.opcode = Opcode::MUL; break;
+      case OpKind::DIV: instruction.opcode = Opcode::DIV; break;
+      case OpKind::NEGATE: instruction.opcode = Opcode::NEGATE; break;
+      case OpKind::SQRT: instruction.opcode = Opcode::SQRT; break;
+      case OpKind::SIN: instruction.opcode = Opcode::SIN; break;
+      case OpKind::COS: instruction.opcode = Opcode::COS; break;
+      case OpKind::EXP: instruction.opcode = Opcode::EXP; break;
+      case OpKind::LOG: instruction.opcode = Opcode::LOG; break;
+      case OpKind::ATAN2: instruction.opcode = Opcode::ATAN2; break;
+      case OpKind::POW: instruction.opcode = Opcode::POW; break;
+      // clang-format on
+      case OpKind::PARAM:
+        instruction.opcode = Opcode::PARAM;
+        instruction.a = op->param_index.value();
+        has_params_ = true;
+        break;
+      case OpKind::EXTCALL: {
+        if (args.size() > max_ext_args) {
+          throw std::runtime_error(std::format("{} has {} arguments, more than {}",
+                                               op->ext_func_name.value(), args.size(),
+                                               max_ext_args));
+        }
+        instruction.opcode = Opcode::CALL;
+        instruction.n_args = args.size();
+        instruction.a = std::distance(
+            ext_names.begin(),
+            std::lower_bound(ext_names.begin(), ext_names.end(), op->ext_func_name.value()));
+        instruction.b = operands_.size();
+        operands_.insert(operands_.end(), args.begin(), args.end());
+        break;
+      }
+      case OpKind::LOAD:
+      case OpKind::ZERO:
+      case OpKind::ONE:
+      case OpKind::CONSTANT:
+        break;  // already in its register
+      default:
+        throw std::runtime_error(
+            std::format("not implemented operation name: {}", to_string(op->kind)));
+    }
+    uint32_t dst;
+    if (op->kind == OpKind::LOAD || op->constant_value.has_value()) {
+      dst = registers.at(op->hash_id);
+    } else {
+      dst = allocate();
+      registers[op->hash_id] = dst;
+      instruction.dst = dst;
+      if (instruction.opcode != Opcode::PARAM && instruction.opcode != Opcode::CALL) {
+        instruction.a = args.at(0);
+        instruction.b = args.size() > 1 ? args[1] : 0;
+      }
+      code_.push_back(instruction);
+    }
+
+    auto it_outputs = output_indices.find(op->hash_id);
+    if (it_outputs != output_indices.end()) {
+      for (auto index : it_outputs->second) {
+        code_.push_back({Opcode::STORE, 0, index, dst, 0});
+      }
+    }
+    if (!last_use.contains(op->hash_id)) {
+      free_registers.push_back(dst);
+      registers.erase(op->hash_id);
+    }
+  }
+  code_.push_back({Opcode::RETURN, 0, 0, 0, 0});
+}
+
+void BytecodeKernel::operator()(const double* input, double* output, void** extfns) const {
+  // the registers of the small kernels stay on the stack
+  constexpr size_t n_stack_registers = 256;
+  double stack_registers[n_stack_registers];
+  std::unique_ptr<double[]> heap_registers;
+  double* regs = stack_registers;
+  if (n_registers_ > n_stack_registers) {
+    heap_registers = std::make_unique<double[]>(n_registers_);
+    regs = heap_registers.get();
+  }
+  std::memcpy(regs, constants_.data(), constants_.size() * sizeof(double));
+  std::memcpy(regs + constants_.size(), input, n_inputs_ * sizeof(double));
+  const double* params =
+      has_params_ ? static_cast<const double*>(extfns[param_slot_]) : nullptr;
+  const uint32_t* operands = operands_.data();
+
+  // threaded dispatch: every handler jumps to the handler of the next instruction, so that
+  // each of them has its own indirect branch to predict
+  static const void* handlers[] = {
+      &&op_add, &&op_sub, &&op_mul,   &&op_div,   &&op_negate, &&op_sqrt, &&op_sin,   &&op_cos,
+      &&op_exp, &&op_log, &&op_atan2, &&op_pow,   &&op_param,  &&op_call, &&op_store, &&op_return,
+  };
+  static_assert(std::size(handlers) == static_cast<size_t>(Opcode::RETURN) + 1);
+  const Instruction* pc = code_.data();
+#define TENKAI_DISPATCH() goto* handlers[static_cast<size_t>(pc->opcode)]
+#define TENKAI_NEXT() \
+  ++pc;               \
+  TENKAI_DISPATCH()
+
+  TENKAI_DISPATCH();
+op_add:
+  regs[pc->dst] = regs[pc->a] + regs[pc->b];
+  TENKAI_NEXT();
+op_sub:
+  regs[pc->dst] = regs[pc->a] - regs[pc->b];
+  TENKAI_NEXT();
+op_mul:
+  regs[pc->dst] = regs[pc->a] * regs[pc->b];
+  TENKAI_NEXT();
+op_div:
+  regs[pc->dst] = regs[pc->a] / regs[pc->b];
+  TENKAI_NEXT();
+op_negate:
+  regs[pc->dst] = -regs[pc->a];
+  TENKAI_NEXT();
+op_sqrt:
+  regs[pc->dst] = std::sqrt(regs[pc->a]);
+  TENKAI_NEXT();
+op_sin:
+  regs[pc->dst] = std::sin(regs[pc->a]);
+  TENKAI_NEXT();
+op_cos:
+  regs[pc->dst] = std::cos(regs[pc->a]);
+  TENKAI_NEXT();
+op_exp:
+  regs[pc->dst] = std::exp(regs[pc->a]);
+  TENKAI_NEXT();
+op_log:
+  regs[pc->dst] = std::log(regs[pc->a]);
+  TENKAI_NEXT();
+op_atan2:
+  regs[pc->dst] = std::atan2(regs[pc->a], regs[pc->b]);
+  TENKAI_NEXT();
+op_pow:
+  regs[pc->dst] = std::pow(regs[pc->a], regs[pc->b]);
+  TENKAI_NEXT();
+op_param:
+  regs[pc->dst] = params[pc->a];
+  TENKAI_NEXT();
+op_call: {
+  double args[max_ext_args];
+  for (size_t i = 0; i < pc->n_args; ++i) {
+    args[i] = regs[operands[pc->b + i]];
+  }
+  regs[pc->dst] = ext_callers[pc->n_args](extfns[pc->a], args);
+  TENKAI_NEXT();
+}
+op_store:
+  output[pc->dst] = regs[pc->a];
+  TENKAI_NEXT();
+op_return:
+  return;
+#undef TENKAI_NEXT
+#undef TENKAI_DISPATCH
+}
+
+}  // namespace compiler
+}  // namespace tenkai
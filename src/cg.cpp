@@ -1,10 +1,17 @@
 #include "cg.hpp"
 #include <algorithm>
+#include <atomic>
+#include <bit>
 #include <cmath>
+#include <format>
+#include <mutex>
 #include <random>
+#include <set>
 #include <stack>
 #include <stdexcept>
 #include <string>
+#include <unordered_map>
+#include <unordered_set>
 
 namespace tenkai {
 
@@ -22,16 +29,94 @@ std::string generate_random_string(size_t length) {
   return result;
 }
 
-int32_t generate_random_int() {
-  std::random_device rd;
-  std::mt19937 generator(rd());
-  std::uniform_int_distribution<> distribution(0, 2147483647);
-  return distribution(generator);
+namespace {
+
+uint64_t splitmix64(uint64_t x) {
+  x += 0x9e3779b97f4a7c15;
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111eb;
+  return x ^ (x >> 31);
 }
 
-int32_t division_hash(int32_t x) {
-  constexpr int32_t prime = 2147483647;
-  return x % prime;
+// ids are integers modulo this prime. The ids of ADD, SUB, MUL and NEGATE are computed in
+// this field, so they follow the ring identities (e.g. (x + y) - y has the id of x), and a
+// product of ids is zero only if one of the factors is, whereas modulo 2^32 long products
+// run out of low bits and collide
+constexpr int64_t node_id_prime = 2147483647;
+
+int32_t to_node_id(uint64_t bits) {
+  return static_cast<int32_t>((bits >> 33) % node_id_prime);
+}
+
+struct IdStreamState {
+  uint64_t base;
+  uint64_t counter;
+  bool initialized = false;
+};
+thread_local IdStreamState id_stream;
+
+// streams opened by NodeIdStream are usually small numbers, so the default streams are
+// numbered from the upper half
+constexpr uint64_t default_stream_bit = uint64_t(1) << 63;
+std::atomic<uint64_t> n_default_streams{0};
+
+// the default streams are salted once per process, so that the variables of this process do
+// not take the ids of the nodes built by another one, e.g. of a graph file
+uint64_t process_salt() {
+  static const uint64_t salt = [] {
+    std::random_device device;
+    return (static_cast<uint64_t>(device()) << 32) | device();
+  }();
+  return salt;
+}
+
+// streams opened by NodeIdStream so far, which are never reopened as the nodes drawn from them
+// may still be alive
+std::mutex reserved_streams_mutex;
+std::unordered_set<uint64_t> reserved_streams;
+
+int32_t generate_node_id() {
+  if (!id_stream.initialized) {
+    id_stream = {splitmix64(process_salt() ^ splitmix64(default_stream_bit |
+                                                         n_default_streams.fetch_add(1))),
+                 0, true};
+  }
+  return to_node_id(splitmix64(id_stream.base + id_stream.counter++));
+}
+
+// ZERO, ONE, CONSTANT and PARAM are identified by their value or index, whichever thread
+// creates them first
+int32_t constant_node_id(OpKind kind, uint64_t bits) {
+  return to_node_id(splitmix64(bits ^ splitmix64(static_cast<uint64_t>(kind))));
+}
+
+}  // namespace
+
+NodeIdStream::NodeIdStream(uint64_t stream)
+    : saved_base_(id_stream.base),
+      saved_counter_(id_stream.counter),
+      saved_initialized_(id_stream.initialized) {
+  if ((stream & default_stream_bit) != 0) {
+    throw std::runtime_error(
+        std::format("id stream {} is reserved for the default streams", stream));
+  }
+  {
+    std::lock_guard<std::mutex> lock(reserved_streams_mutex);
+    if (!reserved_streams.insert(stream).second) {
+      throw std::runtime_error(
+          std::format("id stream {} is already used in this process", stream));
+    }
+  }
+  id_stream = {splitmix64(stream), 0, true};
+}
+
+NodeIdStream::~NodeIdStream() {
+  id_stream = {saved_base_, saved_counter_, saved_initialized_};
+}
+
+int32_t division_hash(int64_t x) {
+  x %= node_id_prime;
+  return static_cast<int32_t>(x < 0 ? x + node_id_prime : x);
 }
 
 int32_t djb2_hash(const std::string& str) {
@@ -39,22 +124,30 @@ int32_t djb2_hash(const std::string& str) {
   for (char c : str) {
     hash = ((hash << 5) + hash) + c;
   }
-  return hash;
+  return static_cast<int32_t>(hash % node_id_prime);
 }
 
 Operation::Operation() : kind(OpKind::NIL) {
-  hash_id = generate_random_int();
+  hash_id = generate_node_id();
 }
 
 Operation::Operation(OpKind kind, std::vector<Operation::Ptr> leafs, int32_t hash_id)
-    : kind(kind), args(leafs), hash_id(hash_id) {}
+    : kind(kind), args(std::move(leafs)), hash_id(hash_id) {}
+
+// ZERO, ONE and CONSTANT nodes are shared by the whole process, so they do not keep track of
+// their callers. Otherwise their callers list would grow without bound.
+inline bool tracks_callers(const Operation::Ptr& op) {
+  return !op->constant_value.has_value();
+}
 
 Operation::Ptr Operation::create(OpKind kind,
                                  std::vector<Operation::Ptr>&& leafs,
                                  int32_t hash_id) {
-  auto created = std::make_shared<Operation>(kind, leafs, hash_id);
-  for (auto& leaf : leafs) {
-    leaf->callers.push_back(created);
+  auto created = std::make_shared<Operation>(kind, std::move(leafs), hash_id);
+  for (auto& leaf : created->args) {
+    if (tracks_callers(leaf)) {
+      leaf->callers.push_back(created);
+    }
   }
   return created;
 }
@@ -66,16 +159,22 @@ Operation::Ptr Operation::make_var() {
 }
 
 Operation::Ptr Operation::make_zero() {
-  Operation::Ptr zero = std::make_shared<Operation>();
-  zero->kind = OpKind::ZERO;
-  zero->constant_value = 0.0;
+  static const Operation::Ptr zero = [] {
+    Operation::Ptr zero = std::make_shared<Operation>(
+        OpKind::ZERO, std::vector<Operation::Ptr>{}, constant_node_id(OpKind::ZERO, std::bit_cast<uint64_t>(0.0)));
+    zero->constant_value = 0.0;
+    return zero;
+  }();
   return zero;
 }
 
 Operation::Ptr Operation::make_one() {
-  Operation::Ptr one = std::make_shared<Operation>();
-  one->kind = OpKind::ONE;
-  one->constant_value = 1.0;
+  static const Operation::Ptr one = [] {
+    Operation::Ptr one = std::make_shared<Operation>(
+        OpKind::ONE, std::vector<Operation::Ptr>{}, constant_node_id(OpKind::ONE, std::bit_cast<uint64_t>(1.0)));
+    one->constant_value = 1.0;
+    return one;
+  }();
   return one;
 }
 
@@ -84,16 +183,56 @@ Operation::Ptr Operation::make_ext_func(std::string&& name, std::vector<Operatio
   func->kind = OpKind::EXTCALL;
   func->args = std::move(args);
   func->ext_func_name = std::move(name);
+  for (auto& arg : func->args) {
+    if (tracks_callers(arg)) {
+      arg->callers.push_back(func);
+    }
+  }
   return func;
 }
 
+Operation::Ptr Operation::make_canonical_constant(double value) {
+  // -0.0 stays a constant, as ZERO would lose its sign
+  if (std::bit_cast<uint64_t>(value) == std::bit_cast<uint64_t>(0.0)) {
+    return make_zero();
+  }
+  if (value == 1.0) {
+    return make_one();
+  }
+  return make_constant(value);
+}
+
 Operation::Ptr Operation::make_constant(double value) {
-  Operation::Ptr constant = std::make_shared<Operation>();
-  constant->kind = OpKind::CONSTANT;
+  // constants are interned by their bit pattern (so 0.0 and -0.0 are distinct) and live as long
+  // as any graph refers to them
+  static std::mutex mutex;
+  static std::unordered_map<uint64_t, Operation::WeakPtr> table;
+  static size_t sweep_size = 1024;
+  std::lock_guard<std::mutex> lock(mutex);
+  if (table.size() >= sweep_size) {
+    std::erase_if(table, [](const auto& item) { return item.second.expired(); });
+    sweep_size = std::max<size_t>(1024, table.size() * 2);
+  }
+  auto& entry = table[std::bit_cast<uint64_t>(value)];
+  if (auto constant = entry.lock()) {
+    return constant;
+  }
+  auto id = constant_node_id(OpKind::CONSTANT, std::bit_cast<uint64_t>(value));
+  Operation::Ptr constant =
+      std::make_shared<Operation>(OpKind::CONSTANT, std::vector<Operation::Ptr>{}, id);
   constant->constant_value = value;
+  entry = constant;
   return constant;
 }
 
+Operation::Ptr Operation::make_param(size_t index) {
+  // parameters of the same index are the same value, so they share the hash_id (CSE)
+  Operation::Ptr param = std::make_shared<Operation>(
+      OpKind::PARAM, std::vector<Operation::Ptr>{}, constant_node_id(OpKind::PARAM, index));
+  param->param_index = index;
+  return param;
+}
+
 std::vector<Operation::Ptr> Operation::get_leafs() {
   std::vector<Operation::Ptr> leafs;
   auto is_added = [&leafs](Operation::Ptr op) {
@@ -117,6 +256,57 @@ std::vector<Operation::Ptr> Operation::get_leafs() {
   return leafs;
 }
 
+namespace {
+
+// calls visit once for every node reachable from outputs
+template <typename Visit>
+void visit_graph(const std::vector<Operation::Ptr>& outputs, Visit visit) {
+  std::unordered_set<const Operation*> visited;
+  std::vector<const Operation*> stack;
+  for (const auto& output : outputs) {
+    stack.push_back(output.get());
+  }
+  while (!stack.empty()) {
+    auto op = stack.back();
+    stack.pop_back();
+    if (!visited.insert(op).second) {
+      continue;
+    }
+    visit(op);
+    for (const auto& arg : op->args) {
+      if (!visited.contains(arg.get())) {
+        stack.push_back(arg.get());
+      }
+    }
+  }
+}
+
+}  // namespace
+
+std::vector<std::string> ext_func_table(const std::vector<Operation::Ptr>& outputs) {
+  std::set<std::string> names;
+  visit_graph(outputs, [&names](const Operation* op) {
+    if (op->kind == OpKind::EXTCALL) {
+      names.insert(op->ext_func_name.value());
+    }
+  });
+  return std::vector<std::string>(names.begin(), names.end());
+}
+
+size_t param_slot(const std::vector<Operation::Ptr>& outputs) {
+  return ext_func_table(outputs).size();
+}
+
+size_t param_count(const std::vector<Operation::Ptr>& outputs) {
+  size_t count = 0;
+  visit_graph(outputs, [&count](const Operation* op) {
+    if (op->kind == OpKind::PARAM) {
+      count = std::max(count, op->param_index.value() + 1);
+    }
+  });
+  return count;
+}
+
 Operation::Ptr operator+(Operation::Ptr lhs, Operation::Ptr rhs) {
   if (lhs->kind == OpKind::ZERO) {
     return rhs;
@@ -124,23 +314,23 @@ Operation::Ptr operator+(Operation::Ptr lhs, Operation::Ptr rhs) {
   if (rhs->kind == OpKind::ZERO) {
     return lhs;
   }
-  if (rhs->kind == OpKind::CONSTANT && lhs->kind == OpKind::CONSTANT) {
-    return Operation::make_constant(*lhs->constant_value + *rhs->constant_value);
+  if (rhs->constant_value.has_value() && lhs->constant_value.has_value()) {
+    return Operation::make_canonical_constant(*lhs->constant_value + *rhs->constant_value);
   }
-  auto this_hash_id = division_hash(lhs->hash_id + rhs->hash_id);
+  auto this_hash_id = division_hash(int64_t(lhs->hash_id) + rhs->hash_id);
   return Operation::create(OpKind::ADD, {lhs, rhs}, this_hash_id);
 }
 Operation::Ptr operator-(Operation::Ptr lhs, Operation::Ptr rhs) {
   if (lhs->kind == OpKind::ZERO) {
-    return rhs;
+    return -rhs;
   }
   if (rhs->kind == OpKind::ZERO) {
     return lhs;
   }
-  if (rhs->kind == OpKind::CONSTANT && lhs->kind == OpKind::CONSTANT) {
-    return Operation::make_constant(*lhs->constant_value - *rhs->constant_value);
+  if (rhs->constant_value.has_value() && lhs->constant_value.has_value()) {
+    return Operation::make_canonical_constant(*lhs->constant_value - *rhs->constant_value);
   }
-  auto this_hash_id = division_hash(lhs->hash_id - rhs->hash_id);
+  auto this_hash_id = division_hash(int64_t(lhs->hash_id) - rhs->hash_id);
   return Operation::create(OpKind::SUB, {lhs, rhs}, this_hash_id);
 }
 Operation::Ptr operator*(Operation::Ptr lhs, Operation::Ptr rhs) {
@@ -153,16 +343,58 @@ Operation::Ptr operator*(Operation::Ptr lhs, Operation::Ptr rhs) {
   if (rhs->kind == OpKind::ONE) {
     return lhs;
   }
-  if (rhs->kind == OpKind::CONSTANT && lhs->kind == OpKind::CONSTANT) {
-    return Operation::make_constant(*lhs->constant_value * *rhs->constant_value);
+  if (rhs->constant_value.has_value() && lhs->constant_value.has_value()) {
+    return Operation::make_canonical_constant(*lhs->constant_value * *rhs->constant_value);
   }
-  auto this_hash_id = division_hash(lhs->hash_id * rhs->hash_id);
+  auto this_hash_id = division_hash(int64_t(lhs->hash_id) * rhs->hash_id);
   return Operation::create(OpKind::MUL, {lhs, rhs}, this_hash_id);
 }
+Operation::Ptr operator/(Operation::Ptr lhs, Operation::Ptr rhs) {
+  if (rhs->kind == OpKind::ZERO) {
+    throw std::runtime_error("division by structural zero");
+  }
+  if (lhs->kind == OpKind::ZERO) {
+    return Operation::make_zero();
+  }
+  if (rhs->kind == OpKind::ONE) {
+    return lhs;
+  }
+  if (rhs->constant_value.has_value() && lhs->constant_value.has_value()) {
+    return Operation::make_canonical_constant(*lhs->constant_value / *rhs->constant_value);
+  }
+  auto tmp = "(div)" + std::to_string(lhs->hash_id) + "," + std::to_string(rhs->hash_id);
+  auto this_hash_id = djb2_hash(tmp);
+  return Operation::create(OpKind::DIV, {lhs, rhs}, this_hash_id);
+}
+Operation::Ptr atan2(Operation::Ptr y, Operation::Ptr x) {
+  if (y->constant_value.has_value() && x->constant_value.has_value()) {
+    return Operation::make_canonical_constant(std::atan2(*y->constant_value, *x->constant_value));
+  }
+  auto tmp = "(atan2)" + std::to_string(y->hash_id) + "," + std::to_string(x->hash_id);
+  auto this_hash_id = djb2_hash(tmp);
+  return Operation::create(OpKind::ATAN2, {y, x}, this_hash_id);
+}
+Operation::Ptr pow(Operation::Ptr base, Operation::Ptr exponent) {
+  if (exponent->kind == OpKind::ZERO) {
+    return Operation::make_one();
+  }
+  if (exponent->kind == OpKind::ONE) {
+    return base;
+  }
+  if (base->constant_value.has_value() && exponent->constant_value.has_value()) {
+    return Operation::make_canonical_constant(std::pow(*base->constant_value, *exponent->constant_value));
+  }
+  auto tmp = "(pow)" + std::to_string(base->hash_id) + "," + std::to_string(exponent->hash_id);
+  auto this_hash_id = djb2_hash(tmp);
+  return Operation::create(OpKind::POW, {base, exponent}, this_hash_id);
+}
 Operation::Ptr cos(Operation::Ptr op) {
   if (op->kind == OpKind::ZERO) {
     return Operation::make_one();
   }
+  if (op->constant_value.has_value()) {
+    return Operation::make_canonical_constant(std::cos(*op->constant_value));
+  }
   auto tmp = "(cos)" + std::to_string(op->hash_id);
   auto this_hash_id = djb2_hash(tmp);
   return Operation::create(OpKind::COS, {op}, this_hash_id);
@@ -171,16 +403,88 @@ Operation::Ptr sin(Operation::Ptr op) {
   if (op->kind == OpKind::ZERO) {
     return Operation::make_zero();
   }
+  if (op->constant_value.has_value()) {
+    return Operation::make_canonical_constant(std::sin(*op->constant_value));
+  }
   auto tmp = "(sin)" + std::to_string(op->hash_id);
   auto this_hash_id = djb2_hash(tmp);
   return Operation::create(OpKind::SIN, {op}, this_hash_id);
 }
+Operation::Ptr sqrt(Operation::Ptr op) {
+  if (op->kind == OpKind::ZERO || op->kind == OpKind::ONE) {
+    return op;
+  }
+  if (op->constant_value.has_value()) {
+    return Operation::make_canonical_constant(std::sqrt(*op->constant_value));
+  }
+  auto tmp = "(sqrt)" + std::to_string(op->hash_id);
+  auto this_hash_id = djb2_hash(tmp);
+  return Operation::create(OpKind::SQRT, {op}, this_hash_id);
+}
+Operation::Ptr exp(Operation::Ptr op) {
+  if (op->kind == OpKind::ZERO) {
+    return Operation::make_one();
+  }
+  if (op->constant_value.has_value()) {
+    return Operation::make_canonical_constant(std::exp(*op->constant_value));
+  }
+  auto tmp = "(exp)" + std::to_string(op->hash_id);
+  auto this_hash_id = djb2_hash(tmp);
+  return Operation::create(OpKind::EXP, {op}, this_hash_id);
+}
+Operation::Ptr log(Operation::Ptr op) {
+  if (op->kind == OpKind::ONE) {
+    return Operation::make_zero();
+  }
+  if (op->constant_value.has_value()) {
+    return Operation::make_canonical_constant(std::log(*op->constant_value));
+  }
+  auto tmp = "(log)" + std::to_string(op->hash_id);
+  auto this_hash_id = djb2_hash(tmp);
+  return Operation::create(OpKind::LOG, {op}, this_hash_id);
+}
 Operation::Ptr operator-(Operation::Ptr op) {
   if (op->kind == OpKind::ZERO) {
     return Operation::make_zero();
   }
-  auto this_hash_id = division_hash(-op->hash_id);
+  if (op->constant_value.has_value()) {
+    return Operation::make_canonical_constant(-*op->constant_value);
+  }
+  auto this_hash_id = division_hash(-int64_t(op->hash_id));
   return Operation::create(OpKind::NEGATE, {op}, this_hash_id);
 }
 
+Operation::Ptr build_operation(OpKind kind,
+                               std::vector<Operation::Ptr> args,
+                               const std::string& ext_func_name) {
+  if (kind == OpKind::EXTCALL) {
+    return Operation::make_ext_func(std::string(ext_func_name), std::move(args));
+  }
+  // the leaves have factories of their own
+  size_t n_operands = arity(kind).value();
+  if (n_operands == 0) {
+    throw std::runtime_error(std::format("cannot build {}", to_string(kind)));
+  }
+  if (args.size() != n_operands) {
+    throw std::runtime_error(std::format("{} takes {} operands, not {}", to_string(kind),
+                                         n_operands, args.size()));
+  }
+  switch (kind) {
+    // clang-format off
+    case OpKind::ADD: return args[0] + args[1];
+    case OpKind::SUB: return args[0] - args[1];
+    case OpKind::MUL: return args[0] * args[1];
+    case OpKind::DIV: return args[0] / args[1];
+    case OpKind::ATAN2: return atan2(args[0], args[1]);
+    case OpKind::POW: return pow(args[0], args[1]);
+    case OpKind::NEGATE: return -args[0];
+    case OpKind::COS: return cos(args[0]);
+    case OpKind::SIN: return sin(args[0]);
+    case OpKind::SQRT: return sqrt(args[0]);
+    case OpKind::EXP: return exp(args[0]);
+    default: return log(args[0]);
+    // clang-format on
+  }
+}
+
 };  // namespace tenkai
@@ -2,18 +2,24 @@
 #include <sys/mman.h>
 #include <unistd.h>
 #include <algorithm>
+#include <atomic>
 #include <cmath>
 #include <cstdint>
+#include <cstddef>
 #include <cstring>
 #include <format>
 #include <iostream>
+#include <limits>
+#include <numeric>
 #include <sstream>
 #include <stack>
 #include <stdexcept>
+#include <unordered_map>
 #include <unordered_set>
 #include <variant>
 #include "cg.hpp"
 #include "operation_scheduler.hpp"
+#include "perf_map.hpp"
 #include "register_alloc.hpp"
 #include "xbyak.h"
 
@@ -29,45 +35,257 @@ std::optional<size_t> find_index(T elem, const std::vector<T>& vec) {
   return std::distance(vec.begin(), it);
 }
 
-// this value must be multiply of page size (4096)?
-// must be shared both xbyak constructor and mmap (why? really)
-constexpr size_t max_code_size = 4096 * 8;
+void* libm_function_address(OpKind kind) {
+  double (*unary)(double) = nullptr;
+  double (*binary)(double, double) = nullptr;
+  switch (kind) {
+    // clang-format off
+    case OpKind::SIN: unary = std::sin; break;
+    case OpKind::COS: unary = std::cos; break;
+    case OpKind::EXP: unary = std::exp; break;
+    case OpKind::LOG: unary = std::log; break;
+    case OpKind::ATAN2: binary = std::atan2; break;
+    case OpKind::POW: binary = std::pow; break;
+    default: throw std::runtime_error(std::format("{} is not a libm call", to_string(kind)));
+      // clang-format on
+  }
+  return unary != nullptr ? reinterpret_cast<void*>(unary) : reinterpret_cast<void*>(binary);
+}
+
+std::vector<int32_t> IoLayout::strided(size_t n, int32_t offset, int32_t stride) {
+  std::vector<int32_t> offsets(n);
+  for (size_t k = 0; k < n; ++k) {
+    // unless stride is 0, the offsets are distinct and the loop throws before k reaches 2^32,
+    // so k * stride fits in 64 bits
+    int64_t value = int64_t(offset) + int64_t(k) * stride;
+    if (value < std::numeric_limits<int32_t>::min() ||
+        value > std::numeric_limits<int32_t>::max()) {
+      throw std::runtime_error(std::format(
+          "offset {} + {} * {} does not fit in a 32-bit displacement", offset, k, stride));
+    }
+    offsets[k] = static_cast<int32_t>(value);
+  }
+  return offsets;
+}
+
+bool IoLayout::is_dense() const {
+  auto is_dense_offsets = [](const std::vector<int32_t>& offsets) {
+    for (size_t k = 0; k < offsets.size(); ++k) {
+      if (offsets[k] != static_cast<int64_t>(k * sizeof(double))) {
+        return false;
+      }
+    }
+    return true;
+  };
+  return is_dense_offsets(input_offsets) && is_dense_offsets(output_offsets);
+}
+
+// upper bounds of the machine code size used to reserve the code buffer.
+// the longest transition is the negation (movabs + movq + vxorpd), and a transition of a
+// kernel with entries may be preceded by a guard (movabs + test + jz rel32)
+constexpr size_t max_prologue_epilogue_size = 128;  // including the instrumentation
+constexpr size_t max_transition_code_size = 32;
+constexpr size_t max_guard_code_size = 24;
+// the stub of an entry (endbr64 + mov ecx + jmp rel32) padded to a fixed size, so that entry e
+// starts at e * entry_stub_size
+constexpr size_t entry_stub_size = 16;
+constexpr size_t max_entries = 64;  // one bit of rbx per entry
+
+size_t estimate_max_code_size(const std::vector<register_alloc::TransitionSet>& transset_seq,
+                              size_t n_entries) {
+  size_t n_transitions = 0;
+  for (const auto& transset : transset_seq) {
+    n_transitions += transset.size();
+  }
+  size_t transition_size = max_transition_code_size + (n_entries > 0 ? max_guard_code_size : 0);
+  return max_prologue_epilogue_size + entry_stub_size * n_entries +
+         transition_size * n_transitions;
+}
+
+// rax = rdtsc (clobbers rdx)
+void emit_read_tsc(Xbyak::CodeGenerator& gen) {
+  gen.rdtsc();
+  gen.shl(gen.rdx, 32);
+  gen.or_(gen.rax, gen.rdx);
+}
 
 std::vector<uint8_t> generate_code(const std::vector<Operation::Ptr>& inputs,
-                                   const std::vector<Operation::Ptr>& outputs) {
-  double (*sin_ptr)(double) = std::sin;
-  void* sin_vptr = reinterpret_cast<void*>(sin_ptr);
-  double (*cos_ptr)(double) = std::cos;
-  void* cos_vptr = reinterpret_cast<void*>(cos_ptr);
-
-  const auto& opseq_flatten = DepthFirstScheduler().flatten(inputs, outputs);
-  const auto& transset_seq =
-      register_alloc::RegisterAllocator(opseq_flatten, inputs, outputs, 16).allocate();
-
-  auto gen = Xbyak::CodeGenerator(max_code_size);
-  gen.endbr64();
+                                   const std::vector<Operation::Ptr>& outputs,
+                                   KernelCounters* counters,
+                                   std::vector<Relocation>* relocations,
+                                   const std::vector<std::string>* ext_names_of_kernel,
+                                   const IoLayout* layout,
+                                   const MachineModel* machine_model,
+                                   const std::vector<std::vector<size_t>>* entries) {
+  const auto& opseq_flatten = machine_model != nullptr
+                                  ? ListScheduler(*machine_model).flatten(inputs, outputs)
+                                  : DepthFirstScheduler().flatten(inputs, outputs);
+  auto allocator = register_alloc::RegisterAllocator(opseq_flatten, inputs, outputs, 16);
+  const auto& transset_seq = allocator.allocate();
+
+  // with entries, rbx has bit e set when entry e is running, and a transition is skipped
+  // unless the running entry needs its value. The values an entry needs are the cone of its
+  // outputs, so every move and operation on them is executed, while a skipped transition only
+  // leaves its destination stale for values the entry never reads. An output is stored only
+  // by the entries that list it
+  const size_t n_entries = entries != nullptr ? entries->size() : 0;
+  if (n_entries > max_entries) {
+    throw std::runtime_error(
+        std::format("{} entries are more than the {} supported", n_entries, max_entries));
+  }
+  const uint64_t all_entries = n_entries == 64 ? ~uint64_t(0) : (uint64_t(1) << n_entries) - 1;
+  std::vector<uint64_t> output_masks(outputs.size(), all_entries);
+  std::unordered_map<register_alloc::HashType, uint64_t> value_masks;
+  if (entries != nullptr) {
+    std::fill(output_masks.begin(), output_masks.end(), 0);
+    for (size_t e = 0; e < n_entries; ++e) {
+      for (auto index : (*entries)[e]) {
+        if (index >= outputs.size()) {
+          throw std::runtime_error(std::format("entry {} refers to output {}, out of {}", e,
+                                               index, outputs.size()));
+        }
+        output_masks[index] |= uint64_t(1) << e;
+      }
+    }
+    for (size_t i = 0; i < outputs.size(); ++i) {
+      value_masks[outputs[i]->hash_id] |= output_masks[i];
+    }
+    // the operands come before their users in the sequence
+    for (auto it = opseq_flatten.rbegin(); it != opseq_flatten.rend(); ++it) {
+      auto mask = value_masks[(*it)->hash_id];
+      for (const auto& arg : (*it)->args) {
+        value_masks[arg->hash_id] |= mask;
+      }
+    }
+  }
+  auto guard_mask = [&](const register_alloc::Transition& trans) -> uint64_t {
+    if (const auto* raw = std::get_if<register_alloc::RawTransition>(&trans);
+        raw != nullptr && raw->dst.type == register_alloc::LocationType::OUTPUT) {
+      return output_masks[raw->dst.idx];
+    }
+    auto hash_id = std::visit([](const auto& t) { return t.hash_id; }, trans);
+    auto it = value_masks.find(hash_id);
+    return it != value_masks.end() ? it->second : all_entries;
+  };
+
+  const auto ext_names =
+      ext_names_of_kernel != nullptr ? *ext_names_of_kernel : ext_func_table(outputs);
+  // the parameter buffer is read through rax, which no transition keeps a value in
+  const size_t param_slot = ext_names.size();
+  auto io_offsets = [](const std::vector<int32_t>* offsets, size_t n, const char* what) {
+    if (offsets == nullptr || offsets->empty()) {
+      return IoLayout::strided(n, 0, sizeof(double));
+    }
+    if (offsets->size() != n) {
+      throw std::runtime_error(
+          std::format("layout has {} {} offsets for {} {}s", offsets->size(), what, n, what));
+    }
+    return *offsets;
+  };
+  const auto input_offsets =
+      io_offsets(layout != nullptr ? &layout->input_offsets : nullptr, inputs.size(), "input");
+  const auto output_offsets =
+      io_offsets(layout != nullptr ? &layout->output_offsets : nullptr, outputs.size(), "output");
+  auto ext_slot = [&ext_names](const std::string& name) -> size_t {
+    return std::distance(ext_names.begin(),
+                         std::lower_bound(ext_names.begin(), ext_names.end(), name));
+  };
+
+  // frame layout (from higher address):
+  // [return address] [r12] [r13] [r14] ([r15] if instrumented) ([rbx] with entries) [rbp]
+  // <- rbp [spilled values ...] [outgoing call arguments ...] <- rsp (16-byte aligned)
+  // as rsp is 8 (mod 16) at entry, an even number of pushes leaves rsp 8 (mod 16) and an odd
+  // number 0 (mod 16)
+  bool instrumented = counters != nullptr;
+  size_t n_pushes = 4 + (instrumented ? 1 : 0) + (entries != nullptr ? 1 : 0);
+  size_t frame_size = (allocator.get_stack_size() + allocator.get_outgoing_size()) * 8;
+  if (frame_size % 16 != (n_pushes % 2 == 1 ? 0 : 8)) {
+    frame_size += 8;
+  }
+
+  auto gen = Xbyak::CodeGenerator(estimate_max_code_size(transset_seq, n_entries));
+  if (entries != nullptr) {
+    // entry e passes e in ecx to the shared body
+    Xbyak::Label body;
+    for (size_t e = 0; e < n_entries; ++e) {
+      gen.endbr64();
+      gen.mov(gen.ecx, static_cast<uint32_t>(e));
+      gen.jmp(body, gen.T_NEAR);
+      while (gen.getSize() < (e + 1) * entry_stub_size) {
+        gen.nop();
+      }
+    }
+    gen.L(body);
+  } else {
+    gen.endbr64();
+  }
   gen.push(gen.r12);
   gen.push(gen.r13);
+  gen.push(gen.r14);
+  if (instrumented) {
+    gen.push(gen.r15);
+  }
+  if (entries != nullptr) {
+    gen.push(gen.rbx);
+    gen.xor_(gen.ebx, gen.ebx);
+    gen.bts(gen.rbx, gen.rcx);
+  }
   gen.push(gen.rbp);
   gen.mov(gen.rbp, gen.rsp);
-  size_t sub_size = 1024;  // temporary
-  gen.sub(gen.rsp, sub_size);
+  gen.sub(gen.rsp, frame_size);
   gen.mov(gen.r12, gen.rdi);
   gen.mov(gen.r13, gen.rsi);
+  gen.mov(gen.r14, gen.rdx);
+  if (instrumented) {
+    // start time in r15, which is preserved by the libm and external calls
+    emit_read_tsc(gen);
+    gen.mov(gen.r15, gen.rax);
+  }
 
+  // consecutive transitions with the same mask share a guard, which jumps to skip
+  uint64_t guarded_mask = all_entries;
+  Xbyak::Label skip;
+  auto close_guard = [&]() {
+    if (guarded_mask != all_entries) {
+      gen.L(skip);
+      skip = Xbyak::Label();
+      guarded_mask = all_entries;
+    }
+  };
   for (size_t i = 0; i < opseq_flatten.size(); ++i) {
-    std::cout << "===============================" << std::endl;
     const auto& op = opseq_flatten[i];
     const register_alloc::TransitionSet& transset = transset_seq[i];
+#ifdef TENKAI_DEBUG_CODEGEN
+    std::cout << "===============================" << std::endl;
     std::cout << std::format("operation name: {}", to_string(op->kind)) << std::endl;
+#endif
     for (const register_alloc::Transition& trans : transset) {
+#ifdef TENKAI_DEBUG_CODEGEN
       std::cout << trans;
+#endif
+      if (auto mask = guard_mask(trans); mask != guarded_mask) {
+        close_guard();
+        if (mask != all_entries) {
+          if (mask <= 0x7fffffff) {
+            gen.test(gen.ebx, static_cast<uint32_t>(mask));
+          } else {
+            gen.mov(gen.rax, mask);
+            gen.test(gen.rbx, gen.rax);
+          }
+          gen.jz(skip, gen.T_NEAR);
+          guarded_mask = mask;
+        }
+      }
       if (std::holds_alternative<register_alloc::RawTransition>(trans)) {
         std::variant<std::monostate, Xbyak::Address, Xbyak::Xmm> src, dst;
         const auto& raw_trans = std::get<register_alloc::RawTransition>(trans);
         switch (raw_trans.src.type) {
           case register_alloc::LocationType::INPUT:
-            src = gen.ptr[gen.r12 + raw_trans.src.idx * 8];
+            src = gen.ptr[gen.r12 + input_offsets[raw_trans.src.idx]];
+            break;
+          case register_alloc::LocationType::PARAM:
+            gen.mov(gen.rax, gen.ptr[gen.r14 + param_slot * 8]);
+            src = gen.ptr[gen.rax + raw_trans.src.idx * 8];
             break;
           case register_alloc::LocationType::REGISTER:
             src = Xbyak::Xmm(raw_trans.src.idx);
@@ -86,7 +304,10 @@ std::vector<uint8_t> generate_code(const std::vector<Operation::Ptr>& inputs,
             dst = gen.ptr[gen.rbp - (raw_trans.dst.idx + 1) * 8];
             break;
           case register_alloc::LocationType::OUTPUT:
-            dst = gen.ptr[gen.r13 + raw_trans.dst.idx * 8];
+            dst = gen.ptr[gen.r13 + output_offsets[raw_trans.dst.idx]];
+            break;
+          case register_alloc::LocationType::OUTGOING:
+            dst = gen.ptr[gen.rsp + raw_trans.dst.idx * 8];
             break;
           default:
             throw std::runtime_error("not implemented");
@@ -117,18 +338,29 @@ std::vector<uint8_t> generate_code(const std::vector<Operation::Ptr>& inputs,
 
         auto instr_operand_xmm_size = op_trans.xmms_src.size();  // different from op.args.size()
         if (instr_operand_xmm_size == 0) {
+          // operands are already placed on xmm0, xmm1, ... by the register allocator.
+          if (op->kind == OpKind::EXTCALL) {
+            gen.call(gen.ptr[gen.r14 + ext_slot(op->ext_func_name.value()) * 8]);
+          } else {
+            // call through register because the code is relocated after generation and
+            // thus rel32 call is not reliable
+            gen.mov(gen.rax, reinterpret_cast<uint64_t>(libm_function_address(op->kind)));
+            if (relocations != nullptr) {
+              relocations->push_back({Relocation::Kind::LIBM, static_cast<uint32_t>(op->kind),
+                                      gen.getSize() - sizeof(uint64_t)});
+            }
+            gen.call(gen.rax);
+          }
+        } else if (instr_operand_xmm_size == 1) {
+          auto arg0 = Xbyak::Xmm(op_trans.xmms_src[0]);
           switch (op->kind) {
-            case OpKind::SIN:
-              gen.call(sin_vptr);
-              break;
-            case OpKind::COS:
-              gen.call(cos_vptr);
+            case OpKind::SQRT:
+              gen.vsqrtsd(dst, arg0, arg0);
               break;
             default:
-              throw std::runtime_error("not implemented");
+              throw std::runtime_error(
+                  std::format("not implemented operation name: {}", to_string(op->kind)));
           }
-        } else if (instr_operand_xmm_size == 1) {
-          throw std::runtime_error("not implemented");
         } else if (instr_operand_xmm_size == 2) {
           auto arg0 = Xbyak::Xmm(op_trans.xmms_src[0]);
           auto arg1 = Xbyak::Xmm(op_trans.xmms_src[1]);
@@ -148,6 +380,9 @@ std::vector<uint8_t> generate_code(const std::vector<Operation::Ptr>& inputs,
             case OpKind::MUL:
               gen.vmulsd(dst, arg0, arg1);
               break;
+            case OpKind::DIV:
+              gen.vdivsd(dst, arg0, arg1);
+              break;
             default:
               throw std::runtime_error(
                   std::format("not implemented operation name: {}", to_string(op->kind)));
@@ -158,27 +393,172 @@ std::vector<uint8_t> generate_code(const std::vector<Operation::Ptr>& inputs,
       }
     }
   }
+  close_guard();
+
+  if (instrumented) {
+    // rax = elapsed cycles, rdx = floor(log2(elapsed | 1)) as the histogram bucket
+    emit_read_tsc(gen);
+    gen.sub(gen.rax, gen.r15);
+    gen.mov(gen.rcx, reinterpret_cast<uint64_t>(counters));
+    if (relocations != nullptr) {
+      relocations->push_back({Relocation::Kind::COUNTERS, 0, gen.getSize() - sizeof(uint64_t)});
+    }
+    gen.lock();
+    gen.add(gen.qword[gen.rcx + offsetof(KernelCounters, total_cycles)], gen.rax);
+    gen.or_(gen.rax, 1);
+    gen.bsr(gen.rdx, gen.rax);
+    gen.lock();
+    gen.inc(gen.qword[gen.rcx + gen.rdx * 8 + offsetof(KernelCounters, histogram)]);
+  }
 
   gen.mov(gen.rsp, gen.rbp);
   gen.pop(gen.rbp);
+  if (entries != nullptr) {
+    gen.pop(gen.rbx);
+  }
+  if (instrumented) {
+    gen.pop(gen.r15);
+  }
+  gen.pop(gen.r14);
   gen.pop(gen.r13);
   gen.pop(gen.r12);
   gen.ret();
 
   auto code = std::vector<uint8_t>(gen.getSize());
   std::copy(gen.getCode(), gen.getCode() + gen.getSize(), code.begin());
+  if (relocations != nullptr) {
+    // an address that fits in 32 bits would be encoded as a shorter mov
+    for (const auto& relocation : *relocations) {
+      uint64_t address =
+          relocation.kind == Relocation::Kind::LIBM
+              ? reinterpret_cast<uint64_t>(libm_function_address(OpKind(relocation.target)))
+              : reinterpret_cast<uint64_t>(counters);
+      if (std::memcmp(code.data() + relocation.offset, &address, sizeof(address)) != 0) {
+        throw std::runtime_error("relocation does not point to a 64-bit immediate");
+      }
+    }
+  }
   return code;
 }
 
+namespace {
+
+std::string kernel_name(const CompileOptions& options) {
+  static std::atomic<size_t> kernel_count = 0;
+  return options.name.empty() ? std::format("tenkai_kernel_{}", kernel_count++) : options.name;
+}
+
+// maps the functions into one executable region, each starting at a 16-byte boundary
+std::vector<JitFunc<double>> map_code(const std::vector<std::vector<uint8_t>>& codes,
+                                      const std::vector<std::string>& names,
+                                      const CompileOptions& options) {
+  constexpr size_t function_alignment = 16;
+  std::vector<size_t> offsets;
+  size_t total_size = 0;
+  for (const auto& code : codes) {
+    offsets.push_back(total_size);
+    total_size += (code.size() + function_alignment - 1) / function_alignment * function_alignment;
+  }
+  size_t page_size = sysconf(_SC_PAGESIZE);
+  size_t mapped_size = (total_size + page_size - 1) / page_size * page_size;
+  void* mem = mmap(NULL, mapped_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (mem == MAP_FAILED) {
+    throw std::runtime_error("failed to allocate memory for the code");
+  }
+  // padding between the functions is int3
+  std::memset(mem, 0xcc, mapped_size);
+  for (size_t i = 0; i < codes.size(); ++i) {
+    std::memcpy(static_cast<uint8_t*>(mem) + offsets[i], codes[i].data(), codes[i].size());
+  }
+  if (mprotect(mem, mapped_size, PROT_READ | PROT_EXEC) == -1) {
+    munmap(mem, mapped_size);
+    throw std::runtime_error("failed to make the code executable");
+  }
+  std::vector<JitFunc<double>> funcs;
+  for (size_t i = 0; i < codes.size(); ++i) {
+    uint8_t* instruction = static_cast<uint8_t*>(mem) + offsets[i];
+    if (options.perf_map) {
+      write_perf_map_entry(instruction, codes[i].size(), names[i]);
+    }
+    if (options.jitdump) {
+      write_jitdump_entry(instruction, codes[i].size(), names[i]);
+    }
+    funcs.push_back(reinterpret_cast<JitFunc<double>>(instruction));
+  }
+  return funcs;
+}
+
+}  // namespace
+
 JitFunc<double> compile(const std::vector<Operation::Ptr>& inputs,
-                        const std::vector<Operation::Ptr>& outputs) {
-  auto code = generate_code(inputs, outputs);
-  void* mem = mmap(NULL, max_code_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
-  uint8_t* instruction = static_cast<uint8_t*>(mem);
-  std::memcpy(instruction, code.data(), code.size());
-  mprotect(mem, max_code_size, PROT_READ | PROT_EXEC) == -1;
-  auto add_func = reinterpret_cast<JitFunc<double>>(instruction);
-  return add_func;
+                        const std::vector<Operation::Ptr>& outputs,
+                        const CompileOptions& options) {
+  auto name = kernel_name(options);
+  KernelCounters* counters = nullptr;
+  if (options.instrument) {
+    counters = KernelRegistry::instance().add(name);
+  }
+  auto code = generate_code(inputs, outputs, counters, nullptr, nullptr, &options.layout,
+                            options.machine_model ? &*options.machine_model : nullptr);
+  return map_code({code}, {name}, options)[0];
+}
+
+std::vector<JitFunc<double>> compile_entries(const std::vector<Operation::Ptr>& inputs,
+                                             const std::vector<Operation::Ptr>& outputs,
+                                             const std::vector<std::vector<size_t>>& entries,
+                                             const CompileOptions& options) {
+  if (entries.empty()) {
+    throw std::runtime_error("compile_entries needs at least one entry");
+  }
+  auto name = kernel_name(options);
+  auto ext_names = ext_func_table(outputs);
+  const auto whole_offsets =
+      options.layout.output_offsets.empty()
+          ? IoLayout::strided(outputs.size(), 0, sizeof(double))
+          : options.layout.output_offsets;
+  if (whole_offsets.size() != outputs.size()) {
+    throw std::runtime_error(std::format("layout has {} output offsets for {} outputs",
+                                         whole_offsets.size(), outputs.size()));
+  }
+  // the body computes the outputs listed by any entry, each written at its place in the whole
+  // outputs. The outputs of the smaller entries come first, so that the operations of their
+  // cones are scheduled together and share the guards
+  std::vector<size_t> entry_order(entries.size());
+  std::iota(entry_order.begin(), entry_order.end(), 0);
+  std::stable_sort(entry_order.begin(), entry_order.end(), [&entries](size_t a, size_t b) {
+    return entries[a].size() < entries[b].size();
+  });
+  std::vector<Operation::Ptr> body_outputs;
+  IoLayout body_layout{options.layout.input_offsets, {}};
+  std::unordered_map<size_t, size_t> body_indices;
+  std::vector<std::vector<size_t>> body_entries(entries.size());
+  for (auto e : entry_order) {
+    for (auto index : entries[e]) {
+      if (index >= outputs.size()) {
+        throw std::runtime_error(std::format("entry {} refers to output {}, out of {}", e, index,
+                                             outputs.size()));
+      }
+      auto [it, inserted] = body_indices.emplace(index, body_outputs.size());
+      if (inserted) {
+        body_outputs.push_back(outputs[index]);
+        body_layout.output_offsets.push_back(whole_offsets[index]);
+      }
+      body_entries[e].push_back(it->second);
+    }
+  }
+  KernelCounters* counters = nullptr;
+  if (options.instrument) {
+    counters = KernelRegistry::instance().add(name);
+  }
+  auto code = generate_code(inputs, body_outputs, counters, nullptr, &ext_names, &body_layout,
+                            options.machine_model ? &*options.machine_model : nullptr,
+                            &body_entries);
+  auto base = reinterpret_cast<uint8_t*>(map_code({code}, {name}, options)[0]);
+  std::vector<JitFunc<double>> funcs;
+  for (size_t e = 0; e < entries.size(); ++e) {
+    funcs.push_back(reinterpret_cast<JitFunc<double>>(base + e * entry_stub_size));
+  }
+  return funcs;
 }
 
 }  // namespace compiler
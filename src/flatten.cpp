@@ -1,203 +1,332 @@
 #include <dlfcn.h>
-#include <algorithm>
+#include <charconv>
+#include <cmath>
 #include <format>
 #include <fstream>
 #include <iostream>
-#include <stack>
+#include <map>
+#include <stdexcept>
 #include <string>
-#include <typeinfo>
+#include <string_view>
+#include <type_traits>
 #include <unordered_map>
-#include <unordered_set>
 #include "cg.hpp"
+#include "operation_scheduler.hpp"
 
 namespace tenkai {
 
-template <typename T>
-constexpr const char* getTypeString() {
-  if constexpr (std::is_same_v<T, double>)
-    return "double";
-  else if constexpr (std::is_same_v<T, float>)
-    return "float";
-  else
-    return "unknown";
-}
+namespace {
 
-template <typename T>
-constexpr void opkind_to_cppfunc_name(OpKind kind, std::ostream& strm) {
-  if (kind == OpKind::EXTCALL) {
-    throw std::runtime_error("EXTCALL does not have cpp function name");
-  }
-  std::string type_name = getTypeString<T>();
-  // use std::plus .. to handle these primitive operation as function
-  switch (kind) {
-    // clang-format off
-    case OpKind::ADD: strm << std::format("std::plus<{}>()", type_name); break;
-    case OpKind::SUB: strm << std::format("std::minus<{}>()", type_name); break;
-    case OpKind::MUL: strm << std::format("std::multiplies<{}>()", type_name); break;
-    case OpKind::COS: strm << "cos"; break;
-    case OpKind::SIN: strm << "sin"; break;
-    case OpKind::NEGATE: strm << std::format("std::negate<{}>()", type_name); break;
-    default: throw std::runtime_error("unknown operator");
-      // clang-format on
+// appends to a string and writes it to the stream in large chunks, instead of going through
+// the formatting of std::ostream for every token
+class SourceWriter {
+ public:
+  explicit SourceWriter(std::ostream& strm) : strm_(strm) { buffer_.reserve(buffer_size); }
+  ~SourceWriter() { flush(); }
+
+  SourceWriter& operator<<(std::string_view str) {
+    buffer_.append(str);
+    if (buffer_.size() >= buffer_size) {
+      flush();
+    }
+    return *this;
+  }
+  SourceWriter& operator<<(char c) {
+    buffer_.push_back(c);
+    return *this;
+  }
+  SourceWriter& operator<<(size_t value) {
+    char chars[24];
+    auto end = std::to_chars(chars, chars + sizeof(chars), value).ptr;
+    return *this << std::string_view(chars, end - chars);
+  }
+  SourceWriter& operator<<(double value) {
+    if (std::isnan(value)) {
+      return *this << "__builtin_nan(\"\")";
+    }
+    if (std::isinf(value)) {
+      return *this << (value > 0 ? "__builtin_inf()" : "(-__builtin_inf())");
+    }
+    // shortest representation that round-trips, made a floating point literal (so that -0 is
+    // kept) and parenthesized if negative, so that e.g. x - -1.0 is valid
+    char chars[40];
+    auto end = std::to_chars(chars, chars + sizeof(chars) - 2, value).ptr;
+    auto literal = std::string_view(chars, end - chars);
+    if (literal.find_first_of(".e") == std::string_view::npos) {
+      *end++ = '.';
+      *end++ = '0';
+      literal = std::string_view(chars, end - chars);
+    }
+    if (std::signbit(value)) {
+      return *this << '(' << literal << ')';
+    }
+    return *this << literal;
+  }
+  void flush() {
+    strm_.write(buffer_.data(), buffer_.size());
+    buffer_.clear();
+  }
+
+ private:
+  static constexpr size_t buffer_size = 1 << 16;
+  std::ostream& strm_;
+  std::string buffer_;
+};
+
+// where the value of a node is read from in the generated code
+struct Operand {
+  enum class Kind { INPUT, BATCH_INPUT, PARAM, CONSTANT, TEMP } kind;
+  size_t index;  // input, parameter or temporary number
+  double value;  // for CONSTANT
+};
+
+SourceWriter& operator<<(SourceWriter& writer, const Operand& operand) {
+  switch (operand.kind) {
+    case Operand::Kind::INPUT:
+      return writer << "input[" << operand.index << ']';
+    case Operand::Kind::BATCH_INPUT:
+      return writer << "in" << operand.index << "[i]";
+    case Operand::Kind::PARAM:
+      return writer << "params[" << operand.index << ']';
+    case Operand::Kind::CONSTANT:
+      return writer << operand.value;
+    default:
+      return writer << 't' << operand.index;
   }
 }
 
-void flatten(const std::string& func_name,
-             const std::vector<Operation::Ptr>& inputs,
-             const std::vector<Operation::Ptr>& outputs,
-             std::ostream& strm,
-             const std::string& type_name) {
-  // check if inputs and outputs are unique (in terms of hash_id)
-  // TODO: this requirment is too strict, we should relax this
-  std::unordered_set<int32_t> input_output_set;
-  for (auto& input : inputs) {
-    input_output_set.insert(input->hash_id);
-  }
-  for (auto& output : outputs) {
-    input_output_set.insert(output->hash_id);
-  }
-  if (input_output_set.size() != inputs.size() + outputs.size()) {
-    for (auto& input : inputs) {
-      std::cout << "input: " << input->hash_id << std::endl;
-    }
-    for (auto& output : outputs) {
-      std::cout << "output: " << output->hash_id << std::endl;
-    }
-    throw std::runtime_error("inputs and outputs must be unique");
-  }
-
-  std::vector<Operation::Ptr> operations;
-  std::stack<Operation::Ptr> opstack;
-  for (auto& output : outputs) {
-    opstack.push(output);
-  }
-  while (!opstack.empty()) {
-    auto op = opstack.top();
-    opstack.pop();
-    if (!op->is_nullaryop()) {
-      operations.push_back(op);
-      for (auto& arg : op->args) {
-        if (arg != nullptr) {
-          opstack.push(arg);
-        }
-      }
+// the body of flatten() and flatten_batch()
+void emit_kernel(const std::string& func_name,
+                 const std::vector<Operation::Ptr>& inputs,
+                 const std::vector<Operation::Ptr>& outputs,
+                 std::ostream& strm,
+                 const std::string& type_name,
+                 bool batch) {
+  // same evaluation order as the native compiler, each common subexpression appears once
+  auto operations = compiler::DepthFirstScheduler().flatten(inputs, outputs);
+
+  // nodes are identified by hash_id as in the scheduler, so a node that the scheduler merged
+  // into an input (e.g. (x + y) - y) is read from the input as well
+  std::unordered_map<int32_t, Operand> operands;
+  operands.reserve(operations.size() + inputs.size());
+  for (size_t i = 0; i < inputs.size(); ++i) {
+    auto kind = batch ? Operand::Kind::BATCH_INPUT : Operand::Kind::INPUT;
+    if (!operands.emplace(inputs[i]->hash_id, Operand{kind, i, 0.0}).second) {
+      throw std::runtime_error("inputs must be unique");
     }
   }
-
-  auto remapped_name = [&](const Operation::Ptr op) -> std::string {
-    for (size_t i = 0; i < inputs.size(); ++i) {
-      if (inputs[i] == op) {
-        if (op->kind != OpKind::LOAD) {
-          throw std::runtime_error("must not reach here");
-        }
-        return std::format("input[{}]", i);
-      }
+  bool has_params = false;
+  for (const auto& op : operations) {
+    if (op->kind == OpKind::PARAM) {
+      operands.emplace(op->hash_id, Operand{Operand::Kind::PARAM, op->param_index.value(), 0.0});
+      has_params = true;
     }
-
-    if (op->kind == OpKind::LOAD) {
-      throw std::runtime_error("must not reach here");
+  }
+  // outputs may be duplicated or even constant, e.g. entries of jacobian
+  std::unordered_map<int32_t, std::vector<size_t>> output_indices;
+  for (size_t i = 0; i < outputs.size(); ++i) {
+    output_indices[outputs[i]->hash_id].push_back(i);
+  }
+  auto operand_of = [&operands](const Operation::Ptr& op) -> Operand {
+    if (op->constant_value.has_value()) {
+      return Operand{Operand::Kind::CONSTANT, 0, *op->constant_value};
     }
-
-    // if zero/one/constant, return the value
-    if (op->kind == OpKind::ZERO || op->kind == OpKind::ONE || op->kind == OpKind::CONSTANT) {
-      return std::to_string(*op->constant_value);
+    auto it = operands.find(op->hash_id);
+    if (it == operands.end()) {
+      throw std::runtime_error("must not reach here");
     }
-    auto var_name = std::to_string(op->hash_id);
-    std::replace(var_name.begin(), var_name.end(), '-', 'm');
-    return "var_" + var_name;
+    return it->second;
   };
 
-  // code generation
-  strm << "#include <cmath>" << std::endl;
-  strm << "#include <functional>" << std::endl;
-  strm << "extern \"C\" {" << std::endl;
-  strm << std::format("void {}(const {}* input, {}* output, void** extfns){{\n", func_name,
-                      type_name, type_name);
-  std::unordered_map<std::string, bool> is_evaluated;
-  for (auto it = operations.rbegin(); it != operations.rend(); ++it) {
-    auto op = *it;
-    if (is_evaluated.find(remapped_name(op)) != is_evaluated.end()) {
+  SourceWriter writer(strm);
+  writer << "#include <cmath>\n";
+  writer << "#include <cstddef>\n";
+  writer << "extern \"C\" {\n";
+  if (batch) {
+    writer << "void " << func_name << "(const " << type_name << "* const* input, " << type_name
+           << "* const* output, void** extfns, size_t n){\n";
+  } else {
+    writer << "void " << func_name << "(const " << type_name << "* input, " << type_name
+           << "* output, void** extfns){\n";
+  }
+
+  // external functions are resolved once, from the slot assigned by ext_func_table, i.e. the
+  // sorted names, which are collected from the operations rather than by another graph walk
+  std::map<std::string, size_t> ext_arities;
+  for (const auto& op : operations) {
+    if (op->kind != OpKind::EXTCALL) {
       continue;
     }
-    if (op->is_nullaryop()) {
-      throw std::runtime_error("must not reach here");
+    auto [it, inserted] = ext_arities.emplace(op->ext_func_name.value(), op->args.size());
+    if (!inserted && it->second != op->args.size()) {
+      throw std::runtime_error(
+          std::format("external function {} is called with different arities", it->first));
     }
-
-    if (op->kind == OpKind::EXTCALL) {
-      // require additional cast to function pointer
-      strm << "  auto " << op->ext_func_name.value();
-      strm << " = reinterpret_cast<double (*)(";
-      for (size_t i = 0; i < op->args.size(); ++i) {
-        if (i != 0) {
-          strm << ", ";
-        }
-        strm << "double";
-      }
-      strm << ")>(extfns[0]);" << std::endl;
+  }
+  std::vector<std::string> ext_names;
+  for (const auto& [name, arity] : ext_arities) {
+    ext_names.push_back(name);
+  }
+  std::unordered_map<std::string, size_t> ext_slots;
+  for (size_t slot = 0; slot < ext_names.size(); ++slot) {
+    const auto& name = ext_names[slot];
+    ext_slots[name] = slot;
+    writer << "  auto extfn" << slot << " = reinterpret_cast<double (*)(";
+    for (size_t i = 0; i < ext_arities[name]; ++i) {
+      writer << (i == 0 ? "double" : ", double");
     }
+    writer << ")>(extfns[" << slot << "]);  // " << name << '\n';
+  }
+  if (has_params) {
+    writer << "  const " << type_name << "* __restrict params = static_cast<const " << type_name
+           << "*>(extfns[" << ext_names.size() << "]);\n";
+  }
 
-    strm << "  ";  // for indent
-    bool is_intermediate = (remapped_name(op).find("output") == std::string::npos);
-    if (is_intermediate) {
-      strm << "auto ";
+  // in the batch kernel, the columns of the inputs and outputs are hoisted out of the loop
+  // so that the compiler can vectorize it
+  std::string_view indent = "  ";
+  auto write_output = [&](size_t output_idx) -> SourceWriter& {
+    if (batch) {
+      return writer << indent << "out" << output_idx << "[i] = ";
     }
-    strm << remapped_name(op) << " = ";
-    if (op->kind == OpKind::EXTCALL) {
-      strm << op->ext_func_name.value();
-    } else {
-      opkind_to_cppfunc_name<double>(op->kind, strm);
+    return writer << indent << "output[" << output_idx << "] = ";
+  };
+  if (batch) {
+    for (size_t i = 0; i < inputs.size(); ++i) {
+      writer << "  const " << type_name << "* __restrict in" << i << " = input[" << i << "];\n";
     }
-    strm << "(";
-    for (size_t i = 0; i < op->args.size(); ++i) {
-      if (i != 0) {
-        strm << ", ";
-      }
-      strm << remapped_name(op->args[i]);
+    for (size_t i = 0; i < outputs.size(); ++i) {
+      writer << "  " << type_name << "* __restrict out" << i << " = output[" << i << "];\n";
     }
-    strm << ");" << std::endl;
+    writer << "#pragma omp simd\n";
+    writer << "  for (size_t i = 0; i < n; ++i) {\n";
+    indent = "    ";
+  }
 
-    // if op is output, assign to output
-    size_t output_idx =
-        std::distance(outputs.begin(), std::find(outputs.begin(), outputs.end(), op));
-    if (output_idx != outputs.size()) {
-      strm << "  output[" << output_idx << "] = " << remapped_name(op) << ";" << std::endl;
+  size_t n_temps = 0;
+  for (const auto& op : operations) {
+    if (op->is_nullaryop() || operands.contains(op->hash_id)) {
+      continue;
     }
+    const auto& args = op->args;
+    writer << indent << "const " << type_name << " t" << n_temps << " = ";
+    switch (op->kind) {
+      // clang-format off
+      case OpKind::ADD: writer << operand_of(args[0]) << " + " << operand_of(args[1]); break;
+      case OpKind::SUB: writer << operand_of(args[0]) << " - " << operand_of(args[1]); break;
+      case OpKind::MUL: writer << operand_of(args[0]) << " * " << operand_of(args[1]); break;
+      case OpKind::DIV: writer << operand_of(args[0]) << " / " << operand_of(args[1]); break;
+      case OpKind::NEGATE: writer << '-' << operand_of(args[0]); break;
+      // clang-format on
+      default: {
+        switch (op->kind) {
+          // clang-format off
+          case OpKind::COS: writer << "cos"; break;
+          case OpKind::SIN: writer << "sin"; break;
+          case OpKind::SQRT: writer << "sqrt"; break;
+          case OpKind::EXP: writer << "exp"; break;
+          case OpKind::LOG: writer << "log"; break;
+          case OpKind::ATAN2: writer << "atan2"; break;
+          case OpKind::POW: writer << "pow"; break;
+          case OpKind::EXTCALL: writer << "extfn" << ext_slots.at(op->ext_func_name.value()); break;
+          default: throw std::runtime_error("unknown operator");
+            // clang-format on
+        }
+        writer << '(';
+        for (size_t i = 0; i < args.size(); ++i) {
+          if (i != 0) {
+            writer << ", ";
+          }
+          writer << operand_of(args[i]);
+        }
+        writer << ')';
+        break;
+      }
+    }
+    writer << ";\n";
+    operands.emplace(op->hash_id, Operand{Operand::Kind::TEMP, n_temps++, 0.0});
 
-    is_evaluated[remapped_name(op)] = true;
+    // outputs are written as soon as they are computed
+    auto it_output = output_indices.find(op->hash_id);
+    if (it_output != output_indices.end()) {
+      for (auto output_idx : it_output->second) {
+        write_output(output_idx) << 't' << n_temps - 1 << ";\n";
+      }
+      output_indices.erase(it_output);
+    }
   }
-  strm << "}" << std::endl;
-  strm << "}" << std::endl;  // for extern "C"
+  // outputs that are inputs or constants are not computed above
+  for (size_t i = 0; i < outputs.size(); ++i) {
+    if (output_indices.contains(outputs[i]->hash_id)) {
+      write_output(i) << operand_of(outputs[i]) << ";\n";
+    }
+  }
+  if (batch) {
+    writer << "  }\n";
+  }
+  writer << "}\n";
+  writer << "}\n";  // for extern "C"
 }
 
+}  // namespace
+
+void flatten(const std::string& func_name,
+             const std::vector<Operation::Ptr>& inputs,
+             const std::vector<Operation::Ptr>& outputs,
+             std::ostream& strm,
+             const std::string& type_name) {
+  emit_kernel(func_name, inputs, outputs, strm, type_name, false);
+}
+
+void flatten_batch(const std::string& func_name,
+                   const std::vector<Operation::Ptr>& inputs,
+                   const std::vector<Operation::Ptr>& outputs,
+                   std::ostream& strm,
+                   const std::string& type_name) {
+  emit_kernel(func_name, inputs, outputs, strm, type_name, true);
+}
+
+namespace {
+
 template <typename T>
-JitFunc<T> jit_compile(const std::vector<Operation::Ptr>& inputs,
-                       const std::vector<Operation::Ptr>& outputs,
-                       const std::string& backend,
-                       bool disas) {
-  std::string type_name;
+std::string type_name_of() {
   if constexpr (std::is_same<T, double>::value) {
-    type_name = "double";
+    return "double";
   } else if constexpr (std::is_same<T, float>::value) {
-    type_name = "float";
+    return "float";
   } else {
     throw std::runtime_error("unsupported type");
   }
+}
 
+// compiles the source written by the emitter into a shared library and returns the function
+void* compile_source(const std::vector<Operation::Ptr>& inputs,
+                     const std::vector<Operation::Ptr>& outputs,
+                     const std::string& type_name,
+                     const JitOptions& options,
+                     bool batch) {
   std::string func_name = "generated_" + generate_random_string(16);
   std::string source_name = "/tmp/" + func_name + ".cpp";
   std::string so_name = "/tmp/" + func_name + ".so";
 
   auto fs = std::ofstream(source_name);
-  flatten(func_name, inputs, outputs, fs, type_name);
+  emit_kernel(func_name, inputs, outputs, fs, type_name, batch);
   fs.close();
-  std::string cmd = backend + " -O3 -shared -fPIC " + source_name + " -o " + so_name;
+  std::string cmd = options.compiler + " " + options.flags + " -shared -fPIC ";
+  if (batch) {
+    // -fopenmp-simd honors `#pragma omp simd` without linking the OpenMP runtime. sqrt and
+    // the other libm calls are not vectorized while they may set errno, which the generated
+    // code never reads
+    cmd += "-fopenmp-simd -fno-math-errno ";
+  }
+  cmd += source_name + " -o " + so_name;
 
   auto ret = system(cmd.c_str());
   if (ret != 0) {
     throw std::runtime_error("failed to compile");
   }
 
-  if (disas) {
+  if (options.disas) {
     std::string disas_cmd = "objdump --disassemble=" + func_name + " " + so_name;
     std::cout << disas_cmd << std::endl;
     system(disas_cmd.c_str());
@@ -207,7 +336,7 @@ JitFunc<T> jit_compile(const std::vector<Operation::Ptr>& inputs,
   if (lib == nullptr) {
     throw std::runtime_error("dlopen failed");
   }
-  auto func = reinterpret_cast<JitFunc<T>>(dlsym(lib, func_name.c_str()));
+  auto func = dlsym(lib, func_name.c_str());
   if (func == nullptr) {
     throw std::runtime_error("dlsym failed");
   }
@@ -217,6 +346,43 @@ JitFunc<T> jit_compile(const std::vector<Operation::Ptr>& inputs,
   return func;
 }
 
+}  // namespace
+
+template <typename T>
+JitFunc<T> jit_compile(const std::vector<Operation::Ptr>& inputs,
+                       const std::vector<Operation::Ptr>& outputs,
+                       const JitOptions& options) {
+  return reinterpret_cast<JitFunc<T>>(
+      compile_source(inputs, outputs, type_name_of<T>(), options, false));
+}
+
+template <typename T>
+JitFunc<T> jit_compile(const std::vector<Operation::Ptr>& inputs,
+                       const std::vector<Operation::Ptr>& outputs,
+                       const std::string& backend,
+                       bool disas) {
+  JitOptions options;
+  options.compiler = backend;
+  options.disas = disas;
+  return jit_compile<T>(inputs, outputs, options);
+}
+
+template <typename T>
+BatchJitFunc<T> jit_compile_batch(const std::vector<Operation::Ptr>& inputs,
+                                  const std::vector<Operation::Ptr>& outputs,
+                                  const JitOptions& options) {
+  return reinterpret_cast<BatchJitFunc<T>>(
+      compile_source(inputs, outputs, type_name_of<T>(), options, true));
+}
+
+template JitFunc<double> jit_compile<double>(const std::vector<Operation::Ptr>& inputs,
+                                             const std::vector<Operation::Ptr>& outputs,
+                                             const JitOptions& options);
+
+template JitFunc<float> jit_compile<float>(const std::vector<Operation::Ptr>& inputs,
+                                           const std::vector<Operation::Ptr>& outputs,
+                                           const JitOptions& options);
+
 template JitFunc<double> jit_compile<double>(const std::vector<Operation::Ptr>& inputs,
                                              const std::vector<Operation::Ptr>& outputs,
                                              const std::string& backend,
@@ -227,4 +393,12 @@ template JitFunc<float> jit_compile<float>(const std::vector<Operation::Ptr>& in
                                            const std::string& backend,
                                            bool disas);
 
+template BatchJitFunc<double> jit_compile_batch<double>(const std::vector<Operation::Ptr>& inputs,
+                                                        const std::vector<Operation::Ptr>& outputs,
+                                                        const JitOptions& options);
+
+template BatchJitFunc<float> jit_compile_batch<float>(const std::vector<Operation::Ptr>& inputs,
+                                                      const std::vector<Operation::Ptr>& outputs,
+                                                      const JitOptions& options);
+
 }  // namespace tenkai
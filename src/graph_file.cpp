@@ -0,0 +1,257 @@
+#include "graph_file.hpp"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cstring>
+#include <format>
+#include <fstream>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+
+namespace tenkai {
+
+namespace {
+
+constexpr char graph_file_magic[8] = "TENKAIG";
+
+size_t align8(size_t size) {
+  return (size + 7) / 8 * 8;
+}
+
+template <typename T>
+std::span<const T> take_section(const uint8_t* base, size_t& offset, size_t count) {
+  auto section = std::span<const T>(reinterpret_cast<const T*>(base + offset), count);
+  offset += align8(count * sizeof(T));
+  return section;
+}
+
+}  // namespace
+
+void save_graph(const std::string& path,
+                const std::vector<Operation::Ptr>& inputs,
+                const std::vector<Operation::Ptr>& outputs) {
+  // nodes are numbered in post-order, so the operands of a node always come before it
+  std::unordered_map<const Operation*, uint32_t> indices;
+  std::vector<const Operation*> nodes;
+  for (const auto& input : inputs) {
+    if (indices.emplace(input.get(), nodes.size()).second) {
+      nodes.push_back(input.get());
+    }
+  }
+  std::vector<std::pair<const Operation*, bool>> stack;  // (node, expanded)
+  for (auto it = outputs.rbegin(); it != outputs.rend(); ++it) {
+    stack.emplace_back(it->get(), false);
+  }
+  while (!stack.empty()) {
+    auto [op, expanded] = stack.back();
+    stack.pop_back();
+    if (indices.contains(op)) {
+      continue;
+    }
+    if (expanded) {
+      indices.emplace(op, nodes.size());
+      nodes.push_back(op);
+      continue;
+    }
+    stack.emplace_back(op, true);
+    for (auto it = op->args.rbegin(); it != op->args.rend(); ++it) {
+      if (!indices.contains(it->get())) {
+        stack.emplace_back(it->get(), false);
+      }
+    }
+  }
+
+  std::vector<GraphFileNode> file_nodes;
+  std::vector<uint32_t> operands;
+  std::string strings;
+  std::unordered_map<std::string, uint32_t> string_offsets;
+  file_nodes.reserve(nodes.size());
+  for (const auto op : nodes) {
+    GraphFileNode node{};
+    node.kind = static_cast<uint32_t>(op->kind);
+    node.n_args = op->args.size();
+    node.first_arg = operands.size();
+    node.hash_id = op->hash_id;
+    for (const auto& arg : op->args) {
+      operands.push_back(indices.at(arg.get()));
+    }
+    if (op->ext_func_name.has_value()) {
+      auto [it, inserted] = string_offsets.emplace(*op->ext_func_name, strings.size());
+      if (inserted) {
+        strings += *op->ext_func_name + '\0';
+      }
+      node.ext_func_name = it->second;
+    }
+    node.param_index = op->param_index.value_or(0);
+    node.constant_value = op->constant_value.value_or(0.0);
+    file_nodes.push_back(node);
+  }
+  std::vector<uint32_t> input_indices, output_indices;
+  for (const auto& input : inputs) {
+    input_indices.push_back(indices.at(input.get()));
+  }
+  for (const auto& output : outputs) {
+    output_indices.push_back(indices.at(output.get()));
+  }
+
+  GraphFileHeader header{};
+  std::memcpy(header.magic, graph_file_magic, sizeof(header.magic));
+  header.version = graph_file_version;
+  header.n_nodes = file_nodes.size();
+  header.n_operands = operands.size();
+  header.n_inputs = input_indices.size();
+  header.n_outputs = output_indices.size();
+  header.strings_size = strings.size();
+
+  std::ofstream ofs(path, std::ios::binary | std::ios::trunc);
+  if (!ofs) {
+    throw std::runtime_error(std::format("failed to open {}", path));
+  }
+  auto write_section = [&ofs](const void* data, size_t size) {
+    static const char padding[8] = {};
+    ofs.write(static_cast<const char*>(data), size);
+    ofs.write(padding, align8(size) - size);
+  };
+  write_section(&header, sizeof(header));
+  write_section(file_nodes.data(), file_nodes.size() * sizeof(GraphFileNode));
+  write_section(operands.data(), operands.size() * sizeof(uint32_t));
+  write_section(input_indices.data(), input_indices.size() * sizeof(uint32_t));
+  write_section(output_indices.data(), output_indices.size() * sizeof(uint32_t));
+  write_section(strings.data(), strings.size());
+  if (!ofs) {
+    throw std::runtime_error(std::format("failed to write {}", path));
+  }
+}
+
+GraphView::GraphView(const std::string& path) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd == -1) {
+    throw std::runtime_error(std::format("failed to open {}", path));
+  }
+  struct stat st;
+  if (fstat(fd, &st) == -1 || static_cast<size_t>(st.st_size) < sizeof(GraphFileHeader)) {
+    close(fd);
+    throw std::runtime_error(std::format("{} is not a graph file", path));
+  }
+  size_ = st.st_size;
+  mem_ = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (mem_ == MAP_FAILED) {
+    throw std::runtime_error(std::format("failed to map {}", path));
+  }
+  auto fail = [this, &path](const std::string& message) {
+    munmap(mem_, size_);
+    throw std::runtime_error(std::format("{}: {}", path, message));
+  };
+
+  auto base = static_cast<const uint8_t*>(mem_);
+  const auto& header = *reinterpret_cast<const GraphFileHeader*>(base);
+  if (std::memcmp(header.magic, graph_file_magic, sizeof(header.magic)) != 0) {
+    fail("not a graph file");
+  }
+  if (header.version != graph_file_version) {
+    fail(std::format("graph file version {} is not supported (expected {})", header.version,
+                     graph_file_version));
+  }
+  // the counts are bounded first, so that the sizes computed from them do not overflow
+  if (header.n_nodes > UINT32_MAX || header.n_operands > UINT32_MAX ||
+      header.n_inputs > size_ || header.n_outputs > size_ || header.strings_size > size_) {
+    fail("corrupted graph file");
+  }
+  size_t offset = align8(sizeof(header));
+  size_t expected_size = offset + align8(header.n_nodes * sizeof(GraphFileNode)) +
+                         align8(header.n_operands * sizeof(uint32_t)) +
+                         align8(header.n_inputs * sizeof(uint32_t)) +
+                         align8(header.n_outputs * sizeof(uint32_t)) +
+                         align8(header.strings_size);
+  if (expected_size != size_) {
+    fail("corrupted graph file");
+  }
+  nodes_ = take_section<GraphFileNode>(base, offset, header.n_nodes);
+  operands_ = take_section<uint32_t>(base, offset, header.n_operands);
+  inputs_ = take_section<uint32_t>(base, offset, header.n_inputs);
+  outputs_ = take_section<uint32_t>(base, offset, header.n_outputs);
+  strings_ = reinterpret_cast<const char*>(base + offset);
+
+  // from here on the accessors need no bounds check
+  if (header.strings_size > 0 && strings_[header.strings_size - 1] != '\0') {
+    fail("corrupted graph file");
+  }
+  for (size_t i = 0; i < nodes_.size(); ++i) {
+    const auto& node = nodes_[i];
+    if (node.kind == static_cast<uint32_t>(OpKind::NIL) ||
+        node.kind > static_cast<uint32_t>(OpKind::PARAM) ||
+        static_cast<uint64_t>(node.first_arg) + node.n_args > operands_.size()) {
+      fail(std::format("corrupted node {}", i));
+    }
+    if (auto n_args = arity(kind(i)); n_args.has_value() && node.n_args != *n_args) {
+      fail(std::format("node {} has {} operands, but {} takes {}", i, node.n_args,
+                       to_string(kind(i)), *n_args));
+    }
+    if (kind(i) == OpKind::EXTCALL && node.ext_func_name >= header.strings_size) {
+      fail(std::format("corrupted node {}", i));
+    }
+    for (auto arg : args(i)) {
+      if (arg >= i) {
+        fail(std::format("node {} refers to a later node", i));
+      }
+    }
+  }
+  for (auto indices : {inputs_, outputs_}) {
+    for (auto index : indices) {
+      if (index >= nodes_.size()) {
+        fail("corrupted input or output");
+      }
+    }
+  }
+}
+
+GraphView::~GraphView() {
+  munmap(mem_, size_);
+}
+
+OperationGraph GraphView::to_operations() const {
+  std::vector<Operation::Ptr> ops(nodes_.size());
+  for (size_t i = 0; i < nodes_.size(); ++i) {
+    const auto& node = nodes_[i];
+    switch (kind(i)) {
+      case OpKind::ZERO:
+        ops[i] = Operation::make_zero();
+        break;
+      case OpKind::ONE:
+        ops[i] = Operation::make_one();
+        break;
+      case OpKind::CONSTANT:
+        ops[i] = Operation::make_constant(node.constant_value);
+        break;
+      case OpKind::PARAM:
+        ops[i] = Operation::make_param(node.param_index);
+        break;
+      case OpKind::LOAD:
+        ops[i] = Operation::make_var();
+        break;
+      default: {
+        std::vector<Operation::Ptr> op_args;
+        op_args.reserve(node.n_args);
+        for (auto arg : args(i)) {
+          op_args.push_back(ops[arg]);
+        }
+        ops[i] = build_operation(kind(i), std::move(op_args),
+                                 kind(i) == OpKind::EXTCALL ? std::string(ext_func_name(i)) : "");
+        break;
+      }
+    }
+  }
+  OperationGraph graph;
+  for (auto index : inputs_) {
+    graph.inputs.push_back(ops[index]);
+  }
+  for (auto index : outputs_) {
+    graph.outputs.push_back(ops[index]);
+  }
+  return graph;
+}
+
+}  // namespace tenkai
@@ -0,0 +1,231 @@
+#include "kernel_file.hpp"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cstring>
+#include <format>
+#include <fstream>
+#include <stdexcept>
+
+namespace tenkai {
+
+namespace compiler {
+
+namespace {
+
+constexpr char kernel_file_magic[8] = "TENKAIK";
+
+uint32_t supported_isa() {
+  uint32_t isa = 0;
+  if (__builtin_cpu_supports("avx")) {
+    isa |= ISA_AVX;
+  }
+  return isa;
+}
+
+// closes the file descriptor on scope exit
+struct FileDescriptor {
+  int fd;
+  ~FileDescriptor() {
+    if (fd != -1) {
+      close(fd);
+    }
+  }
+};
+
+}  // namespace
+
+void save_kernel(const std::string& path, const std::vector<Operation::Ptr>& inputs,
+                 const std::vector<Operation::Ptr>& outputs, const CompileOptions& options) {
+  // the counters only serve as a placeholder address here, they are registered again on load
+  KernelCounters counters;
+  std::vector<Relocation> relocations;
+  auto code = generate_code(inputs, outputs, options.instrument ? &counters : nullptr,
+                            &relocations, nullptr, &options.layout,
+                            options.machine_model ? &*options.machine_model : nullptr);
+  auto ext_names = ext_func_table(outputs);
+
+  std::string strings = options.name + '\0';
+  for (const auto& name : ext_names) {
+    strings += name + '\0';
+  }
+
+  // the dense layout is recorded without offsets, whichever way it was given
+  IoLayout layout = options.layout.is_dense() ? IoLayout{} : options.layout;
+
+  KernelFileHeader header{};
+  std::memcpy(header.magic, kernel_file_magic, sizeof(header.magic));
+  header.version = kernel_file_version;
+  header.isa = ISA_AVX;
+  header.n_inputs = inputs.size();
+  header.n_outputs = outputs.size();
+  header.n_params = param_count(outputs);
+  header.n_relocations = relocations.size();
+  header.n_input_offsets = layout.input_offsets.size();
+  header.n_output_offsets = layout.output_offsets.size();
+  header.n_ext_funcs = ext_names.size();
+  header.strings_size = strings.size();
+  size_t metadata_size = sizeof(header) + relocations.size() * sizeof(Relocation) +
+                         (layout.input_offsets.size() + layout.output_offsets.size()) *
+                             sizeof(int32_t) +
+                         strings.size();
+  header.code_offset =
+      (metadata_size + kernel_file_page_size - 1) / kernel_file_page_size * kernel_file_page_size;
+  header.code_size = code.size();
+  header.instrumented = options.instrument;
+
+  std::ofstream ofs(path, std::ios::binary | std::ios::trunc);
+  if (!ofs) {
+    throw std::runtime_error(std::format("failed to open {}", path));
+  }
+  ofs.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  ofs.write(reinterpret_cast<const char*>(relocations.data()),
+            relocations.size() * sizeof(Relocation));
+  ofs.write(reinterpret_cast<const char*>(layout.input_offsets.data()),
+            layout.input_offsets.size() * sizeof(int32_t));
+  ofs.write(reinterpret_cast<const char*>(layout.output_offsets.data()),
+            layout.output_offsets.size() * sizeof(int32_t));
+  ofs.write(strings.data(), strings.size());
+  ofs.write(std::string(header.code_offset - metadata_size, '\0').data(),
+            header.code_offset - metadata_size);
+  ofs.write(reinterpret_cast<const char*>(code.data()), code.size());
+  if (!ofs) {
+    throw std::runtime_error(std::format("failed to write {}", path));
+  }
+}
+
+LoadedKernel load_kernel(const std::string& path) {
+  FileDescriptor file{open(path.c_str(), O_RDONLY)};
+  if (file.fd == -1) {
+    throw std::runtime_error(std::format("failed to open {}", path));
+  }
+  struct stat st;
+  if (fstat(file.fd, &st) == -1 || static_cast<size_t>(st.st_size) < sizeof(KernelFileHeader)) {
+    throw std::runtime_error(std::format("{} is not a kernel file", path));
+  }
+  size_t file_size = st.st_size;
+  // private mapping: the relocations are patched in copy-on-write pages
+  void* mem = mmap(nullptr, file_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, file.fd, 0);
+  if (mem == MAP_FAILED) {
+    throw std::runtime_error(std::format("failed to map {}", path));
+  }
+  auto base = static_cast<uint8_t*>(mem);
+  // every error after the mapping goes through fail, which releases what has been acquired
+  uint8_t* mapped = base;
+  size_t mapped_size = file_size;
+  KernelCounters* counters = nullptr;
+  auto fail = [&](const std::string& message) {
+    if (counters != nullptr) {
+      KernelRegistry::instance().remove(counters);
+    }
+    munmap(mapped, mapped_size);
+    throw std::runtime_error(std::format("{}: {}", path, message));
+  };
+
+  KernelFileHeader header;
+  std::memcpy(&header, base, sizeof(header));
+  if (std::memcmp(header.magic, kernel_file_magic, sizeof(header.magic)) != 0) {
+    fail("not a kernel file");
+  }
+  if (header.version != kernel_file_version) {
+    fail(std::format("kernel file version {} is not supported (expected {})", header.version,
+                     kernel_file_version));
+  }
+  if ((header.isa & ~supported_isa()) != 0) {
+    fail("the CPU does not support the instructions of the kernel");
+  }
+  // the counts are bounded first, so that the sizes computed from them do not overflow
+  if (header.n_relocations > file_size || header.n_input_offsets > file_size ||
+      header.n_output_offsets > file_size ||
+      (header.n_input_offsets != 0 && header.n_input_offsets != header.n_inputs) ||
+      (header.n_output_offsets != 0 && header.n_output_offsets != header.n_outputs)) {
+    fail("corrupted kernel file");
+  }
+  size_t offsets_size = (header.n_input_offsets + header.n_output_offsets) * sizeof(int32_t);
+  size_t metadata_size = sizeof(header) + header.n_relocations * sizeof(Relocation) +
+                         offsets_size + header.strings_size;
+  if (metadata_size > header.code_offset || header.code_offset % kernel_file_page_size != 0 ||
+      header.code_offset + header.code_size > file_size) {
+    fail("corrupted kernel file");
+  }
+
+  LoadedKernel kernel;
+  kernel.n_inputs = header.n_inputs;
+  kernel.n_outputs = header.n_outputs;
+  kernel.n_params = header.n_params;
+  auto offsets = base + sizeof(header) + header.n_relocations * sizeof(Relocation);
+  kernel.layout.input_offsets.resize(header.n_input_offsets);
+  kernel.layout.output_offsets.resize(header.n_output_offsets);
+  std::memcpy(kernel.layout.input_offsets.data(), offsets,
+              header.n_input_offsets * sizeof(int32_t));
+  std::memcpy(kernel.layout.output_offsets.data(),
+              offsets + header.n_input_offsets * sizeof(int32_t),
+              header.n_output_offsets * sizeof(int32_t));
+  auto strings = reinterpret_cast<const char*>(offsets + offsets_size);
+  auto strings_end = strings + header.strings_size;
+  if (header.strings_size == 0 || strings_end[-1] != '\0') {
+    fail("corrupted kernel file");
+  }
+  kernel.name = strings;
+  strings += kernel.name.size() + 1;
+  for (size_t i = 0; i < header.n_ext_funcs; ++i) {
+    if (strings >= strings_end) {
+      fail("corrupted kernel file");
+    }
+    kernel.ext_func_names.emplace_back(strings);
+    strings += kernel.ext_func_names.back().size() + 1;
+  }
+
+  // the relocations are all validated before anything is registered or patched
+  std::vector<Relocation> relocations(header.n_relocations);
+  if (header.n_relocations > 0) {
+    std::memcpy(relocations.data(), base + sizeof(header),
+                header.n_relocations * sizeof(Relocation));
+  }
+  for (const auto& relocation : relocations) {
+    if (relocation.offset > header.code_size ||
+        header.code_size - relocation.offset < sizeof(uint64_t)) {
+      fail("corrupted kernel file");
+    }
+    switch (relocation.kind) {
+      case Relocation::Kind::LIBM:
+        if (!is_libm_call(OpKind(relocation.target))) {
+          fail(std::format("relocation to unknown libm function {}", relocation.target));
+        }
+        break;
+      case Relocation::Kind::COUNTERS:
+        if (!header.instrumented) {
+          fail("corrupted kernel file");
+        }
+        break;
+      default:
+        fail("unknown relocation kind");
+    }
+  }
+
+  uint8_t* code = base + header.code_offset;
+  if (header.instrumented) {
+    counters = KernelRegistry::instance().add(kernel.name);
+  }
+  for (const auto& relocation : relocations) {
+    uint64_t address =
+        relocation.kind == Relocation::Kind::LIBM
+            ? reinterpret_cast<uint64_t>(libm_function_address(OpKind(relocation.target)))
+            : reinterpret_cast<uint64_t>(counters);
+    std::memcpy(code + relocation.offset, &address, sizeof(address));
+  }
+
+  // the metadata pages are no longer needed
+  munmap(base, header.code_offset);
+  mapped = code;
+  mapped_size = file_size - header.code_offset;
+  if (mprotect(code, mapped_size, PROT_READ | PROT_EXEC) == -1) {
+    fail("failed to make the code executable");
+  }
+  kernel.func = reinterpret_cast<JitFunc<double>>(code);
+  return kernel;
+}
+
+}  // namespace compiler
+}  // namespace tenkai
@@ -0,0 +1,71 @@
+#include "kernel_library.hpp"
+#include <format>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+namespace tenkai {
+
+namespace {
+
+void write_if_changed(const std::string& path, const std::string& content) {
+  {
+    std::ifstream ifs(path, std::ios::binary);
+    if (ifs && std::string(std::istreambuf_iterator<char>(ifs), {}) == content) {
+      return;
+    }
+  }
+  std::ofstream ofs(path, std::ios::binary | std::ios::trunc);
+  ofs << content;
+  if (!ofs) {
+    throw std::runtime_error(std::format("failed to write {}", path));
+  }
+}
+
+}  // namespace
+
+KernelLibrary::KernelLibrary(std::string name) : name_(std::move(name)) {}
+
+void KernelLibrary::add(const std::string& kernel_name,
+                        const std::vector<Operation::Ptr>& inputs,
+                        const std::vector<Operation::Ptr>& outputs) {
+  // the C symbol carries the name of the library, so that libraries with kernels of the same
+  // name link together
+  auto symbol = std::format("{}_{}", name_, kernel_name);
+  std::stringstream source;
+  flatten(symbol, inputs, outputs, source, "double");
+  source_ += source.str();
+  declarations_ += std::format(
+      "extern \"C\" void {}(const double* input, double* output, void** extfns);\n", symbol);
+
+  header_ += std::format("constexpr size_t {}_n_inputs = {};\n", kernel_name, inputs.size());
+  header_ += std::format("constexpr size_t {}_n_outputs = {};\n", kernel_name, outputs.size());
+  auto ext_names = ext_func_table(outputs);
+  if (!ext_names.empty()) {
+    header_ += std::format("// {} function table:", kernel_name);
+    for (const auto& ext_name : ext_names) {
+      header_ += " " + ext_name;
+    }
+    header_ += "\n";
+  }
+  header_ += std::format("inline constexpr auto& {} = ::{};\n\n", kernel_name, symbol);
+}
+
+void KernelLibrary::write(const std::string& dir) const {
+  auto header = std::format(
+      "// generated by tenkai::KernelLibrary, do not edit\n"
+      "#pragma once\n"
+      "#include <cstddef>\n\n"
+      "{}\n"
+      "namespace {} {{\n\n"
+      "{}"
+      "}}  // namespace {}\n",
+      declarations_, name_, header_, name_);
+  write_if_changed(std::format("{}/{}.hpp", dir, name_), header);
+  write_if_changed(std::format("{}/{}.cpp", dir, name_),
+                   std::format("// generated by tenkai::KernelLibrary, do not edit\n"
+                               "#include \"{}.hpp\"\n{}",
+                               name_, source_));
+}
+
+}  // namespace tenkai
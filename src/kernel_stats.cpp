@@ -0,0 +1,100 @@
+#include "kernel_stats.hpp"
+#include <x86intrin.h>
+#include <chrono>
+#include <thread>
+
+namespace tenkai {
+
+namespace compiler {
+
+double KernelProfile::mean_cycles() const {
+  return calls == 0 ? 0.0 : static_cast<double>(total_cycles) / calls;
+}
+
+uint64_t KernelProfile::quantile_cycles(double q) const {
+  uint64_t count = 0;
+  for (size_t b = 0; b < n_latency_buckets; ++b) {
+    count += histogram[b];
+    if (count > 0 && count >= q * calls) {
+      return b + 1 < n_latency_buckets ? uint64_t(1) << (b + 1) : UINT64_MAX;
+    }
+  }
+  return 0;
+}
+
+KernelRegistry& KernelRegistry::instance() {
+  static KernelRegistry registry;
+  return registry;
+}
+
+KernelCounters* KernelRegistry::add(const std::string& name) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  entries_.push_back(std::make_unique<Entry>());
+  entries_.back()->name = name;
+  return &entries_.back()->counters;
+}
+
+void KernelRegistry::remove(const KernelCounters* counters) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::erase_if(entries_, [counters](const auto& entry) { return &entry->counters == counters; });
+}
+
+namespace {
+
+KernelProfile load_profile(const std::string& name, const KernelCounters& counters) {
+  KernelProfile profile;
+  profile.name = name;
+  profile.total_cycles = counters.total_cycles.load(std::memory_order_relaxed);
+  for (size_t b = 0; b < n_latency_buckets; ++b) {
+    profile.histogram[b] = counters.histogram[b].load(std::memory_order_relaxed);
+    profile.calls += profile.histogram[b];
+  }
+  return profile;
+}
+
+}  // namespace
+
+std::vector<KernelProfile> KernelRegistry::snapshot() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::vector<KernelProfile> profiles;
+  for (const auto& entry : entries_) {
+    profiles.push_back(load_profile(entry->name, entry->counters));
+  }
+  return profiles;
+}
+
+std::vector<KernelProfile> KernelRegistry::find(const std::string& name) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::vector<KernelProfile> profiles;
+  for (const auto& entry : entries_) {
+    if (entry->name == name) {
+      profiles.push_back(load_profile(entry->name, entry->counters));
+    }
+  }
+  return profiles;
+}
+
+void KernelRegistry::reset() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (auto& entry : entries_) {
+    entry->counters.total_cycles = 0;
+    for (auto& bucket : entry->counters.histogram) {
+      bucket = 0;
+    }
+  }
+}
+
+double tsc_cycles_per_ns() {
+  static const double cycles_per_ns = [] {
+    auto start = std::chrono::steady_clock::now();
+    uint64_t tsc_start = __rdtsc();
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    uint64_t tsc_end = __rdtsc();
+    auto end = std::chrono::steady_clock::now();
+    return (tsc_end - tsc_start) / std::chrono::duration<double, std::nano>(end - start).count();
+  }();
+  return cycles_per_ns;
+}
+
+}  // namespace compiler
+}  // namespace tenkai
@@ -0,0 +1,105 @@
+#include "kinematics.hpp"
+#include <stdexcept>
+#include "compile.hpp"
+
+namespace tenkai {
+
+namespace {
+
+SpatialTransform joint_motion(JointType joint_type, Axis axis, const Operation::Ptr& value) {
+  if (joint_type == JointType::REVOLUTE) {
+    switch (axis) {
+      case Axis::X:
+        return SpatialTransform(Matrix::RotX(value), Vector::Zero(3));
+      case Axis::Y:
+        return SpatialTransform(Matrix::RotY(value), Vector::Zero(3));
+      case Axis::Z:
+        return SpatialTransform(Matrix::RotZ(value), Vector::Zero(3));
+    }
+  }
+  auto trans = Vector::Zero(3).elements;
+  trans[static_cast<size_t>(axis)] = value;
+  return SpatialTransform(Matrix::Identity(3), Vector(trans));
+}
+
+}  // namespace
+
+SpatialTransform KinematicTree::make_offset(const std::array<double, 3>& translation,
+                                            const std::array<double, 3>& rpy) {
+  auto rot = Matrix::RotX(Operation::make_canonical_constant(rpy[0])) *
+             Matrix::RotY(Operation::make_canonical_constant(rpy[1])) *
+             Matrix::RotZ(Operation::make_canonical_constant(rpy[2]));
+  auto trans = Vector({Operation::make_canonical_constant(translation[0]),
+                       Operation::make_canonical_constant(translation[1]),
+                       Operation::make_canonical_constant(translation[2])});
+  return SpatialTransform(rot, trans);
+}
+
+size_t KinematicTree::add_link(std::optional<size_t> parent,
+                               JointType joint_type,
+                               Axis axis,
+                               const SpatialTransform& offset) {
+  if (parent.has_value() && *parent >= links.size()) {
+    throw std::runtime_error("parent link must be added before its children");
+  }
+  if (offset.dim != 3) {
+    throw std::runtime_error("offset must be a 3D transform");
+  }
+  links.push_back(Link{parent, joint_type, axis, offset});
+  return links.size() - 1;
+}
+
+size_t KinematicTree::n_joints() const {
+  size_t n = 0;
+  for (const auto& link : links) {
+    if (link.joint_type != JointType::FIXED) {
+      n++;
+    }
+  }
+  return n;
+}
+
+std::vector<SpatialTransform> KinematicTree::link_poses(
+    const std::vector<Operation::Ptr>& joint_values) const {
+  if (joint_values.size() != n_joints()) {
+    throw std::runtime_error("number of joint values must be equal to n_joints()");
+  }
+  std::vector<SpatialTransform> poses;
+  poses.reserve(links.size());
+  size_t joint_idx = 0;
+  for (const auto& link : links) {
+    // compose the offset and the motion first, so that the constant parts are folded
+    auto local = link.offset;
+    if (link.joint_type != JointType::FIXED) {
+      local = local * joint_motion(link.joint_type, link.axis, joint_values[joint_idx++]);
+    }
+    if (link.parent.has_value()) {
+      poses.push_back(poses[*link.parent] * local);
+    } else {
+      poses.push_back(local);
+    }
+  }
+  return poses;
+}
+
+std::vector<Operation::Ptr> KinematicTree::pose_elements(
+    const std::vector<Operation::Ptr>& joint_values) const {
+  std::vector<Operation::Ptr> elements;
+  elements.reserve(12 * links.size());
+  for (const auto& pose : link_poses(joint_values)) {
+    elements.insert(elements.end(), pose.rot.elements.begin(), pose.rot.elements.end());
+    elements.insert(elements.end(), pose.trans.elements.begin(), pose.trans.elements.end());
+  }
+  return elements;
+}
+
+JitFunc<double> KinematicTree::compile(const std::string& backend) const {
+  auto joint_values = Vector::Var(n_joints()).elements;
+  auto outputs = pose_elements(joint_values);
+  if (backend == "native") {
+    return compiler::compile(joint_values, outputs);
+  }
+  return jit_compile<double>(joint_values, outputs, backend);
+}
+
+}  // namespace tenkai
@@ -2,11 +2,16 @@
 
 namespace tenkai {
 
-Vector Vector::Zero(size_t n) {
-  std::vector<Operation::Ptr> elements(n);
-  for (size_t i = 0; i < n; i++) {
-    elements[i] = Operation::make_zero();
+std::vector<bool> structural_nonzeros(const std::vector<Operation::Ptr>& elements) {
+  std::vector<bool> nonzero(elements.size());
+  for (size_t i = 0; i < elements.size(); i++) {
+    nonzero[i] = elements[i]->kind != OpKind::ZERO;
   }
+  return nonzero;
+}
+
+Vector Vector::Zero(size_t n) {
+  std::vector<Operation::Ptr> elements(n, Operation::make_zero());
   return Vector({elements});
 }
 
@@ -53,21 +58,15 @@ Vector Vector::operator+(const Vector& v) {
 Vector Vector::operator*(Operation::Ptr scalar) {
   std::vector<Operation::Ptr> elements(size());
   for (size_t i = 0; i < size(); i++) {
-    elements[i] = elements[i] * scalar;
+    elements[i] = (*this)(i) * scalar;
   }
   return Vector({elements});
 }
 
 Matrix Matrix::Identity(size_t n) {
-  std::vector<Operation::Ptr> elements(n * n);
+  std::vector<Operation::Ptr> elements(n * n, Operation::make_zero());
   for (size_t i = 0; i < n; i++) {
-    for (size_t j = 0; j < n; j++) {
-      if (i == j) {
-        elements[i + j * n] = Operation::make_one();
-      } else {
-        elements[i + j * n] = Operation::make_zero();
-      }
-    }
+    elements[i + i * n] = Operation::make_one();
   }
   return Matrix(elements, n, n);
 }
@@ -126,26 +125,59 @@ Matrix Matrix::Var(size_t n_rows, size_t n_cols) {
 }
 
 Vector Matrix::operator*(const Vector& v) {
-  std::vector<Operation::Ptr> elements(n_rows);
+  std::vector<Operation::Ptr> elements(n_rows, Operation::make_zero());
   for (size_t i = 0; i < n_rows; i++) {
-    Operation::Ptr sum = Operation::make_zero();
+    Operation::Ptr sum = nullptr;
     for (size_t j = 0; j < n_cols; j++) {
-      sum = sum + (*this)(i, j) * v(j);
+      if (!is_nonzero(i, j) || !v.nonzero[j]) {
+        continue;
+      }
+      auto term = (*this)(i, j) * v(j);
+      sum = sum ? sum + term : term;
+    }
+    if (sum) {
+      elements[i] = sum;
     }
-    elements[i] = sum;
   }
   return Vector(elements);
 }
 
 Matrix Matrix::operator*(const Matrix& other) {
-  std::vector<Operation::Ptr> elements(n_rows * other.n_cols);
+  // nonzero patterns of the rows of this and the columns of other. The inner loop walks the
+  // shorter of the two and only visits the terms which are nonzero on both sides
+  std::vector<std::vector<size_t>> row_nonzeros(n_rows);
+  for (size_t k = 0; k < n_cols; k++) {
+    for (size_t i = 0; i < n_rows; i++) {
+      if (is_nonzero(i, k)) {
+        row_nonzeros[i].push_back(k);
+      }
+    }
+  }
+  std::vector<std::vector<size_t>> col_nonzeros(other.n_cols);
+  for (size_t j = 0; j < other.n_cols; j++) {
+    for (size_t k = 0; k < other.n_rows; k++) {
+      if (other.is_nonzero(k, j)) {
+        col_nonzeros[j].push_back(k);
+      }
+    }
+  }
+
+  std::vector<Operation::Ptr> elements(n_rows * other.n_cols, Operation::make_zero());
   for (size_t i = 0; i < n_rows; i++) {
     for (size_t j = 0; j < other.n_cols; j++) {
-      Operation::Ptr sum = Operation::make_zero();
-      for (size_t k = 0; k < n_cols; k++) {
-        sum = sum + (*this)(i, k) * other(k, j);
+      bool walk_row = row_nonzeros[i].size() <= col_nonzeros[j].size();
+      const auto& ks = walk_row ? row_nonzeros[i] : col_nonzeros[j];
+      Operation::Ptr sum = nullptr;
+      for (size_t k : ks) {
+        if (walk_row ? !other.is_nonzero(k, j) : !is_nonzero(i, k)) {
+          continue;
+        }
+        auto term = (*this)(i, k) * other(k, j);
+        sum = sum ? sum + term : term;
+      }
+      if (sum) {
+        elements[i + j * n_rows] = sum;
       }
-      elements[i + j * n_rows] = sum;
     }
   }
   return Matrix(elements, n_rows, other.n_cols);
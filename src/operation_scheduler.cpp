@@ -1,5 +1,8 @@
 #include "operation_scheduler.hpp"
-#include <stack>
+#include <algorithm>
+#include <set>
+#include <tuple>
+#include <unordered_map>
 #include <unordered_set>
 #include "cg.hpp"
 
@@ -10,26 +13,42 @@ namespace compiler {
 std::vector<Operation::Ptr> DepthFirstScheduler::flatten(
     const std::vector<Operation::Ptr>& inputs,
     const std::vector<Operation::Ptr>& outputs) {
-  std::vector<Operation::Ptr> operations;
-
   // Order the operation using depth-first search
   // DFS is better than BFS because the operation is likely to be used immediately
-  // after it is calculated, and will consume less xmm register
-  std::stack<Operation::Ptr> opstack;
-  for (auto& output : outputs) {
-    opstack.push(output);
+  // after it is calculated, and will consume less xmm register.
+  // The operations are emitted in post-order, visiting the operands from the first one,
+  // and common subexpressions (in terms of hash_id) are emitted only once.
+  // Note that a node is marked when emitted rather than when expanded, because the
+  // algebraic hash may give a node the same hash_id as one of its descendants
+  // (e.g. (a + b) - b and a), and then the descendant must be emitted in its place
+  // the stack refers to the shared pointers held by the outputs and the args of the nodes,
+  // so that a pointer is copied (atomic reference counting) only once into the result
+  std::unordered_set<int32_t> emitted;
+  std::vector<Operation::Ptr> result;
+  std::vector<std::pair<const Operation::Ptr*, bool>> opstack;  // (op, is_expanded)
+  for (auto it = outputs.rbegin(); it != outputs.rend(); ++it) {
+    opstack.emplace_back(&*it, false);
   }
   while (!opstack.empty()) {
-    auto op = opstack.top();
-    opstack.pop();
-    operations.push_back(op);
-    for (auto& arg : op->args) {
-      opstack.push(arg);
+    auto [op, is_expanded] = opstack.back();
+    opstack.pop_back();
+    if (emitted.contains((*op)->hash_id)) {
+      continue;
+    }
+    if (is_expanded) {
+      emitted.insert((*op)->hash_id);
+      result.push_back(*op);
+      continue;
+    }
+    opstack.emplace_back(op, true);
+    const auto& args = (*op)->args;
+    for (auto it = args.rbegin(); it != args.rend(); ++it) {
+      if (!emitted.contains((*it)->hash_id)) {
+        opstack.emplace_back(&*it, false);
+      }
     }
   }
 
-  std::unordered_set<int32_t> visited;
-  std::vector<Operation::Ptr> result;
   // The below is commented out because it is rather making the code slower
   // extcall-priotized optimization
   // for (const auto& inp : inputs) {
@@ -43,14 +62,212 @@ std::vector<Operation::Ptr> DepthFirstScheduler::flatten(
   //     }
   //   }
   // }
+  return result;
+}
+
+MachineModel MachineModel::zen4() {
+  MachineModel model;
+  model.add_latency = 3;
+  model.mul_latency = 3;
+  model.div_latency = 13;
+  model.div_throughput = 5;
+  model.issue_width = 6;
+  model.fp_ports = 4;  // two for ADD and two for MUL
+  return model;
+}
+
+namespace {
+
+// values that the register allocator loads into a register where they appear
+bool is_leaf(const Operation& op) {
+  return op.kind == OpKind::LOAD || op.kind == OpKind::PARAM || op.constant_value.has_value();
+}
+
+uint32_t latency_of(const Operation& op, const MachineModel& model) {
+  switch (op.kind) {
+    case OpKind::ADD:
+    case OpKind::SUB:
+    case OpKind::NEGATE:
+      return model.add_latency;
+    case OpKind::MUL:
+      return model.mul_latency;
+    case OpKind::DIV:
+    case OpKind::SQRT:
+      return model.div_latency;
+    default:
+      return is_call(op.kind) ? model.call_latency : 0;
+  }
+}
+
+}  // namespace
+
+std::vector<Operation::Ptr> ListScheduler::flatten(const std::vector<Operation::Ptr>& inputs,
+                                                   const std::vector<Operation::Ptr>& outputs) {
+  // the depth-first order resolves the common subexpressions (including a node that has the
+  // hash_id of one of its descendants), and is the tie-breaker that keeps chains together
+  const auto opseq = DepthFirstScheduler().flatten(inputs, outputs);
+  const size_t n = opseq.size();
+  std::unordered_map<int32_t, size_t> index_of;
+  for (size_t i = 0; i < n; ++i) {
+    index_of[opseq[i]->hash_id] = i;
+  }
+  std::vector<std::vector<size_t>> preds(n);  // distinct operands
+  std::vector<std::vector<size_t>> succs(n);
+  for (size_t i = 0; i < n; ++i) {
+    for (const auto& arg : opseq[i]->args) {
+      size_t j = index_of.at(arg->hash_id);
+      if (std::find(preds[i].begin(), preds[i].end(), j) == preds[i].end()) {
+        preds[i].push_back(j);
+        succs[j].push_back(i);
+      }
+    }
+  }
+
+  // priority: longest latency path to an output. The depth-first order is topological
+  std::vector<uint32_t> latency(n);
+  std::vector<uint64_t> priority(n, 0);
+  for (size_t i = n; i-- > 0;) {
+    latency[i] = latency_of(*opseq[i], model_);
+    uint64_t tail = 0;
+    for (auto s : succs[i]) {
+      tail = std::max(tail, priority[s]);
+    }
+    priority[i] = latency[i] + tail;
+  }
+
+  std::vector<size_t> remaining_uses(n);
+  std::vector<size_t> waiting_operands(n, 0);  // operands that are not leaves nor issued
+  std::set<size_t> ready;
+  for (size_t i = 0; i < n; ++i) {
+    remaining_uses[i] = succs[i].size();
+    if (is_leaf(*opseq[i])) {
+      continue;
+    }
+    for (auto p : preds[i]) {
+      waiting_operands[i] += is_leaf(*opseq[p]) ? 0 : 1;
+    }
+    if (waiting_operands[i] == 0) {
+      ready.insert(i);
+    }
+  }
+
+  std::vector<Operation::Ptr> result;
+  result.reserve(n);
+  std::vector<bool> emitted(n, false);
+  std::vector<uint64_t> result_ready(n, 0);  // cycle at which the value can be used
+  size_t n_live = 0;                         // emitted values with remaining uses
+  uint64_t cycle = 0;
+  uint32_t n_issued = 0;     // in this cycle
+  uint32_t n_fp_issued = 0;  // in this cycle
+  uint64_t divider_free = 0;
 
-  // Do common subexpression elimination
-  for (auto it = operations.rbegin(); it != operations.rend(); ++it) {
-    if (visited.find((*it)->hash_id) != visited.end()) {
+  auto is_fp = [](OpKind kind) {
+    return kind == OpKind::ADD || kind == OpKind::SUB || kind == OpKind::MUL ||
+           kind == OpKind::NEGATE;
+  };
+  auto is_div = [](OpKind kind) { return kind == OpKind::DIV || kind == OpKind::SQRT; };
+  auto start_cycle = [&](size_t i) {
+    uint64_t start = cycle;
+    for (auto p : preds[i]) {
+      start = std::max(start, result_ready[p]);
+    }
+    OpKind kind = opseq[i]->kind;
+    if (is_fp(kind) && start == cycle && n_fp_issued == model_.fp_ports) {
+      start = cycle + 1;
+    }
+    if (is_div(kind)) {
+      start = std::max(start, divider_free);
+    }
+    return start;
+  };
+  // change of n_live by issuing i
+  auto live_delta = [&](size_t i) {
+    int64_t delta = remaining_uses[i] > 0 ? 1 : 0;
+    for (auto p : preds[i]) {
+      if (!emitted[p] && remaining_uses[p] > 1) {
+        delta += 1;  // leaf loaded here and kept for its other uses
+      } else if (emitted[p] && remaining_uses[p] == 1) {
+        delta -= 1;
+      }
+    }
+    return delta;
+  };
+  auto emit = [&](size_t i) {
+    emitted[i] = true;
+    result.push_back(opseq[i]);
+    if (remaining_uses[i] > 0) {
+      n_live++;
+    }
+  };
+
+  while (!ready.empty()) {
+    bool over_budget = n_live >= model_.register_budget;
+    size_t best = n;
+    std::tuple<int64_t, bool, uint64_t, int64_t> best_key;
+    size_t n_considered = 0;
+    for (auto it = ready.begin(); it != ready.end() && n_considered < model_.lookahead;
+         ++it, ++n_considered) {
+      size_t i = *it;
+      // calls go first, while few values are live, as the values live across a call are
+      // spilled. They also hide the latencies of the operations in flight
+      std::tuple<int64_t, bool, uint64_t, int64_t> key{
+          over_budget ? live_delta(i) : 0, !is_call(opseq[i]->kind), start_cycle(i) - cycle,
+          -static_cast<int64_t>(priority[i])};
+      if (best == n || key < best_key) {  // ties go to the earliest in depth-first order
+        best = i;
+        best_key = key;
+      }
+    }
+    ready.erase(best);
+
+    uint64_t start = start_cycle(best);
+    for (auto p : preds[best]) {
+      if (!emitted[p]) {
+        emit(p);
+      }
+    }
+    emit(best);
+    for (auto p : preds[best]) {
+      if (--remaining_uses[p] == 0) {
+        n_live--;
+      }
+    }
+    for (auto s : succs[best]) {
+      if (--waiting_operands[s] == 0) {
+        ready.insert(s);
+      }
+    }
+
+    OpKind kind = opseq[best]->kind;
+    if (start > cycle) {
+      cycle = start;
+      n_issued = 0;
+      n_fp_issued = 0;
+    }
+    if (is_call(kind)) {
+      // the core executes the callee meanwhile
+      cycle = start + latency[best];
+      n_issued = 0;
+      n_fp_issued = 0;
+      result_ready[best] = cycle;
       continue;
     }
-    visited.insert((*it)->hash_id);
-    result.push_back(*it);
+    result_ready[best] = start + latency[best];
+    n_fp_issued += is_fp(kind) ? 1 : 0;
+    if (is_div(kind)) {
+      divider_free = start + model_.div_throughput;
+    }
+    if (++n_issued == model_.issue_width) {
+      cycle++;
+      n_issued = 0;
+      n_fp_issued = 0;
+    }
+  }
+  // outputs that are leaves and have no other use
+  for (size_t i = 0; i < n; ++i) {
+    if (!emitted[i]) {
+      result.push_back(opseq[i]);
+    }
   }
   return result;
 }
@@ -0,0 +1,149 @@
+#include "perf_map.hpp"
+#include <elf.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <format>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+namespace tenkai {
+
+namespace compiler {
+
+namespace {
+
+// see tools/perf/Documentation/jitdump-specification.txt in the linux source tree
+constexpr uint32_t jitdump_magic = 0x4A695444;  // "JiTD"
+constexpr uint32_t jitdump_version = 1;
+constexpr uint32_t jit_code_load = 0;
+
+struct JitdumpFileHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t total_size;
+  uint32_t elf_mach;
+  uint32_t pad1;
+  uint32_t pid;
+  uint64_t timestamp;
+  uint64_t flags;
+};
+
+struct JitdumpRecordHeader {
+  uint32_t id;
+  uint32_t total_size;
+  uint64_t timestamp;
+};
+
+struct JitdumpCodeLoad {
+  JitdumpRecordHeader header;
+  uint32_t pid;
+  uint32_t tid;
+  uint64_t vma;
+  uint64_t code_addr;
+  uint64_t code_size;
+  uint64_t code_index;
+  // followed by the null-terminated name and the code bytes
+};
+
+// perf record -k mono uses the same clock
+uint64_t monotonic_timestamp() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+// files are opened on first use and reopened in a forked child, as they are named by pid
+std::mutex perf_file_mutex;
+
+FILE* perf_map_file() {
+  static FILE* file = nullptr;
+  static pid_t file_pid = 0;
+  if (file == nullptr || file_pid != getpid()) {
+    file_pid = getpid();
+    file = std::fopen(std::format("/tmp/perf-{}.map", file_pid).c_str(), "a");
+    if (file == nullptr) {
+      throw std::runtime_error("failed to open perf map file");
+    }
+  }
+  return file;
+}
+
+struct Jitdump {
+  int fd = -1;
+  pid_t pid = 0;
+  uint64_t code_index = 0;
+};
+
+Jitdump& jitdump_file() {
+  static Jitdump jitdump;
+  if (jitdump.fd != -1 && jitdump.pid == getpid()) {
+    return jitdump;
+  }
+  jitdump.pid = getpid();
+  jitdump.code_index = 0;
+  auto path = std::format("/tmp/jit-{}.dump", jitdump.pid);
+  jitdump.fd = open(path.c_str(), O_CREAT | O_TRUNC | O_RDWR, 0666);
+  if (jitdump.fd == -1) {
+    throw std::runtime_error("failed to open jitdump file");
+  }
+  // perf finds the dump file through this executable mapping of it
+  void* marker = mmap(nullptr, sysconf(_SC_PAGESIZE), PROT_READ | PROT_EXEC, MAP_PRIVATE,
+                      jitdump.fd, 0);
+  if (marker == MAP_FAILED) {
+    throw std::runtime_error("failed to map jitdump file");
+  }
+  JitdumpFileHeader header{jitdump_magic,
+                           jitdump_version,
+                           sizeof(JitdumpFileHeader),
+                           EM_X86_64,
+                           0,
+                           static_cast<uint32_t>(jitdump.pid),
+                           monotonic_timestamp(),
+                           0};
+  if (write(jitdump.fd, &header, sizeof(header)) != sizeof(header)) {
+    throw std::runtime_error("failed to write jitdump header");
+  }
+  return jitdump;
+}
+
+}  // namespace
+
+void write_perf_map_entry(const void* code, size_t code_size, const std::string& name) {
+  std::lock_guard<std::mutex> lock(perf_file_mutex);
+  auto file = perf_map_file();
+  std::fprintf(file, "%lx %zx %s\n", reinterpret_cast<uintptr_t>(code), code_size, name.c_str());
+  std::fflush(file);
+}
+
+void write_jitdump_entry(const void* code, size_t code_size, const std::string& name) {
+  std::lock_guard<std::mutex> lock(perf_file_mutex);
+  auto& jitdump = jitdump_file();
+  auto addr = reinterpret_cast<uint64_t>(code);
+  JitdumpCodeLoad record{
+      {jit_code_load,
+       static_cast<uint32_t>(sizeof(JitdumpCodeLoad) + name.size() + 1 + code_size),
+       monotonic_timestamp()},
+      static_cast<uint32_t>(jitdump.pid),
+      static_cast<uint32_t>(syscall(SYS_gettid)),
+      addr,
+      addr,
+      code_size,
+      jitdump.code_index++};
+  std::vector<uint8_t> buffer(record.header.total_size);
+  std::memcpy(buffer.data(), &record, sizeof(record));
+  std::memcpy(buffer.data() + sizeof(record), name.c_str(), name.size() + 1);
+  std::memcpy(buffer.data() + sizeof(record) + name.size() + 1, code, code_size);
+  if (write(jitdump.fd, buffer.data(), buffer.size()) != static_cast<ssize_t>(buffer.size())) {
+    throw std::runtime_error("failed to write jitdump record");
+  }
+}
+
+}  // namespace compiler
+}  // namespace tenkai
@@ -0,0 +1,90 @@
+#include "random_graph.hpp"
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <stdexcept>
+
+namespace tenkai {
+
+double random_graph_ext_func(double x, double y) {
+  // bounded so that long chains of calls stay finite
+  return std::tanh(x) * std::cos(y);
+}
+
+RandomGraph make_random_graph(const RandomGraphConfig& config) {
+  if (config.n_inputs == 0 || config.n_outputs == 0 || config.depth == 0) {
+    throw std::runtime_error("n_inputs, n_outputs and depth must be positive");
+  }
+  if (config.n_nodes < config.depth) {
+    throw std::runtime_error("n_nodes must not be less than depth");
+  }
+
+  std::mt19937_64 gen(config.seed);
+  std::uniform_real_distribution<double> uniform(0.0, 1.0);
+  std::discrete_distribution<int> kind_dist({config.weight_add, config.weight_sub,
+                                             config.weight_mul, config.weight_negate,
+                                             config.weight_sin, config.weight_cos,
+                                             config.weight_extcall});
+
+  RandomGraph graph;
+  for (size_t i = 0; i < config.n_inputs; ++i) {
+    graph.inputs.push_back(Operation::make_var());
+  }
+
+  // all the nodes in creation order. A layer is a range [begin, end) of it
+  std::vector<Operation::Ptr> nodes = graph.inputs;
+  size_t prev_begin = 0;
+  size_t prev_end = nodes.size();
+  auto pick_operand = [&]() -> Operation::Ptr {
+    if (uniform(gen) < config.sharing) {
+      return nodes[std::uniform_int_distribution<size_t>(0, prev_end - 1)(gen)];
+    }
+    return nodes[std::uniform_int_distribution<size_t>(prev_begin, prev_end - 1)(gen)];
+  };
+
+  for (size_t layer = 0; layer < config.depth; ++layer) {
+    size_t layer_size = config.n_nodes / config.depth + (layer < config.n_nodes % config.depth);
+    for (size_t i = 0; i < layer_size; ++i) {
+      // operands are drawn before building the node, as the evaluation order of function
+      // arguments is unspecified
+      int kind = kind_dist(gen);
+      auto lhs = pick_operand();
+      auto rhs = pick_operand();
+      Operation::Ptr op;
+      switch (kind) {
+        case 0:
+          op = lhs + rhs;
+          break;
+        case 1:
+          op = lhs - rhs;
+          break;
+        case 2:
+          op = lhs * rhs;
+          break;
+        case 3:
+          op = -lhs;
+          break;
+        case 4:
+          op = sin(lhs);
+          break;
+        case 5:
+          op = cos(lhs);
+          break;
+        default:
+          op = Operation::make_ext_func(std::string(random_graph_ext_func_name), {lhs, rhs});
+          break;
+      }
+      nodes.push_back(op);
+    }
+    prev_begin = prev_end;
+    prev_end = nodes.size();
+  }
+
+  for (size_t i = 0; i < config.n_outputs; ++i) {
+    graph.outputs.push_back(
+        nodes[std::uniform_int_distribution<size_t>(prev_begin, prev_end - 1)(gen)]);
+  }
+  return graph;
+}
+
+}  // namespace tenkai
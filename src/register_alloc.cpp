@@ -22,6 +22,12 @@ std::ostream& operator<<(std::ostream& os, const Location& loc) {
     case LocationType::OUTPUT:
       os << std::format("output({})", loc.idx);
       break;
+    case LocationType::OUTGOING:
+      os << std::format("outgoing({})", loc.idx);
+      break;
+    case LocationType::PARAM:
+      os << std::format("param({})", loc.idx);
+      break;
   }
   return os;
 }
@@ -58,9 +64,8 @@ std::ostream& operator<<(std::ostream& os, const Transition& trans) {
   }
 }
 
-// T is temporary. Actuall stack size is determined by the max_stack_usage_
-AllocState::AllocState(const std::vector<Operation::Ptr>& inputs, size_t T, size_t n_xmm)
-    : xmm_usages_(n_xmm, std::nullopt), stack_usages_(T, std::nullopt) {
+AllocState::AllocState(const std::vector<Operation::Ptr>& inputs, size_t n_xmm)
+    : xmm_usages_(n_xmm, std::nullopt) {
   for (size_t i = 0; i < inputs.size(); ++i) {
     auto& op = inputs[i];
     if (op->kind != OpKind::LOAD) {
@@ -79,11 +84,31 @@ std::optional<size_t> AllocState::get_available_xmm() const {
 }
 
 size_t AllocState::get_available_stack() const {
-  auto it = std::find(stack_usages_.begin(), stack_usages_.end(), std::nullopt);
-  if (it == stack_usages_.end()) {
-    throw std::runtime_error("stack is full");
+  // the lowest free slot, or a new slot if all of them are in use
+  if (!free_stacks_.empty()) {
+    return free_stacks_.top();
+  }
+  return stack_usages_.size();
+}
+
+void AllocState::occupy_stack(size_t idx, HashType hash_id) {
+  if (idx != get_available_stack()) {
+    throw std::runtime_error("stack slot must be taken from get_available_stack");
+  }
+  if (idx == stack_usages_.size()) {
+    stack_usages_.push_back(hash_id);
+  } else {
+    free_stacks_.pop();
+    stack_usages_[idx] = hash_id;
+  }
+  max_stack_usage_ = std::max(max_stack_usage_, stack_usages_.size());
+}
+
+void AllocState::release_stack(size_t idx) {
+  if (stack_usages_[idx].has_value()) {
+    stack_usages_[idx].reset();
+    free_stacks_.push(idx);
   }
-  return std::distance(stack_usages_.begin(), it);
 }
 
 std::vector<std::unordered_set<HashType>> compute_disappear_hashid_table(
@@ -119,17 +144,22 @@ std::vector<TransitionSet> RegisterAllocator::allocate() {
   for (size_t t = 0; t < opseq_.size(); ++t) {
     auto& op = opseq_[t];
 
-    if (op->kind == OpKind::LOAD || op->kind == OpKind::CONSTANT) {
+    // ZERO and ONE are treated as the same as CONSTANT
+    bool is_constant = op->constant_value.has_value();
+    bool is_load = op->kind == OpKind::LOAD || op->kind == OpKind::PARAM;
+    if (is_load || is_constant) {
       std::variant<double, Location> loc_src;  // double for constant
 
       if (op->kind == OpKind::LOAD) {
         // determine source location
-        auto it_inp_idx = std::find_if(
-            inputs_.begin(), inputs_.end(),
-            [op](const Operation::Ptr& input) { return input->hash_id == op->hash_id; });
-        auto inp_idx = std::distance(inputs_.begin(), it_inp_idx);
-        loc_src = Location{LocationType::INPUT, inp_idx};
-      } else if (op->kind == OpKind::CONSTANT) {
+        auto it_inp_idx = input_indices_.find(op->hash_id);
+        if (it_inp_idx == input_indices_.end()) {
+          throw std::runtime_error("variable is not included in the inputs");
+        }
+        loc_src = Location{LocationType::INPUT, it_inp_idx->second};
+      } else if (op->kind == OpKind::PARAM) {
+        loc_src = Location{LocationType::PARAM, op->param_index.value()};
+      } else if (is_constant) {
         loc_src = op->constant_value.value();
       }
 
@@ -145,46 +175,35 @@ std::vector<TransitionSet> RegisterAllocator::allocate() {
       alloc_state_.locations_[op->hash_id] = loc_dst;
 
       // record
-      if (op->kind == OpKind::LOAD) {
+      if (is_load) {
         transition_sets_[t].emplace_back(
             RawTransition{op->hash_id, std::get<Location>(loc_src), loc_dst});
-      } else if (op->kind == OpKind::CONSTANT) {
+      } else if (is_constant) {
         transition_sets_[t].emplace_back(
             ConstantSubstitution{op->hash_id, std::get<double>(loc_src), loc_dst});
       }
-    } else if (op->kind == OpKind::SIN ||
-               op->kind == OpKind::COS) {  // when calling exeternal functions
-      // in this case we must move the operands to xmm0 and stash all the xmm registers to stack
-      // and the result will be stored in xmm0
-      if (op->args.size() != 1) {
-        throw std::runtime_error("SIN or COS must have only one operand");
-      }
-      const auto& opr_loc_now = alloc_state_.locations_[op->args[0]->hash_id];
-      prepare_value_on_xmm(op->args[0]->hash_id, 0);
-
-      // following x86-64 nasm calling convention
-      for (size_t i = 0; i < alloc_state_.xmm_usages_.size(); ++i) {
-        if (alloc_state_.xmm_usages_[i] != std::nullopt) {
-          spill_xmm(i);
+      store_if_output(op, loc_dst);
+      release_if_unused(op);
+    } else if (is_call(op->kind)) {
+      allocate_call(op);
+    } else {
+      // registers holding operands must not be spilled while preparing the other operands
+      std::vector<size_t> pinned_xmms;
+      for (auto& operand : op->args) {
+        const auto& op_loc_now = alloc_state_.locations_[operand->hash_id];
+        if (op_loc_now.type == LocationType::REGISTER) {
+          pinned_xmms.push_back(op_loc_now.idx);
         }
       }
-
-      auto loc_dst = Location{LocationType::REGISTER, 0};
-      // update alloc_state_
-      alloc_state_.xmm_usages_[0] = op->hash_id;
-      alloc_state_.locations_[op->hash_id] = loc_dst;
-
-      // record
-      transition_sets_[t_].emplace_back(OpTransition{op->hash_id, {}, loc_dst});
-    } else {
       for (auto& operand : op->args) {
         const auto& op_loc_now = alloc_state_.locations_[operand->hash_id];
         if (op_loc_now.type != LocationType::REGISTER) {
           std::optional<size_t> xmm_idx = alloc_state_.get_available_xmm();
           if (xmm_idx == std::nullopt) {
-            xmm_idx = determine_spill_xmm();
+            xmm_idx = determine_spill_xmm(pinned_xmms);
           }
           prepare_value_on_xmm(operand->hash_id, *xmm_idx);
+          pinned_xmms.push_back(*xmm_idx);
         }
       }
 
@@ -199,22 +218,7 @@ std::vector<TransitionSet> RegisterAllocator::allocate() {
         xmms_src.push_back(temp_xmm_idx_);
       }
 
-      // untrack the hashids that will disappear
-      // and free the registers and stack locations
-      const auto& disappear_hash_ids = disappear_hashid_table_[t];
-      for (auto hash_id : disappear_hash_ids) {
-        auto& loc = alloc_state_.locations_[hash_id];
-        if (loc.type == LocationType::REGISTER) {
-          auto xmm_idx = loc.idx;
-          alloc_state_.xmm_usages_[xmm_idx].reset();
-          alloc_state_.locations_.erase(hash_id);
-        } else if (loc.type == LocationType::STACK) {
-          auto stack_idx = loc.idx;
-          alloc_state_.stack_usages_[stack_idx].reset();
-          alloc_state_.locations_.erase(hash_id);
-        } else {
-        }
-      }
+      release_disappearing_values();
 
       // now allocate the result! (same as above)
       std::optional<size_t> result_xmm_idx = alloc_state_.get_available_xmm();
@@ -230,34 +234,175 @@ std::vector<TransitionSet> RegisterAllocator::allocate() {
       // record
       transition_sets_[t_].push_back(OpTransition{op->hash_id, xmms_src, loc_dst});
 
-      // if the result will be output, then copy it to the output location
-      // find output index
-      auto it_out_idx = std::find_if(
-          outputs_.begin(), outputs_.end(),
-          [op](const Operation::Ptr& output) { return output->hash_id == op->hash_id; });
-      if (it_out_idx != outputs_.end()) {
-        auto out_idx = std::distance(outputs_.begin(), it_out_idx);
-        Location loc_src = loc_dst;
-        Location loc_dst{LocationType::OUTPUT, out_idx};
-        transition_sets_[t_].emplace_back(RawTransition{op->hash_id, loc_src, loc_dst});
-        // bit strange but update alloc_state_ is not needed
-        // as it will anyway treated as disappeared in the next step
-      }
+      store_if_output(op, loc_dst);
+      release_if_unused(op);
     }
     step();
   }
   return transition_sets_;
 }
 
+void RegisterAllocator::allocate_call(const Operation::Ptr& op) {
+  // following x86-64 System V calling convention, all the xmm registers are caller-saved.
+  // Remember where the operands are now, because spilling does not destroy the
+  // register contents and reading them from register is cheaper
+  std::vector<std::pair<HashType, Location>> args;
+  for (const auto& arg : op->args) {
+    args.emplace_back(arg->hash_id, alloc_state_.locations_.at(arg->hash_id));
+  }
+
+  // stash only the values that are still needed after the call.
+  // values whose last use is this call are just released after marshalling
+  for (size_t i = 0; i < alloc_state_.xmm_usages_.size(); ++i) {
+    const auto& hash_id = alloc_state_.xmm_usages_[i];
+    if (hash_id != std::nullopt && live_ranges_.at(*hash_id).disappear > t_) {
+      spill_xmm(i);
+    }
+  }
+  marshal_call_arguments(args);
+  release_disappearing_values();
+
+  // the result will be stored in xmm0
+  auto loc_dst = Location{LocationType::REGISTER, 0};
+  alloc_state_.xmm_usages_[0] = op->hash_id;
+  alloc_state_.locations_[op->hash_id] = loc_dst;
+
+  // record
+  transition_sets_[t_].emplace_back(OpTransition{op->hash_id, {}, loc_dst});
+  store_if_output(op, loc_dst);
+  release_if_unused(op);
+}
+
+void RegisterAllocator::marshal_call_arguments(
+    const std::vector<std::pair<HashType, Location>>& args) {
+  constexpr size_t n_xmm_args = 8;  // xmm0-xmm7
+  auto temp = Location{LocationType::REGISTER, temp_xmm_idx_};
+
+  // arguments passed on the stack first, as they do not clobber any register except temp
+  for (size_t i = n_xmm_args; i < args.size(); ++i) {
+    auto [hash_id, src] = args[i];
+    auto dst = Location{LocationType::OUTGOING, i - n_xmm_args};
+    if (src.type != LocationType::REGISTER) {
+      transition_sets_[t_].emplace_back(RawTransition{hash_id, src, temp});
+      src = temp;
+    }
+    transition_sets_[t_].emplace_back(RawTransition{hash_id, src, dst});
+    alloc_state_.max_outgoing_usage_ =
+        std::max(alloc_state_.max_outgoing_usage_, i - n_xmm_args + 1);
+  }
+
+  // then the register arguments, which is a parallel move. A move is emitted only if its
+  // destination is not read by other pending moves, and cycles are broken by temp
+  struct Move {
+    HashType hash_id;
+    Location src;
+    size_t dst;
+  };
+  std::vector<Move> pending;
+  for (size_t i = 0; i < std::min(args.size(), n_xmm_args); ++i) {
+    const auto& [hash_id, src] = args[i];
+    if (!(src.type == LocationType::REGISTER && src.idx == i)) {
+      pending.push_back({hash_id, src, i});
+    }
+  }
+  auto is_read_by_pending = [&pending](size_t xmm_idx) {
+    return std::any_of(pending.begin(), pending.end(), [xmm_idx](const Move& m) {
+      return m.src.type == LocationType::REGISTER && m.src.idx == xmm_idx;
+    });
+  };
+  while (!pending.empty()) {
+    auto it = std::find_if(pending.begin(), pending.end(), [&](const Move& m) {
+      return !is_read_by_pending(m.dst);
+    });
+    if (it == pending.end()) {
+      // cycle: evacuate the destination of the first move to temp
+      size_t xmm_idx = pending.front().dst;
+      auto reader = std::find_if(pending.begin(), pending.end(), [xmm_idx](const Move& m) {
+        return m.src.type == LocationType::REGISTER && m.src.idx == xmm_idx;
+      });
+      transition_sets_[t_].emplace_back(
+          RawTransition{reader->hash_id, Location{LocationType::REGISTER, xmm_idx}, temp});
+      for (auto& m : pending) {
+        if (m.src.type == LocationType::REGISTER && m.src.idx == xmm_idx) {
+          m.src = temp;
+        }
+      }
+      continue;
+    }
+    transition_sets_[t_].emplace_back(
+        RawTransition{it->hash_id, it->src, Location{LocationType::REGISTER, it->dst}});
+    pending.erase(it);
+  }
+}
+
+void RegisterAllocator::release_if_unused(const Operation::Ptr& op) {
+  // value that no one uses (only outputs) need not occupy the register
+  if (live_ranges_.at(op->hash_id).disappear != std::numeric_limits<size_t>::max()) {
+    return;
+  }
+  const auto& loc = alloc_state_.locations_[op->hash_id];
+  if (loc.type == LocationType::REGISTER) {
+    alloc_state_.xmm_usages_[loc.idx].reset();
+    alloc_state_.locations_.erase(op->hash_id);
+  }
+}
+
+void RegisterAllocator::release_disappearing_values() {
+  // untrack the hashids that will disappear
+  // and free the registers and stack locations
+  const auto& disappear_hash_ids = disappear_hashid_table_[t_];
+  for (auto hash_id : disappear_hash_ids) {
+    auto& loc = alloc_state_.locations_[hash_id];
+    if (loc.type == LocationType::REGISTER) {
+      auto xmm_idx = loc.idx;
+      alloc_state_.xmm_usages_[xmm_idx].reset();
+      alloc_state_.locations_.erase(hash_id);
+    } else if (loc.type == LocationType::STACK) {
+      alloc_state_.release_stack(loc.idx);
+      alloc_state_.locations_.erase(hash_id);
+    } else {
+    }
+  }
+}
+
+void RegisterAllocator::store_if_output(const Operation::Ptr& op, const Location& loc_src) {
+  // if the result will be output, then copy it to the output location(s)
+  auto it_output = output_indices_.find(op->hash_id);
+  if (it_output == output_indices_.end()) {
+    return;
+  }
+  for (auto out_idx : it_output->second) {
+    Location loc_dst{LocationType::OUTPUT, out_idx};
+    transition_sets_[t_].emplace_back(RawTransition{op->hash_id, loc_src, loc_dst});
+  }
+  // bit strange but update alloc_state_ is not needed
+  // as it will anyway treated as disappeared in the next step
+}
+
 void RegisterAllocator::spill_xmm(size_t idx) {
   auto hash_id = alloc_state_.xmm_usages_[idx];
   auto loc_src = alloc_state_.locations_[*hash_id];
+
+  // input values and parameters can be reloaded from their buffers, so no need to store them
+  auto it_inp_idx = input_indices_.find(*hash_id);
+  if (it_inp_idx != input_indices_.end()) {
+    alloc_state_.xmm_usages_[idx].reset();
+    alloc_state_.locations_[*hash_id] = Location{LocationType::INPUT, it_inp_idx->second};
+    return;
+  }
+  auto it_param_idx = param_indices_.find(*hash_id);
+  if (it_param_idx != param_indices_.end()) {
+    alloc_state_.xmm_usages_[idx].reset();
+    alloc_state_.locations_[*hash_id] = Location{LocationType::PARAM, it_param_idx->second};
+    return;
+  }
+
   auto stack_idx = alloc_state_.get_available_stack();
   Location loc_dst{LocationType::STACK, stack_idx};
 
   // update alloc_state_
   alloc_state_.xmm_usages_[idx].reset();
-  alloc_state_.stack_usages_[stack_idx] = hash_id;
+  alloc_state_.occupy_stack(stack_idx, *hash_id);
   alloc_state_.locations_[*hash_id] = loc_dst;
 
   // record
@@ -282,8 +427,8 @@ void RegisterAllocator::prepare_value_on_xmm(HashType hash_id, size_t dst_xmm_id
   if (src.type == LocationType::REGISTER) {
     alloc_state_.xmm_usages_[src.idx] = std::nullopt;
   } else if (src.type == LocationType::STACK) {
-    alloc_state_.stack_usages_[src.idx] = std::nullopt;
-  } else {
+    alloc_state_.release_stack(src.idx);
+  } else if (src.type != LocationType::INPUT && src.type != LocationType::PARAM) {
     throw std::runtime_error("unexpected location type");
   }
   alloc_state_.xmm_usages_[dst_xmm_idx] = hash_id;
@@ -299,13 +444,16 @@ size_t RegisterAllocator::spill_and_prepare_xmm() {
   return spill_xmm_idx;
 }
 
-size_t RegisterAllocator::determine_spill_xmm() const {
+size_t RegisterAllocator::determine_spill_xmm(const std::vector<size_t>& pinned_xmms) const {
   size_t max_life_time = 0;
   std::optional<size_t> most_obstructive_xmm_idx;
   for (size_t i = 0; i < alloc_state_.xmm_usages_.size(); ++i) {
     if (alloc_state_.xmm_usages_[i] == std::nullopt) {
       throw std::runtime_error("this should not happen, there is an available xmm register");
     }
+    if (std::find(pinned_xmms.begin(), pinned_xmms.end(), i) != pinned_xmms.end()) {
+      continue;
+    }
     auto hash_id = *alloc_state_.xmm_usages_[i];
     const auto& live_range = live_ranges_.at(hash_id);
     size_t life_time = live_range.disappear - t_;
@@ -0,0 +1,96 @@
+#include "spatial.hpp"
+
+namespace tenkai {
+
+Quaternion Quaternion::Identity() {
+  return Quaternion(Operation::make_one(), Operation::make_zero(), Operation::make_zero(),
+                    Operation::make_zero());
+}
+
+// the sign of half angle is chosen so that RotX(angle).to_matrix() equals Matrix::RotX(angle)
+Quaternion Quaternion::RotX(Operation::Ptr angle) {
+  auto half = angle * Operation::make_constant(-0.5);
+  return Quaternion(cos(half), sin(half), Operation::make_zero(), Operation::make_zero());
+}
+
+Quaternion Quaternion::RotY(Operation::Ptr angle) {
+  auto half = angle * Operation::make_constant(-0.5);
+  return Quaternion(cos(half), Operation::make_zero(), sin(half), Operation::make_zero());
+}
+
+Quaternion Quaternion::RotZ(Operation::Ptr angle) {
+  auto half = angle * Operation::make_constant(-0.5);
+  return Quaternion(cos(half), Operation::make_zero(), Operation::make_zero(), sin(half));
+}
+
+Quaternion Quaternion::FromMatrix(const Matrix& rot) {
+  if (rot.n_rows != 3 || rot.n_cols != 3) {
+    throw std::runtime_error("Matrix must be 3x3");
+  }
+  auto trace = rot(0, 0) + rot(1, 1) + rot(2, 2);
+  auto w = Operation::make_constant(0.5) * sqrt(Operation::make_one() + trace);
+  auto inv_4w = Operation::make_one() / (Operation::make_constant(4.0) * w);
+  return Quaternion(w, (rot(2, 1) - rot(1, 2)) * inv_4w, (rot(0, 2) - rot(2, 0)) * inv_4w,
+                    (rot(1, 0) - rot(0, 1)) * inv_4w);
+}
+
+Quaternion Quaternion::operator*(const Quaternion& o) const {
+  return Quaternion(w * o.w - x * o.x - y * o.y - z * o.z, w * o.x + x * o.w + y * o.z - z * o.y,
+                    w * o.y - x * o.z + y * o.w + z * o.x, w * o.z + x * o.y - y * o.x + z * o.w);
+}
+
+Quaternion Quaternion::conjugate() const {
+  return Quaternion(w, -x, -y, -z);
+}
+
+Vector Quaternion::rotate(const Vector& v) const {
+  // v' = v + w * t + q_vec x t, where t = 2 * (q_vec x v)
+  auto two = Operation::make_constant(2.0);
+  auto tx = two * (y * v(2) - z * v(1));
+  auto ty = two * (z * v(0) - x * v(2));
+  auto tz = two * (x * v(1) - y * v(0));
+  return Vector({v(0) + w * tx + (y * tz - z * ty), v(1) + w * ty + (z * tx - x * tz),
+                 v(2) + w * tz + (x * ty - y * tx)});
+}
+
+Matrix Quaternion::to_matrix() const {
+  auto one = Operation::make_one();
+  auto two = Operation::make_constant(2.0);
+  auto xx = x * x, yy = y * y, zz = z * z;
+  auto xy = x * y, xz = x * z, yz = y * z;
+  auto wx = w * x, wy = w * y, wz = w * z;
+  // column major
+  std::vector<Operation::Ptr> elements = {one - two * (yy + zz), two * (xy + wz), two * (xz - wy),
+                                          two * (xy - wz), one - two * (xx + zz), two * (yz + wx),
+                                          two * (xz + wy), two * (yz - wx), one - two * (xx + yy)};
+  return Matrix(elements, 3, 3);
+}
+
+QuatTransform QuatTransform::FromSpatialTransform(const SpatialTransform& tf) {
+  if (tf.dim != 3) {
+    throw std::runtime_error("SpatialTransform must be 3D");
+  }
+  return QuatTransform(Quaternion::FromMatrix(tf.rot), tf.trans);
+}
+
+QuatTransform QuatTransform::operator*(const QuatTransform& other) const {
+  auto rotated = rot.rotate(other.trans);
+  return QuatTransform(rot * other.rot, rotated + trans);
+}
+
+Vector QuatTransform::operator*(const Vector& v) const {
+  auto rotated = rot.rotate(v);
+  return rotated + trans;
+}
+
+QuatTransform QuatTransform::inverse() const {
+  auto rot_inv = rot.conjugate();
+  auto neg_trans = -Vector(trans);
+  return QuatTransform(rot_inv, rot_inv.rotate(neg_trans));
+}
+
+SpatialTransform QuatTransform::to_spatial_transform() const {
+  return SpatialTransform(rot.to_matrix(), trans);
+}
+
+}  // namespace tenkai
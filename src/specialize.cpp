@@ -0,0 +1,102 @@
+#include "specialize.hpp"
+#include <bit>
+#include <format>
+#include <stdexcept>
+#include <unordered_map>
+#include <unordered_set>
+#include "compile.hpp"
+
+namespace tenkai {
+
+std::vector<Operation::Ptr> specialize(const std::vector<Operation::Ptr>& inputs,
+                                       const std::vector<Operation::Ptr>& outputs,
+                                       const std::map<size_t, double>& fixed) {
+  // nodes are identified by address rather than hash_id, as a node may share the hash_id of
+  // its descendant. A node none of whose operands changed is kept as is
+  std::unordered_map<const Operation*, Operation::Ptr> replaced;
+  for (const auto& [index, value] : fixed) {
+    if (index >= inputs.size()) {
+      throw std::runtime_error(std::format("input {} does not exist", index));
+    }
+    replaced[inputs[index].get()] = Operation::make_canonical_constant(value);
+  }
+
+  std::vector<std::pair<const Operation::Ptr*, bool>> stack;  // (op, is_expanded)
+  for (auto it = outputs.rbegin(); it != outputs.rend(); ++it) {
+    stack.emplace_back(&*it, false);
+  }
+  std::unordered_set<const Operation*> visited;
+  while (!stack.empty()) {
+    auto [op, is_expanded] = stack.back();
+    stack.pop_back();
+    if (!is_expanded) {
+      if (!visited.insert(op->get()).second) {
+        continue;
+      }
+      stack.emplace_back(op, true);
+      for (auto it = (*op)->args.rbegin(); it != (*op)->args.rend(); ++it) {
+        if (!visited.contains(it->get())) {
+          stack.emplace_back(&*it, false);
+        }
+      }
+      continue;
+    }
+    bool changed = false;
+    std::vector<Operation::Ptr> args;
+    args.reserve((*op)->args.size());
+    for (const auto& arg : (*op)->args) {
+      auto it = replaced.find(arg.get());
+      changed |= it != replaced.end();
+      args.push_back(it != replaced.end() ? it->second : arg);
+    }
+    if (changed) {
+      replaced[op->get()] =
+          build_operation((*op)->kind, std::move(args), (*op)->ext_func_name.value_or(""));
+    }
+  }
+
+  std::vector<Operation::Ptr> result;
+  result.reserve(outputs.size());
+  for (const auto& output : outputs) {
+    auto it = replaced.find(output.get());
+    result.push_back(it != replaced.end() ? it->second : output);
+  }
+  return result;
+}
+
+SpecializationCache::SpecializationCache(std::vector<Operation::Ptr> inputs,
+                                         std::vector<Operation::Ptr> outputs,
+                                         size_t capacity)
+    : inputs_(std::move(inputs)), outputs_(std::move(outputs)), capacity_(capacity) {}
+
+JitFunc<double> SpecializationCache::get(const std::map<size_t, double>& fixed) {
+  Key key;
+  key.reserve(fixed.size());
+  for (const auto& [index, value] : fixed) {
+    if (index >= inputs_.size()) {
+      throw std::runtime_error(std::format("input {} does not exist", index));
+    }
+    key.emplace_back(index, std::bit_cast<uint64_t>(value));
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = kernels_.find(key);
+  if (it != kernels_.end()) {
+    return it->second;
+  }
+  if (kernels_.size() >= capacity_) {
+    if (generic_ == nullptr) {
+      generic_ = compiler::compile(inputs_, outputs_);
+    }
+    return generic_;
+  }
+  auto kernel = compiler::compile(inputs_, specialize(inputs_, outputs_, fixed));
+  kernels_.emplace(std::move(key), kernel);
+  return kernel;
+}
+
+size_t SpecializationCache::size() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return kernels_.size();
+}
+
+}  // namespace tenkai
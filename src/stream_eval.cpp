@@ -0,0 +1,176 @@
+#include "stream_eval.hpp"
+#include <fcntl.h>
+#include <immintrin.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <format>
+#include <stdexcept>
+#include <vector>
+
+namespace tenkai {
+
+namespace {
+
+// a read-only or writable shared mapping of a whole file
+class MappedFile {
+ public:
+  MappedFile(const std::string& path, size_t size_to_create) : writable_(true) {
+    fd_ = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd_ == -1) {
+      throw std::runtime_error(std::format("failed to open {}", path));
+    }
+    if (ftruncate(fd_, size_to_create) == -1) {
+      close(fd_);
+      throw std::runtime_error(std::format("failed to resize {}", path));
+    }
+    map(path, size_to_create);
+  }
+  explicit MappedFile(const std::string& path) : writable_(false) {
+    fd_ = open(path.c_str(), O_RDONLY);
+    struct stat st;
+    if (fd_ == -1 || fstat(fd_, &st) == -1) {
+      if (fd_ != -1) {
+        close(fd_);
+      }
+      throw std::runtime_error(std::format("failed to open {}", path));
+    }
+    map(path, st.st_size);
+  }
+  ~MappedFile() {
+    if (data_ != nullptr) {
+      munmap(data_, size_);
+    }
+    close(fd_);
+  }
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  uint8_t* data() const { return data_; }
+  size_t size() const { return size_; }
+  int fd() const { return fd_; }
+
+  // madvise on the pages covering [begin, end), clamped to the file
+  void advise(size_t begin, size_t end, int advice) const {
+    static const size_t page_size = sysconf(_SC_PAGESIZE);
+    begin = begin / page_size * page_size;
+    end = std::min(end, size_);
+    if (data_ != nullptr && begin < end) {
+      madvise(data_ + begin, end - begin, advice);
+    }
+  }
+
+ private:
+  void map(const std::string& path, size_t size) {
+    size_ = size;
+    if (size_ == 0) {
+      return;  // mmap of an empty range fails
+    }
+    int prot = writable_ ? PROT_READ | PROT_WRITE : PROT_READ;
+    void* mem = mmap(nullptr, size_, prot, MAP_SHARED, fd_, 0);
+    if (mem == MAP_FAILED) {
+      close(fd_);
+      throw std::runtime_error(std::format("failed to map {}", path));
+    }
+    data_ = static_cast<uint8_t*>(mem);
+  }
+
+  bool writable_;
+  int fd_ = -1;
+  uint8_t* data_ = nullptr;
+  size_t size_ = 0;
+};
+
+// copies with non-temporal stores, 16 bytes at a time where dst is aligned
+void stream_copy(double* dst, const double* src, size_t n) {
+  size_t i = 0;
+  if (n > 0 && reinterpret_cast<uintptr_t>(dst) % 16 != 0) {
+    _mm_stream_si64(reinterpret_cast<long long*>(dst), std::bit_cast<long long>(src[0]));
+    i = 1;
+  }
+  for (; i + 2 <= n; i += 2) {
+    _mm_stream_pd(dst + i, _mm_loadu_pd(src + i));
+  }
+  if (i < n) {
+    _mm_stream_si64(reinterpret_cast<long long*>(dst + i), std::bit_cast<long long>(src[i]));
+  }
+}
+
+}  // namespace
+
+StreamResult evaluate_stream(JitFunc<double> func,
+                             size_t n_inputs,
+                             size_t n_outputs,
+                             const std::string& input_path,
+                             const std::string& output_path,
+                             void** extfns,
+                             const StreamOptions& options) {
+  if (n_inputs == 0) {
+    throw std::runtime_error("a kernel without inputs has no points to stream");
+  }
+  auto start = std::chrono::steady_clock::now();
+  MappedFile input(input_path);
+  const size_t input_stride = n_inputs * sizeof(double);
+  const size_t output_stride = n_outputs * sizeof(double);
+  if (input.size() % input_stride != 0) {
+    throw std::runtime_error(std::format("size of {} is not a multiple of {} inputs",
+                                         input_path, n_inputs));
+  }
+  const size_t n_points = input.size() / input_stride;
+  MappedFile output(output_path, n_points * output_stride);
+  input.advise(0, input.size(), MADV_SEQUENTIAL);
+
+  auto in = reinterpret_cast<double*>(input.data());
+  auto out = reinterpret_cast<double*>(output.data());
+  const size_t chunk_points = std::max<size_t>(1, options.chunk_size / input_stride);
+  // outputs are staged in a block that stays in L1, then streamed out
+  constexpr size_t block_points = 64;
+  std::vector<double> block(block_points * n_outputs);
+
+  for (size_t begin = 0; begin < n_points; begin += chunk_points) {
+    size_t end = std::min(n_points, begin + chunk_points);
+    // read ahead the next chunk while this one is computed
+    input.advise(end * input_stride, (end + chunk_points) * input_stride, MADV_WILLNEED);
+
+    for (size_t block_begin = begin; block_begin < end; block_begin += block_points) {
+      size_t block_end = std::min(end, block_begin + block_points);
+      for (size_t p = block_begin; p < block_end; ++p) {
+        if (p + options.prefetch_distance < n_points) {
+          _mm_prefetch(reinterpret_cast<const char*>(in + (p + options.prefetch_distance) *
+                                                              n_inputs),
+                       _MM_HINT_T0);
+        }
+        double* dst = options.non_temporal ? block.data() + (p - block_begin) * n_outputs
+                                           : out + p * n_outputs;
+        func(in + p * n_inputs, dst, extfns);
+      }
+      if (options.non_temporal) {
+        stream_copy(out + block_begin * n_outputs, block.data(),
+                    (block_end - block_begin) * n_outputs);
+      }
+    }
+    if (options.non_temporal) {
+      _mm_sfence();
+    }
+
+    // start writing back this chunk, and release the pages of the previous one. Dirty pages
+    // stay in the page cache until they are written, so dropping the mapping loses nothing
+    size_t previous = begin >= chunk_points ? begin - chunk_points : 0;
+    if (n_outputs > 0) {
+      sync_file_range(output.fd(), begin * output_stride, (end - begin) * output_stride,
+                      SYNC_FILE_RANGE_WRITE);
+      output.advise(previous * output_stride, begin * output_stride, MADV_DONTNEED);
+    }
+    input.advise(previous * input_stride, begin * input_stride, MADV_DONTNEED);
+  }
+
+  auto seconds =
+      std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  return {n_points, seconds};
+}
+
+}  // namespace tenkai
@@ -0,0 +1,56 @@
+#include "tiered_kernel.hpp"
+#include "compile.hpp"
+
+namespace tenkai {
+
+TieredKernel::TieredKernel(std::vector<Operation::Ptr> inputs,
+                           std::vector<Operation::Ptr> outputs,
+                           const TieredOptions& options)
+    : inputs_(std::move(inputs)),
+      outputs_(std::move(outputs)),
+      options_(options),
+      func_(compiler::compile(inputs_, outputs_)),
+      tier_(Tier::NATIVE) {}
+
+TieredKernel::~TieredKernel() {
+  wait();
+}
+
+TieredKernel::Tier TieredKernel::tier() const {
+  return tier_.load(std::memory_order_acquire);
+}
+
+void TieredKernel::wait() {
+  std::lock_guard<std::mutex> lock(thread_mutex_);
+  if (compiler_thread_.joinable()) {
+    compiler_thread_.join();
+  }
+}
+
+std::string TieredKernel::error() const {
+  std::lock_guard<std::mutex> lock(error_mutex_);
+  return error_;
+}
+
+void TieredKernel::count_call() {
+  // a plain load and store instead of fetch_add, so that counting costs no locked instruction
+  // on the hot path. Increments lost to a race only delay the promotion
+  auto n = n_calls_.load(std::memory_order_relaxed) + 1;
+  n_calls_.store(n, std::memory_order_relaxed);
+  if (n < options_.promote_after || promotion_started_.exchange(true)) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(thread_mutex_);
+  compiler_thread_ = std::thread([this] {
+    try {
+      auto optimized = jit_compile<double>(inputs_, outputs_, options_.jit);
+      func_.store(optimized, std::memory_order_release);
+      tier_.store(Tier::OPTIMIZED, std::memory_order_release);
+    } catch (const std::exception& e) {
+      std::lock_guard<std::mutex> lock(error_mutex_);
+      error_ = e.what();
+    }
+  });
+}
+
+}  // namespace tenkai
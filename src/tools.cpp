@@ -42,7 +42,7 @@ void write_to_dotfile(const std::vector<Operation::Ptr>& inputs,
     }
     visited.insert(op->hash_id);
 
-    if (op->kind == OpKind::SIN || op->kind == OpKind::COS) {
+    if (is_libm_call(op->kind)) {
       os << std::format("  {} [label={}, color=red, style=filled];\n", get_name(op->hash_id),
                         to_string(op->kind));
     } else {
@@ -0,0 +1,28 @@
+// generator of the test_kernels library (see add_tenkai_kernels in CMakeLists.txt)
+#include <iostream>
+#include "cg.hpp"
+#include "kernel_library.hpp"
+
+using namespace tenkai;
+
+int main(int argc, char** argv) {
+  if (argc != 3) {
+    std::cerr << "usage: " << argv[0] << " <output dir> <library name>" << std::endl;
+    return 1;
+  }
+  KernelLibrary library(argv[2]);
+  {
+    auto r = Operation::make_var();
+    auto theta = Operation::make_var();
+    // outputs that are an input or a constant are also covered
+    library.add("polar_to_cartesian", {r, theta},
+                {r * cos(theta), r * sin(theta), r, Operation::make_constant(2.0)});
+  }
+  {
+    auto x = Operation::make_var();
+    auto y = Operation::make_var();
+    auto ext = Operation::make_ext_func("scale", {x, y});
+    library.add("ext_kernel", {x, y}, {ext * x + Operation::make_one(), sqrt(ext)});
+  }
+  library.write(argv[1]);
+}
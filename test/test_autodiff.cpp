@@ -0,0 +1,180 @@
+#include <gtest/gtest.h>
+#include <cmath>
+#include <unordered_set>
+#include "autodiff.hpp"
+#include "cg.hpp"
+#include "compile.hpp"
+#include "linalg.hpp"
+#include "spatial.hpp"
+
+using namespace tenkai;
+
+size_t count_unique_kind(const std::vector<Operation::Ptr>& outputs, OpKind kind) {
+  std::unordered_set<int32_t> visited;
+  std::vector<Operation::Ptr> stack(outputs.begin(), outputs.end());
+  size_t count = 0;
+  while (!stack.empty()) {
+    auto op = stack.back();
+    stack.pop_back();
+    if (!visited.insert(op->hash_id).second) {
+      continue;
+    }
+    if (op->kind == kind) {
+      count++;
+    }
+    stack.insert(stack.end(), op->args.begin(), op->args.end());
+  }
+  return count;
+}
+
+TEST(AutodiffTest, Gradient) {
+  auto x = Operation::make_var();
+  auto y = Operation::make_var();
+  auto f = sin(x) * y + exp(x / y) - sqrt(x * x + y * y) + atan2(y, x) + pow(x, y) + log(y);
+  auto grad = gradient(f, {x, y});
+  ASSERT_EQ(grad.size(), 2);
+
+  auto fn = compiler::compile({x, y}, {f, grad[0], grad[1]});
+  double input[2] = {0.7, 1.3};
+  double output[3];
+  fn(input, output, nullptr);
+
+  double a = 0.7, b = 1.3;
+  double r = std::sqrt(a * a + b * b);
+  double dfdx = std::cos(a) * b + std::exp(a / b) / b - a / r - b / (r * r) +
+                b * std::pow(a, b - 1);
+  double dfdy = std::sin(a) - std::exp(a / b) * a / (b * b) - b / r + a / (r * r) +
+                std::pow(a, b) * std::log(a) + 1 / b;
+  ASSERT_NEAR(output[1], dfdx, 1e-10);
+  ASSERT_NEAR(output[2], dfdy, 1e-10);
+}
+
+TEST(AutodiffTest, ConstantAndIndependent) {
+  auto x = Operation::make_var();
+  auto y = Operation::make_var();
+  auto z = Operation::make_var();
+  auto f = x * Operation::make_constant(3.0) + y;
+  auto grad = gradient(f, {x, y, z});
+  ASSERT_EQ(grad[0]->kind, OpKind::CONSTANT);
+  ASSERT_EQ(*grad[0]->constant_value, 3.0);
+  ASSERT_EQ(grad[1]->kind, OpKind::ONE);
+  ASSERT_EQ(grad[2]->kind, OpKind::ZERO);
+}
+
+TEST(AutodiffTest, JacobianOfTransformChain) {
+  std::vector<Operation::Ptr> inputs;
+  for (int i = 0; i < 4; i++) {
+    inputs.push_back(Operation::make_var());
+  }
+  auto trans = Vector({Operation::make_constant(0.1), Operation::make_constant(0.2),
+                       Operation::make_constant(0.3)});
+  auto tf1 = SpatialTransform(Matrix::RotX(inputs[0]), trans);
+  auto tf2 = SpatialTransform(Matrix::RotY(inputs[1]), trans);
+  auto tf3 = SpatialTransform(Matrix::RotZ(inputs[2]), trans);
+  auto tf4 = SpatialTransform(Matrix::RotX(inputs[3]), trans);
+  auto tf = tf4 * tf3 * tf2 * tf1;
+  auto values = tf.trans.elements;
+  auto jac = jacobian(values, inputs);
+  ASSERT_EQ(jac.n_rows, 3);
+  ASSERT_EQ(jac.n_cols, 4);
+
+  // derivative rules of sin/cos reuse the existing cos/sin nodes
+  auto fused_outputs = values;
+  fused_outputs.insert(fused_outputs.end(), jac.elements.begin(), jac.elements.end());
+  ASSERT_EQ(count_unique_kind(fused_outputs, OpKind::SIN), count_unique_kind(values, OpKind::SIN));
+  ASSERT_EQ(count_unique_kind(fused_outputs, OpKind::COS), count_unique_kind(values, OpKind::COS));
+
+  auto fn_value = compiler::compile(inputs, values);
+  auto fn_fused = compiler::compile(inputs, fused_outputs);
+  double input[4] = {0.3, -0.4, 1.1, 0.6};
+  double value[3];
+  double fused[3 + 12];
+  fn_value(input, value, nullptr);
+  fn_fused(input, fused, nullptr);
+  for (int i = 0; i < 3; i++) {
+    ASSERT_NEAR(fused[i], value[i], 1e-12);
+  }
+
+  // compare with central finite differences
+  double eps = 1e-6;
+  for (size_t j = 0; j < 4; j++) {
+    double input_plus[4], input_minus[4], value_plus[3], value_minus[3];
+    std::copy(input, input + 4, input_plus);
+    std::copy(input, input + 4, input_minus);
+    input_plus[j] += eps;
+    input_minus[j] -= eps;
+    fn_value(input_plus, value_plus, nullptr);
+    fn_value(input_minus, value_minus, nullptr);
+    for (size_t i = 0; i < 3; i++) {
+      double fd = (value_plus[i] - value_minus[i]) / (2 * eps);
+      ASSERT_NEAR(fused[3 + i + j * 3], fd, 1e-8);
+    }
+  }
+}
+
+TEST(AutodiffTest, JacobianVectorProduct) {
+  std::vector<Operation::Ptr> inputs;
+  for (int i = 0; i < 7; i++) {
+    inputs.push_back(Operation::make_var());
+  }
+  auto& x = inputs;
+  auto trans = Vector({Operation::make_constant(0.1), Operation::make_constant(0.2),
+                       Operation::make_constant(0.3)});
+  auto tf1 = SpatialTransform(Matrix::RotX(x[0]), trans);
+  auto tf2 = SpatialTransform(Matrix::RotY(x[1]), trans);
+  auto tf3 = SpatialTransform(Matrix::RotZ(x[2]), trans);
+  auto tf4 = SpatialTransform(Matrix::RotX(x[3]), trans);
+  auto tf5 = SpatialTransform(Matrix::RotY(x[4]), trans);
+  auto tf6 = SpatialTransform(Matrix::RotZ(x[5]), trans);
+  auto tf7 = SpatialTransform(Matrix::RotX(x[6]), trans);
+  auto tf = tf7 * tf6 * tf5 * tf4 * tf3 * tf2 * tf1;
+  auto values = tf.trans.elements;
+
+  // two seed directions passed as additional inputs
+  size_t n_dirs = 2;
+  std::vector<std::vector<Operation::Ptr>> seeds(n_dirs);
+  auto kernel_inputs = inputs;
+  for (auto& seed : seeds) {
+    seed = Vector::Var(7).elements;
+    kernel_inputs.insert(kernel_inputs.end(), seed.begin(), seed.end());
+  }
+  auto tangents = jvp(values, inputs, seeds);
+  ASSERT_EQ(tangents.size(), n_dirs);
+  auto kernel_outputs = values;
+  for (const auto& tangent : tangents) {
+    ASSERT_EQ(tangent.size(), 3);
+    kernel_outputs.insert(kernel_outputs.end(), tangent.begin(), tangent.end());
+  }
+
+  // reference by jacobian times direction
+  auto jac = jacobian(values, inputs);
+  auto fn_jac = compiler::compile(inputs, jac.elements);
+
+  double input[7 + 14] = {0.3, -0.4, 1.1, 0.6, -1.3, 0.2, 0.9};
+  for (int i = 0; i < 14; i++) {
+    input[7 + i] = 0.1 * (i - 7);
+  }
+  double jac_value[21];
+  fn_jac(input, jac_value, nullptr);
+
+  auto fn_native = compiler::compile(kernel_inputs, kernel_outputs);
+  auto fn_gcc = jit_compile<double>(kernel_inputs, kernel_outputs);
+  for (auto fn : {fn_native, fn_gcc}) {
+    double output[3 + 6];
+    fn(input, output, nullptr);
+    for (size_t k = 0; k < n_dirs; k++) {
+      for (size_t i = 0; i < 3; i++) {
+        double expected = 0.0;
+        for (size_t j = 0; j < 7; j++) {
+          expected += jac_value[i + j * 3] * input[7 + k * 7 + j];
+        }
+        ASSERT_NEAR(output[3 + k * 3 + i], expected, 1e-10);
+      }
+    }
+  }
+}
+
+int main(int argc, char **argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
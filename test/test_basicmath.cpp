@@ -1,4 +1,7 @@
 #include <gtest/gtest.h>
+#include <set>
+#include <stdexcept>
+#include <thread>
 #include "cg.hpp"
 
 TEST(BasicMathTest, ConstantFolding) {
@@ -11,6 +14,64 @@ TEST(BasicMathTest, ConstantFolding) {
   EXPECT_EQ(*d->constant_value, 6.0);
 }
 
+// ids of the variables and of an expression over them, built in a stream of its own
+std::vector<int32_t> build_ids(uint64_t stream) {
+  tenkai::NodeIdStream id_stream(stream);
+  std::vector<int32_t> ids;
+  auto sum = tenkai::Operation::make_constant(0.5);
+  for (int i = 0; i < 100; i++) {
+    auto x = tenkai::Operation::make_var();
+    ids.push_back(x->hash_id);
+    sum = sum + sin(x) * tenkai::Operation::make_constant(i);
+  }
+  ids.push_back(sum->hash_id);
+  return ids;
+}
+
+TEST(BasicMathTest, NodeIds) {
+  // the enclosing stream is resumed after a NodeIdStream
+  auto before = tenkai::Operation::make_var();
+  auto ids = build_ids(3);
+  auto after = tenkai::Operation::make_var();
+  EXPECT_NE(before->hash_id, after->hash_id);
+  // a stream is never reopened, as its nodes may still be alive
+  EXPECT_THROW(build_ids(3), std::runtime_error);
+  EXPECT_THROW(tenkai::NodeIdStream(uint64_t(1) << 63), std::runtime_error);
+
+  // sub-graphs built in parallel, in the default streams and in a stream of their own, get
+  // distinct ids
+  constexpr size_t n_threads = 4;
+  std::vector<std::vector<int32_t>> parallel_ids(2 * n_threads);
+  std::vector<std::thread> threads;
+  for (size_t k = 0; k < n_threads; k++) {
+    threads.emplace_back([&parallel_ids, k] { parallel_ids[k] = build_ids(100 + k); });
+    threads.emplace_back([&parallel_ids, k] {
+      for (int i = 0; i < 100; i++) {
+        parallel_ids[n_threads + k].push_back(tenkai::Operation::make_var()->hash_id);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  std::set<int32_t> var_ids(ids.begin(), ids.end() - 1);
+  var_ids.insert(before->hash_id);
+  var_ids.insert(after->hash_id);
+  for (size_t k = 0; k < n_threads; k++) {
+    var_ids.insert(parallel_ids[k].begin(), parallel_ids[k].end() - 1);
+    var_ids.insert(parallel_ids[n_threads + k].begin(), parallel_ids[n_threads + k].end());
+  }
+  EXPECT_EQ(var_ids.size(), 102 + 2 * n_threads * 100);
+
+  // constants are identified by their value
+  auto c = tenkai::Operation::make_constant(0.25);
+  EXPECT_GE(c->hash_id, 0);
+  EXPECT_NE(tenkai::Operation::make_constant(0.0)->hash_id,
+            tenkai::Operation::make_constant(-0.0)->hash_id);
+  EXPECT_NE(tenkai::Operation::make_constant(0.0)->hash_id,
+            tenkai::Operation::make_zero()->hash_id);
+}
+
 int main(int argc, char **argv) {
   testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
@@ -0,0 +1,117 @@
+#include <gtest/gtest.h>
+#include <cmath>
+#include <random>
+#include "bytecode.hpp"
+#include "cg.hpp"
+#include "compile.hpp"
+#include "random_graph.hpp"
+
+using namespace tenkai;
+
+double ext_affine(double a, double b, double c) {
+  return a * b + c;
+}
+
+double ext_sum10(double a0,
+                 double a1,
+                 double a2,
+                 double a3,
+                 double a4,
+                 double a5,
+                 double a6,
+                 double a7,
+                 double a8,
+                 double a9) {
+  return a0 + 2 * a1 + 3 * a2 + 4 * a3 + 5 * a4 + 6 * a5 + 7 * a6 + 8 * a7 + 9 * a8 + 10 * a9;
+}
+
+TEST(Bytecode, AllOperations) {
+  auto x = Operation::make_var();
+  auto y = Operation::make_var();
+  auto z = Operation::make_var();
+  auto unused = Operation::make_var();
+  auto p = Operation::make_param(1);
+  auto norm = sqrt(x * x + y * y + z * z);
+  auto angle = atan2(y, x) - Operation::make_constant(0.25);
+  auto soft = log(exp(x) + exp(y)) / norm;
+  auto wave = pow(norm, Operation::make_constant(1.5)) * sin(z) + cos(-z);
+  auto affine = Operation::make_ext_func("ext_affine", {x, p, wave});
+  auto sum = Operation::make_ext_func(
+      "ext_sum10", {x, y, z, norm, angle, soft, wave, affine, p, Operation::make_constant(2.0)});
+  // outputs that are inputs or constants, and the same value twice
+  std::vector<Operation::Ptr> outputs = {norm, angle, soft,  wave, affine,
+                                         sum,  y,     Operation::make_constant(3.5), sum * p, norm};
+  std::vector<Operation::Ptr> inputs = {x, y, unused, z};
+
+  double params[2] = {0.0, 1.25};
+  void* extfns[3] = {reinterpret_cast<void*>(ext_affine), reinterpret_cast<void*>(ext_sum10),
+                     params};
+  ASSERT_EQ(param_slot(outputs), 2);
+  double input[4] = {0.3, -0.7, 100.0, 1.1};
+  double output_native[10];
+  double output_bytecode[10];
+  compiler::compile(inputs, outputs)(input, output_native, extfns);
+  compiler::BytecodeKernel kernel(inputs, outputs);
+  kernel(input, output_bytecode, extfns);
+  for (int i = 0; i < 10; i++) {
+    ASSERT_NEAR(output_bytecode[i], output_native[i], 1e-12) << i;
+  }
+  ASSERT_EQ(output_bytecode[6], -0.7);
+  ASSERT_EQ(output_bytecode[7], 3.5);
+
+  // the parameters are read on every call
+  params[1] = -2.0;
+  compiler::compile(inputs, outputs)(input, output_native, extfns);
+  kernel(input, output_bytecode, extfns);
+  ASSERT_NEAR(output_bytecode[8], output_native[8], 1e-12);
+}
+
+TEST(Bytecode, MatchesNative) {
+  // more values than fit in the registers on the stack
+  RandomGraphConfig config;
+  config.n_nodes = 3000;
+  config.depth = 10;
+  config.sharing = 0.2;
+  config.weight_extcall = 0.5;
+  void* extfns[] = {reinterpret_cast<void*>(&random_graph_ext_func)};
+  for (uint64_t seed = 0; seed < 3; seed++) {
+    config.seed = seed;
+    auto graph = make_random_graph(config);
+    auto f_native = compiler::compile(graph.inputs, graph.outputs);
+    compiler::BytecodeKernel kernel(graph.inputs, graph.outputs);
+    ASSERT_LT(kernel.n_registers(), config.n_nodes);
+
+    std::mt19937 gen(seed);
+    std::uniform_real_distribution<double> dis(-1.0, 1.0);
+    std::vector<double> input(config.n_inputs);
+    for (auto& value : input) {
+      value = dis(gen);
+    }
+    std::vector<double> output_native(config.n_outputs);
+    std::vector<double> output_bytecode(config.n_outputs);
+    f_native(input.data(), output_native.data(), extfns);
+    kernel(input.data(), output_bytecode.data(), extfns);
+    for (size_t i = 0; i < config.n_outputs; i++) {
+      if (output_native[i] == output_bytecode[i]) {
+        continue;  // including the same infinity
+      }
+      ASSERT_NEAR(output_bytecode[i], output_native[i],
+                  1e-9 * std::max(1.0, std::abs(output_native[i])));
+    }
+  }
+}
+
+TEST(Bytecode, TooManyArguments) {
+  std::vector<Operation::Ptr> args;
+  for (size_t i = 0; i <= compiler::BytecodeKernel::max_ext_args; i++) {
+    args.push_back(Operation::make_var());
+  }
+  auto inputs = args;
+  auto ret = Operation::make_ext_func("ext_many", std::move(args));
+  ASSERT_THROW(compiler::BytecodeKernel(inputs, {ret}), std::runtime_error);
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -1,6 +1,13 @@
 #include "cg.hpp"
 #include "compile.hpp"
+#include <unistd.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <format>
+#include <fstream>
 #include <iostream>
+#include <limits>
 #include <gtest/gtest.h>
 
 using namespace tenkai;
@@ -45,6 +52,382 @@ TEST(Compiler, Basic) {
   }
 }
 
+TEST(Compiler, MathFunctions) {
+  auto x = Operation::make_var();
+  auto y = Operation::make_var();
+  auto z = Operation::make_var();
+
+  auto norm = sqrt(x * x + y * y + z * z);
+  auto nx = x / norm;
+  auto soft = log(exp(x) + exp(y));
+  auto angle = atan2(y, x);
+  auto power = pow(norm, z);
+  auto mixed = sin(x) / (cos(y) + Operation::make_constant(2.0)) + pow(z, y);
+
+  std::vector<Operation::Ptr> output = {norm, nx, soft, angle, power, mixed};
+  double input[3] = {0.3, -1.2, 0.7};
+
+  double output_custom[6];
+  auto func = compiler::compile({x, y, z}, output);
+  func(input, output_custom, {});
+
+  double output_gcc[6];
+  func = jit_compile<double>({x, y, z}, output);
+  func(input, output_gcc, {});
+
+  for (int i = 0; i < 6; i++) {
+    ASSERT_NEAR(output_custom[i], output_gcc[i], 1e-9);
+  }
+  ASSERT_NEAR(output_custom[0], std::sqrt(0.09 + 1.44 + 0.49), 1e-12);
+  ASSERT_NEAR(output_custom[3], std::atan2(-1.2, 0.3), 1e-12);
+}
+
+TEST(Compiler, ConstantLiterals) {
+  // constants must be emitted by flatten() as floating point literals of the same value
+  auto x = Operation::make_var();
+  std::vector<Operation::Ptr> output = {x * Operation::make_constant(-0.0),
+                                        x - Operation::make_constant(-2.5),
+                                        x * Operation::make_constant(1e20),
+                                        x + Operation::make_constant(12345678901234567890.0),
+                                        x * Operation::make_constant(INFINITY),
+                                        -Operation::make_constant(1.0 / 3.0) * x};
+  double input[1] = {1.5};
+  double output_custom[6];
+  double output_gcc[6];
+  compiler::compile({x}, output)(input, output_custom, {});
+  jit_compile<double>({x}, output)(input, output_gcc, {});
+  for (int i = 0; i < 6; i++) {
+    ASSERT_EQ(std::memcmp(&output_custom[i], &output_gcc[i], sizeof(double)), 0) << i;
+  }
+  ASSERT_TRUE(std::signbit(output_gcc[0]));
+}
+
+double twice(double x) {
+  return 2.0 * x;
+}
+
+TEST(Compiler, Params) {
+  auto x = Operation::make_var();
+  auto p0 = Operation::make_param(0);
+  auto p1 = Operation::make_param(1);
+  // parameters are not folded, even with constants or into each other
+  auto square = p0 * p0;
+  ASSERT_EQ(square->kind, OpKind::MUL);
+  ASSERT_EQ((p0 * Operation::make_constant(2.0))->kind, OpKind::MUL);
+  ASSERT_EQ(Operation::make_param(0)->hash_id, p0->hash_id);
+  std::vector<Operation::Ptr> output = {
+      x * p0 + p1, sin(p1), p0, square,
+      Operation::make_ext_func("twice", {x + Operation::make_param(2)})};
+  ASSERT_EQ(param_slot(output), 1);
+
+  double params[3] = {0.5, 2.0, -1.0};
+  void* extfns[] = {reinterpret_cast<void*>(&twice), params};
+  auto expected = [&params](double x) {
+    return std::vector<double>{x * params[0] + params[1], std::sin(params[1]), params[0],
+                               params[0] * params[0], 2.0 * (x + params[2])};
+  };
+  auto native = compiler::compile({x}, output);
+  auto gcc = jit_compile<double>({x}, output);
+  auto batch = jit_compile_batch<double>({x}, output);
+  double input[2] = {1.5, -3.0};
+  for (int update = 0; update < 2; update++) {
+    std::vector<double> output_native(5), output_gcc(5), output_batch(10);
+    native(input, output_native.data(), extfns);
+    gcc(input, output_gcc.data(), extfns);
+    double* columns[5];
+    for (size_t k = 0; k < 5; k++) {
+      columns[k] = output_batch.data() + 2 * k;
+    }
+    const double* input_column[1] = {input};
+    batch(input_column, columns, extfns, 2);
+    auto values = expected(input[0]);
+    for (size_t k = 0; k < 5; k++) {
+      ASSERT_DOUBLE_EQ(output_native[k], values[k]) << k;
+      ASSERT_DOUBLE_EQ(output_gcc[k], values[k]) << k;
+      ASSERT_DOUBLE_EQ(columns[k][0], values[k]) << k;
+      ASSERT_DOUBLE_EQ(columns[k][1], expected(input[1])[k]) << k;
+    }
+    // the kernels read the new values without recompilation
+    params[0] = 3.0;
+    params[1] = -0.25;
+    params[2] = 4.0;
+  }
+}
+
+int n_calls_a = 0;
+int n_calls_b = 0;
+double count_a(double x) {
+  n_calls_a++;
+  return x + 1.0;
+}
+double count_b(double x) {
+  n_calls_b++;
+  return x - 1.0;
+}
+
+TEST(Compiler, Entries) {
+  auto x = Operation::make_var();
+  auto y = Operation::make_var();
+  std::vector<Operation::Ptr> output = {
+      Operation::make_ext_func("count_a", {x}), x * y,
+      Operation::make_ext_func("count_b", {y}) + Operation::make_param(0), sin(x)};
+  auto entries = compiler::compile_entries({x, y}, output, {{1}, {2, 0}, {3, 1, 3}});
+  ASSERT_EQ(entries.size(), 3);
+
+  // every entry takes the function table and the parameter slot of the whole outputs, and
+  // writes its outputs where the whole kernel would, leaving the others untouched
+  double params[1] = {10.0};
+  void* extfns[] = {reinterpret_cast<void*>(&count_a), reinterpret_cast<void*>(&count_b), params};
+  double input[2] = {0.5, 3.0};
+  constexpr double untouched = -7.0;
+  double result[4] = {untouched, untouched, untouched, untouched};
+  entries[0](input, result, extfns);
+  ASSERT_EQ(result[0], untouched);
+  ASSERT_EQ(result[1], 1.5);
+  ASSERT_EQ(result[2], untouched);
+  ASSERT_EQ(result[3], untouched);
+  ASSERT_EQ(n_calls_a + n_calls_b, 0);  // only the cone of x * y is evaluated
+  std::fill(std::begin(result), std::end(result), untouched);
+  entries[1](input, result, extfns);
+  ASSERT_EQ(result[0], 1.5);
+  ASSERT_EQ(result[1], untouched);
+  ASSERT_EQ(result[2], 12.0);
+  ASSERT_EQ(result[3], untouched);
+  ASSERT_EQ(n_calls_a, 1);
+  ASSERT_EQ(n_calls_b, 1);
+  std::fill(std::begin(result), std::end(result), untouched);
+  entries[2](input, result, extfns);
+  ASSERT_EQ(result[0], untouched);
+  ASSERT_EQ(result[1], 1.5);
+  ASSERT_EQ(result[2], untouched);
+  ASSERT_EQ(result[3], std::sin(0.5));
+  ASSERT_EQ(n_calls_a + n_calls_b, 2);
+  // entries can be called in any order on the shared body
+  entries[1](input, result, extfns);
+  ASSERT_EQ(result[2], 12.0);
+  ASSERT_EQ(n_calls_a + n_calls_b, 4);
+  ASSERT_THROW(compiler::compile_entries({x, y}, output, {{4}}), std::runtime_error);
+  ASSERT_THROW(compiler::compile_entries({x, y}, output, {}), std::runtime_error);
+  ASSERT_THROW(compiler::compile_entries({x, y}, output, std::vector<std::vector<size_t>>(65)),
+               std::runtime_error);
+}
+
+TEST(Compiler, EntriesSpills) {
+  // entries over a body that spills, with cones interleaved by the shared subexpressions, agree
+  // with separate kernels for their outputs
+  std::vector<Operation::Ptr> q;
+  for (int i = 0; i < 6; i++) {
+    q.push_back(Operation::make_var());
+  }
+  std::vector<Operation::Ptr> outputs;
+  auto shared = cos(q[0]) * sin(q[1]);
+  for (int i = 0; i < 24; i++) {
+    auto a = q[i % 6] * q[(i + 1) % 6] + Operation::make_constant(i);
+    auto b = i % 3 == 0 ? exp(a * Operation::make_constant(0.1)) : a * a - shared;
+    outputs.push_back(b / (q[(i + 2) % 6] + Operation::make_constant(10.0)));
+  }
+  std::vector<std::vector<size_t>> subsets = {{0, 5, 11}, {23, 1}, {}, {7, 7, 12, 13, 14}};
+  for (size_t i = 0; i < outputs.size(); i++) {
+    subsets[2].push_back(outputs.size() - 1 - i);
+  }
+  auto entries = compiler::compile_entries(q, outputs, subsets);
+  double input[6] = {0.3, -0.8, 1.7, 0.2, -1.1, 0.9};
+  double expected[24];
+  compiler::compile(q, outputs)(input, expected, nullptr);
+  for (size_t e = 0; e < subsets.size(); e++) {
+    double result[24];
+    std::fill(std::begin(result), std::end(result), -7.0);
+    entries[e](input, result, nullptr);
+    for (size_t i = 0; i < outputs.size(); i++) {
+      bool listed = std::find(subsets[e].begin(), subsets[e].end(), i) != subsets[e].end();
+      ASSERT_EQ(result[i], listed ? expected[i] : -7.0) << "entry " << e << " output " << i;
+    }
+  }
+}
+
+struct JointState {
+  double position;
+  double velocity;
+  int32_t flags;
+};
+
+struct Pose {
+  int32_t id;
+  double xy[2];
+};
+
+TEST(Compiler, Layout) {
+  // read from an array of JointState and write into an array of Pose in place
+  std::vector<Operation::Ptr> q;
+  for (int i = 0; i < 3; i++) {
+    q.push_back(Operation::make_var());
+  }
+  // the inputs are read again after the calls, from the same place
+  auto x = cos(q[0]) + cos(q[0] + q[1]) + q[2] * q[0];
+  auto y = sin(q[0]) + sin(q[0] + q[1]) - q[2] * q[1];
+  std::vector<Operation::Ptr> outputs = {x, y, q[2], q[0] * q[1]};
+  compiler::CompileOptions options;
+  options.layout.input_offsets =
+      compiler::IoLayout::strided(3, offsetof(JointState, position), sizeof(JointState));
+  options.layout.output_offsets = {offsetof(Pose, xy), offsetof(Pose, xy) + sizeof(double),
+                                   sizeof(Pose) + offsetof(Pose, xy),
+                                   sizeof(Pose) + offsetof(Pose, xy) + sizeof(double)};
+  auto func = compiler::compile(q, outputs, options);
+
+  JointState states[3] = {{0.3, -1.0, 7}, {-0.8, -2.0, 8}, {1.7, -3.0, 9}};
+  Pose poses[2] = {{1, {0.0, 0.0}}, {2, {0.0, 0.0}}};
+  func(reinterpret_cast<double*>(states), reinterpret_cast<double*>(poses), nullptr);
+  double dense_input[3] = {0.3, -0.8, 1.7};
+  double expected[4];
+  compiler::compile(q, outputs)(dense_input, expected, nullptr);
+  ASSERT_EQ(poses[0].xy[0], expected[0]);
+  ASSERT_EQ(poses[0].xy[1], expected[1]);
+  ASSERT_EQ(poses[1].xy[0], expected[2]);
+  ASSERT_EQ(poses[1].xy[1], expected[3]);
+  ASSERT_EQ(poses[0].id, 1);
+  ASSERT_EQ(poses[1].id, 2);
+
+  // entries take the offsets of their outputs
+  auto entries = compiler::compile_entries(q, outputs, {{3, 1}}, options);
+  Pose entry_poses[2] = {{1, {0.0, 0.0}}, {2, {0.0, 0.0}}};
+  entries[0](reinterpret_cast<double*>(states), reinterpret_cast<double*>(entry_poses), nullptr);
+  ASSERT_EQ(entry_poses[0].xy[0], 0.0);
+  ASSERT_EQ(entry_poses[0].xy[1], expected[1]);
+  ASSERT_EQ(entry_poses[1].xy[0], 0.0);
+  ASSERT_EQ(entry_poses[1].xy[1], expected[3]);
+
+  options.layout.output_offsets.pop_back();
+  ASSERT_THROW(compiler::compile(q, outputs, options), std::runtime_error);
+
+  ASSERT_FALSE(options.layout.is_dense());
+  ASSERT_TRUE(compiler::IoLayout{}.is_dense());
+  compiler::IoLayout explicit_dense{compiler::IoLayout::strided(3, 0, sizeof(double)), {}};
+  ASSERT_TRUE(explicit_dense.is_dense());
+  // the offsets become 32-bit displacements
+  ASSERT_EQ(compiler::IoLayout::strided(2, -8, 1 << 30), (std::vector<int32_t>{-8, (1 << 30) - 8}));
+  ASSERT_THROW(compiler::IoLayout::strided(3, 0, 1 << 30), std::runtime_error);
+  ASSERT_THROW(compiler::IoLayout::strided(2, std::numeric_limits<int32_t>::min(), -1),
+               std::runtime_error);
+}
+
+TEST(Compiler, Batch) {
+  auto x = Operation::make_var();
+  auto y = Operation::make_var();
+  auto norm = sqrt(x * x + y * y);
+  // an input and a constant as outputs are copied for every point
+  std::vector<Operation::Ptr> output = {norm, atan2(y, x), x * sin(y) - exp(norm), y,
+                                        Operation::make_constant(0.5)};
+  auto func = jit_compile<double>({x, y}, output);
+
+  constexpr size_t n = 37;  // not a multiple of the vector width
+  std::vector<double> xs(n), ys(n);
+  for (size_t i = 0; i < n; i++) {
+    xs[i] = std::sin(i + 1.0);
+    ys[i] = std::cos(i * 0.5);
+  }
+  std::vector<std::vector<double>> columns(output.size(), std::vector<double>(n));
+  const double* input[2] = {xs.data(), ys.data()};
+  double* output_batch[5];
+  for (size_t k = 0; k < output.size(); k++) {
+    output_batch[k] = columns[k].data();
+  }
+
+  for (const auto& flags : {"-O3", "-O2 -march=native"}) {
+    JitOptions options;
+    options.flags = flags;
+    auto batch = jit_compile_batch<double>({x, y}, output, options);
+    batch(input, output_batch, {}, n);
+    for (size_t i = 0; i < n; i++) {
+      double point[2] = {xs[i], ys[i]};
+      double expected[5];
+      func(point, expected, {});
+      for (size_t k = 0; k < output.size(); k++) {
+        ASSERT_NEAR(columns[k][i], expected[k], 1e-12) << flags << " " << i << " " << k;
+      }
+    }
+  }
+
+  auto batch_float = jit_compile_batch<float>({x, y}, {norm});
+  float xf[3] = {3.0f, 0.0f, -1.0f}, yf[3] = {4.0f, 2.0f, 0.0f}, normf[3];
+  const float* input_float[2] = {xf, yf};
+  float* output_float[1] = {normf};
+  batch_float(input_float, output_float, {}, 3);
+  ASSERT_FLOAT_EQ(normf[0], 5.0f);
+  ASSERT_FLOAT_EQ(normf[1], 2.0f);
+  ASSERT_FLOAT_EQ(normf[2], 1.0f);
+}
+
+TEST(Compiler, PerfMap) {
+  auto x = Operation::make_var();
+  auto y = Operation::make_var();
+  compiler::CompileOptions options;
+  options.name = "perf_map_test_kernel";
+  options.perf_map = true;
+  options.jitdump = true;
+  auto func = compiler::compile({x, y}, {x * y + sin(x)}, options);
+  double input[2] = {0.5, 2.0};
+  double output[1];
+  func(input, output, {});
+  ASSERT_NEAR(output[0], 1.0 + std::sin(0.5), 1e-12);
+
+  std::ifstream map_file(std::format("/tmp/perf-{}.map", getpid()));
+  std::string line;
+  bool found = false;
+  while (std::getline(map_file, line)) {
+    if (line.starts_with(std::format("{:x} ", reinterpret_cast<uintptr_t>(func))) &&
+        line.ends_with(" perf_map_test_kernel")) {
+      found = true;
+    }
+  }
+  ASSERT_TRUE(found);
+
+  std::ifstream dump_file(std::format("/tmp/jit-{}.dump", getpid()), std::ios::binary);
+  std::string dump((std::istreambuf_iterator<char>(dump_file)), std::istreambuf_iterator<char>());
+  ASSERT_GE(dump.size(), 40);
+  uint32_t magic;
+  std::memcpy(&magic, dump.data(), sizeof(magic));
+  ASSERT_EQ(magic, 0x4A695444);
+  // the code bytes follow the name in the record
+  auto name_pos = dump.find("perf_map_test_kernel");
+  ASSERT_NE(name_pos, std::string::npos);
+  auto code_pos = name_pos + std::string("perf_map_test_kernel").size() + 1;
+  ASSERT_EQ(std::memcmp(dump.data() + code_pos, reinterpret_cast<const void *>(func), 16), 0);
+}
+
+TEST(Compiler, Instrument) {
+  auto x = Operation::make_var();
+  auto y = Operation::make_var();
+  compiler::CompileOptions options;
+  options.name = "instrument_test_kernel";
+  options.instrument = true;
+  auto expr = cos(x * y) + sin(y);
+  auto func = compiler::compile({x, y}, {expr}, options);
+  auto func_plain = compiler::compile({x, y}, {expr});
+
+  double input[2] = {0.3, -0.8};
+  double output[1], output_plain[1];
+  for (int i = 0; i < 1000; i++) {
+    func(input, output, {});
+  }
+  func_plain(input, output_plain, {});
+  ASSERT_EQ(output[0], output_plain[0]);
+
+  auto profiles = compiler::KernelRegistry::instance().find("instrument_test_kernel");
+  ASSERT_EQ(profiles.size(), 1);
+  const auto &profile = profiles.front();
+  ASSERT_EQ(profile.calls, 1000);
+  ASSERT_GT(profile.total_cycles, 0);
+  uint64_t histogram_total = 0;
+  for (auto count : profile.histogram) {
+    histogram_total += count;
+  }
+  ASSERT_EQ(histogram_total, 1000);
+  ASSERT_LE(profile.mean_cycles(), profile.quantile_cycles(1.0));
+
+  compiler::KernelRegistry::instance().reset();
+  ASSERT_EQ(compiler::KernelRegistry::instance().find("instrument_test_kernel").front().calls, 0);
+}
+
 int main(int argc, char **argv) {
   testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
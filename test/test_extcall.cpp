@@ -0,0 +1,94 @@
+#include <cmath>
+#include <gtest/gtest.h>
+#include "cg.hpp"
+#include "compile.hpp"
+
+using namespace tenkai;
+
+double ext_add(double a, double b) {
+  return a + b;
+}
+
+double ext_sub(double a, double b) {
+  return a - b;
+}
+
+double ext_sum10(double a0,
+                 double a1,
+                 double a2,
+                 double a3,
+                 double a4,
+                 double a5,
+                 double a6,
+                 double a7,
+                 double a8,
+                 double a9) {
+  return a0 + 2 * a1 + 3 * a2 + 4 * a3 + 5 * a4 + 6 * a5 + 7 * a6 + 8 * a7 + 9 * a8 + 10 * a9;
+}
+
+TEST(ExtCallTest, FunctionTable) {
+  auto x = Operation::make_var();
+  auto y = Operation::make_var();
+  auto z = Operation::make_var();
+  auto sum = Operation::make_ext_func("ext_add", {x * y, z});
+  auto diff = Operation::make_ext_func("ext_sub", {y, x});
+  // operands are swapped between the arguments, and live across the calls
+  auto swapped = Operation::make_ext_func("ext_sub", {diff, sum});
+  auto ret = sum * diff + swapped + x * y * z;
+  std::vector<Operation::Ptr> outputs = {sum, diff, swapped, ret};
+
+  auto table = ext_func_table(outputs);
+  ASSERT_EQ(table.size(), 2);
+  ASSERT_EQ(table[0], "ext_add");
+  ASSERT_EQ(table[1], "ext_sub");
+  void* extfns[2] = {reinterpret_cast<void*>(ext_add), reinterpret_cast<void*>(ext_sub)};
+
+  double input[3] = {1.5, -2.0, 3.0};
+  double expected_sum = 1.5 * -2.0 + 3.0;
+  double expected_diff = -2.0 - 1.5;
+  double expected_swapped = expected_diff - expected_sum;
+  double expected[4] = {expected_sum, expected_diff, expected_swapped,
+                        expected_sum * expected_diff + expected_swapped + 1.5 * -2.0 * 3.0};
+
+  double output_custom[4];
+  auto func = compiler::compile({x, y, z}, outputs);
+  func(input, output_custom, extfns);
+
+  double output_gcc[4];
+  func = jit_compile<double>({x, y, z}, outputs);
+  func(input, output_gcc, extfns);
+
+  for (int i = 0; i < 4; i++) {
+    ASSERT_NEAR(output_custom[i], expected[i], 1e-12);
+    ASSERT_NEAR(output_gcc[i], expected[i], 1e-12);
+  }
+}
+
+TEST(ExtCallTest, StackArguments) {
+  std::vector<Operation::Ptr> inputs;
+  for (int i = 0; i < 4; i++) {
+    inputs.push_back(Operation::make_var());
+  }
+  auto& a = inputs;
+  // more than 8 arguments, so some of them are passed on the stack
+  auto ret = Operation::make_ext_func(
+      "ext_sum10", {a[3], a[2], a[1], a[0], a[0] * a[1], a[1] * a[2], a[2] * a[3], a[3] * a[0],
+                    a[0] + a[2], sin(a[1])});
+  auto ret2 = ret * a[0];
+  void* extfns[1] = {reinterpret_cast<void*>(ext_sum10)};
+
+  double input[4] = {0.5, 1.5, -2.5, 3.5};
+  double expected = ext_sum10(3.5, -2.5, 1.5, 0.5, 0.5 * 1.5, 1.5 * -2.5, -2.5 * 3.5, 3.5 * 0.5,
+                              0.5 + -2.5, std::sin(1.5));
+
+  double output_custom[2];
+  auto func = compiler::compile(inputs, {ret, ret2});
+  func(input, output_custom, extfns);
+  ASSERT_NEAR(output_custom[0], expected, 1e-12);
+  ASSERT_NEAR(output_custom[1], expected * 0.5, 1e-12);
+}
+
+int main(int argc, char **argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,170 @@
+#include <sys/wait.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cmath>
+#include <format>
+#include <fstream>
+#include <gtest/gtest.h>
+#include "cg.hpp"
+#include "compile.hpp"
+#include "graph_file.hpp"
+#include "random_graph.hpp"
+
+using namespace tenkai;
+
+std::string temp_path(const std::string& name) {
+  return std::format("/tmp/tenkai_{}_{}.graph", name, getpid());
+}
+
+TEST(GraphFile, View) {
+  auto x = Operation::make_var();
+  auto y = Operation::make_var();
+  auto unused = Operation::make_var();
+  auto sum = x + y;
+  auto ext = Operation::make_ext_func("ext", {sum, Operation::make_constant(2.5)});
+  auto path = temp_path("view");
+  save_graph(path, {x, y, unused}, {ext, sum});
+
+  GraphView view(path);
+  ASSERT_EQ(view.inputs().size(), 3);
+  ASSERT_EQ(view.outputs().size(), 2);
+  // inputs come first even if unused
+  for (uint32_t i = 0; i < 3; i++) {
+    ASSERT_EQ(view.inputs()[i], i);
+    ASSERT_EQ(view.kind(i), OpKind::LOAD);
+  }
+  auto ext_index = view.outputs()[0];
+  ASSERT_EQ(view.kind(ext_index), OpKind::EXTCALL);
+  ASSERT_EQ(view.ext_func_name(ext_index), "ext");
+  ASSERT_EQ(view.args(ext_index)[0], view.outputs()[1]);
+  auto constant_index = view.args(ext_index)[1];
+  ASSERT_EQ(view.kind(constant_index), OpKind::CONSTANT);
+  ASSERT_EQ(view.node(constant_index).constant_value, 2.5);
+  for (size_t i = 0; i < view.n_nodes(); i++) {
+    for (auto arg : view.args(i)) {
+      ASSERT_LT(arg, i);
+    }
+  }
+
+  auto graph = view.to_operations();
+  ASSERT_EQ(graph.outputs[0]->ext_func_name, "ext");
+  ASSERT_EQ(graph.outputs[0]->args[0], graph.outputs[1]);
+  // the loaded nodes never take the ids of the nodes of the process
+  ASSERT_NE(graph.inputs[0]->hash_id, x->hash_id);
+  ASSERT_NE(graph.outputs[0]->hash_id, ext->hash_id);
+  ASSERT_NE(graph.outputs[1]->hash_id, sum->hash_id);
+  unlink(path.c_str());
+}
+
+TEST(GraphFile, FreshIds) {
+  // a graph saved by a process whose variables took the ids that the variables of this one
+  // take in the same stream
+  auto path = temp_path("fresh_ids");
+  pid_t pid = fork();
+  ASSERT_NE(pid, -1);
+  if (pid == 0) {
+    NodeIdStream stream(7);
+    auto a = Operation::make_var();
+    save_graph(path, {a}, {sin(a)});
+    _exit(0);
+  }
+  int status;
+  waitpid(pid, &status, 0);
+  ASSERT_TRUE(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+  NodeIdStream stream(7);
+  auto b = Operation::make_var();
+  auto loaded = GraphView(path).to_operations();
+  ASSERT_NE(loaded.inputs[0]->hash_id, b->hash_id);
+  // the loaded variable and b stay two values
+  auto func = compiler::compile({loaded.inputs[0], b}, {loaded.outputs[0] + b});
+  double input[2] = {0.5, 2.0}, output[1];
+  func(input, output, nullptr);
+  ASSERT_EQ(output[0], std::sin(0.5) + 2.0);
+
+  // loading twice gives two independent graphs
+  auto again = GraphView(path).to_operations();
+  ASSERT_NE(again.inputs[0]->hash_id, loaded.inputs[0]->hash_id);
+  unlink(path.c_str());
+}
+
+TEST(GraphFile, RandomGraphRoundTrip) {
+  RandomGraphConfig config;
+  config.n_nodes = 3000;
+  config.depth = 50;
+  config.weight_extcall = 0.5;
+  auto original = make_random_graph(config);
+  auto path = temp_path("random");
+  save_graph(path, original.inputs, original.outputs);
+  auto loaded = GraphView(path).to_operations();
+
+  // the loaded graph is saved to the same tables. The kernels are not compared: they merge
+  // the nodes by hash_id, and the fresh ids of the loaded graph do not collide as the ones of
+  // the original do
+  auto path_loaded = temp_path("random_loaded");
+  save_graph(path_loaded, loaded.inputs, loaded.outputs);
+  GraphView view(path), view_loaded(path_loaded);
+  ASSERT_EQ(view_loaded.n_nodes(), view.n_nodes());
+  for (size_t i = 0; i < view.n_nodes(); i++) {
+    ASSERT_EQ(view_loaded.kind(i), view.kind(i)) << i;
+    ASSERT_TRUE(std::ranges::equal(view_loaded.args(i), view.args(i))) << i;
+    ASSERT_EQ(view_loaded.node(i).constant_value, view.node(i).constant_value) << i;
+    if (view.kind(i) == OpKind::EXTCALL) {
+      ASSERT_EQ(view_loaded.ext_func_name(i), view.ext_func_name(i)) << i;
+    }
+  }
+  ASSERT_TRUE(std::ranges::equal(view_loaded.inputs(), view.inputs()));
+  ASSERT_TRUE(std::ranges::equal(view_loaded.outputs(), view.outputs()));
+  unlink(path.c_str());
+  unlink(path_loaded.c_str());
+}
+
+TEST(GraphFile, RejectsInvalid) {
+  auto x = Operation::make_var();
+  auto path = temp_path("invalid");
+  save_graph(path, {x}, {x * x});
+  {
+    // truncated
+    std::string content;
+    {
+      std::ifstream file(path, std::ios::binary);
+      content.assign(std::istreambuf_iterator<char>(file), {});
+    }
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file.write(content.data(), content.size() - 8);
+  }
+  ASSERT_THROW(GraphView view(path), std::runtime_error);
+
+  // a unary node turned into a binary one keeps a single operand
+  save_graph(path, {x}, {sin(x)});
+  {
+    std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+    file.seekp(sizeof(GraphFileHeader) + sizeof(GraphFileNode) + offsetof(GraphFileNode, kind));
+    uint32_t kind = static_cast<uint32_t>(OpKind::ATAN2);
+    file.write(reinterpret_cast<const char*>(&kind), sizeof(kind));
+  }
+  ASSERT_THROW(GraphView view(path), std::runtime_error);
+
+  // counts whose sizes wrap around when multiplied
+  save_graph(path, {x}, {sin(x)});
+  {
+    std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+    file.seekp(offsetof(GraphFileHeader, n_inputs));
+    uint64_t n_inputs = (uint64_t(1) << 62) + 1;
+    file.write(reinterpret_cast<const char*>(&n_inputs), sizeof(n_inputs));
+  }
+  ASSERT_THROW(GraphView view(path), std::runtime_error);
+
+  {
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file << "not a graph file, but long enough to hold a header";
+  }
+  ASSERT_THROW(GraphView view(path), std::runtime_error);
+  unlink(path.c_str());
+  ASSERT_THROW(GraphView view(path), std::runtime_error);
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,176 @@
+#include <unistd.h>
+#include <cmath>
+#include <cstring>
+#include <format>
+#include <fstream>
+#include <gtest/gtest.h>
+#include "cg.hpp"
+#include "compile.hpp"
+#include "kernel_file.hpp"
+
+using namespace tenkai;
+
+double ext_hypot(double a, double b) {
+  return std::hypot(a, b);
+}
+
+std::string temp_path(const std::string& name) {
+  return std::format("/tmp/tenkai_{}_{}.kernel", name, getpid());
+}
+
+TEST(KernelFile, SaveLoad) {
+  auto x = Operation::make_var();
+  auto y = Operation::make_var();
+  auto z = Operation::make_var();
+  auto h = Operation::make_ext_func("ext_hypot", {x, y});
+  std::vector<Operation::Ptr> outputs = {sin(x) * cos(y) + Operation::make_constant(0.25),
+                                         pow(z, y) - atan2(x, z), h * exp(z)};
+  auto path = temp_path("save_load");
+  compiler::CompileOptions options;
+  options.name = "kernel_file_test";
+  compiler::save_kernel(path, {x, y, z}, outputs, options);
+
+  auto kernel = compiler::load_kernel(path);
+  ASSERT_EQ(kernel.name, "kernel_file_test");
+  ASSERT_EQ(kernel.n_inputs, 3);
+  ASSERT_EQ(kernel.n_outputs, 3);
+  ASSERT_EQ(kernel.n_params, 0);
+  ASSERT_EQ(kernel.ext_func_names, std::vector<std::string>{"ext_hypot"});
+
+  void* extfns[1] = {reinterpret_cast<void*>(ext_hypot)};
+  double input[3] = {0.4, 1.3, 0.7};
+  double output_loaded[3], output_compiled[3];
+  kernel.func(input, output_loaded, extfns);
+  compiler::compile({x, y, z}, outputs)(input, output_compiled, extfns);
+  for (int i = 0; i < 3; i++) {
+    ASSERT_EQ(output_loaded[i], output_compiled[i]);
+  }
+  unlink(path.c_str());
+}
+
+TEST(KernelFile, Params) {
+  // the parameter buffer has to cover the largest index, even if lower ones are unused
+  auto x = Operation::make_var();
+  auto path = temp_path("params");
+  compiler::save_kernel(path, {x}, {x * Operation::make_param(2) + Operation::make_param(0)});
+
+  auto kernel = compiler::load_kernel(path);
+  ASSERT_EQ(kernel.n_params, 3);
+  double params[3] = {1.0, 0.0, 4.0};
+  void* extfns[1] = {params};
+  double input[1] = {0.5}, output[1];
+  kernel.func(input, output, extfns);
+  ASSERT_EQ(output[0], 3.0);
+  unlink(path.c_str());
+}
+
+TEST(KernelFile, Layout) {
+  // the kernel reads the first and writes the second double of 16-byte records
+  auto x = Operation::make_var();
+  auto y = Operation::make_var();
+  auto path = temp_path("layout");
+  compiler::CompileOptions options;
+  options.layout.input_offsets = compiler::IoLayout::strided(2, 0, 16);
+  options.layout.output_offsets = compiler::IoLayout::strided(2, 8, 16);
+  compiler::save_kernel(path, {x, y}, {x * y, x - y}, options);
+
+  auto kernel = compiler::load_kernel(path);
+  ASSERT_EQ(kernel.layout.input_offsets, options.layout.input_offsets);
+  ASSERT_EQ(kernel.layout.output_offsets, options.layout.output_offsets);
+  ASSERT_FALSE(kernel.layout.is_dense());
+  double input[4] = {3.0, -1.0, 0.5, -1.0}, output[4] = {-1.0, -1.0, -1.0, -1.0};
+  kernel.func(input, output, nullptr);
+  ASSERT_EQ(output[0], -1.0);
+  ASSERT_EQ(output[1], 1.5);
+  ASSERT_EQ(output[2], -1.0);
+  ASSERT_EQ(output[3], 2.5);
+
+  // a dense layout given explicitly is recorded as the dense one
+  options.layout.input_offsets = compiler::IoLayout::strided(2, 0, sizeof(double));
+  options.layout.output_offsets.clear();
+  compiler::save_kernel(path, {x, y}, {x * y, x - y}, options);
+  kernel = compiler::load_kernel(path);
+  ASSERT_TRUE(kernel.layout.input_offsets.empty());
+  ASSERT_TRUE(kernel.layout.output_offsets.empty());
+  unlink(path.c_str());
+}
+
+TEST(KernelFile, Instrumented) {
+  auto x = Operation::make_var();
+  auto path = temp_path("instrumented");
+  compiler::CompileOptions options;
+  options.name = "kernel_file_instrumented";
+  options.instrument = true;
+  compiler::save_kernel(path, {x}, {cos(x) * x}, options);
+
+  auto kernel = compiler::load_kernel(path);
+  double input[1] = {0.5}, output[1];
+  for (int i = 0; i < 10; i++) {
+    kernel.func(input, output, {});
+  }
+  ASSERT_EQ(output[0], std::cos(0.5) * 0.5);
+  auto profiles = compiler::KernelRegistry::instance().find("kernel_file_instrumented");
+  ASSERT_EQ(profiles.size(), 1);
+  ASSERT_EQ(profiles.front().calls, 10);
+  unlink(path.c_str());
+}
+
+TEST(KernelFile, RejectsInvalid) {
+  auto x = Operation::make_var();
+  auto path = temp_path("invalid");
+  compiler::save_kernel(path, {x}, {x * x});
+
+  // wrong version
+  {
+    std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+    file.seekp(offsetof(compiler::KernelFileHeader, version));
+    uint32_t version = compiler::kernel_file_version + 1;
+    file.write(reinterpret_cast<const char*>(&version), sizeof(version));
+  }
+  ASSERT_THROW(compiler::load_kernel(path), std::runtime_error);
+
+  {
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file << "not a kernel";
+  }
+  ASSERT_THROW(compiler::load_kernel(path), std::runtime_error);
+  unlink(path.c_str());
+  ASSERT_THROW(compiler::load_kernel(path), std::runtime_error);
+}
+
+TEST(KernelFile, RejectsInvalidRelocation) {
+  auto x = Operation::make_var();
+  auto path = temp_path("invalid_relocation");
+  compiler::CompileOptions options;
+  options.name = "kernel_file_invalid_relocation";
+  options.instrument = true;
+  compiler::save_kernel(path, {x}, {cos(x)}, options);
+  {
+    std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+    compiler::KernelFileHeader header;
+    file.read(reinterpret_cast<char*>(&header), sizeof(header));
+    bool patched = false;
+    for (size_t i = 0; i < header.n_relocations; i++) {
+      auto offset = sizeof(header) + i * sizeof(compiler::Relocation);
+      compiler::Relocation relocation;
+      file.seekg(offset);
+      file.read(reinterpret_cast<char*>(&relocation), sizeof(relocation));
+      if (relocation.kind == compiler::Relocation::Kind::LIBM) {
+        relocation.target = 1000;
+        file.seekp(offset);
+        file.write(reinterpret_cast<const char*>(&relocation), sizeof(relocation));
+        patched = true;
+      }
+    }
+    ASSERT_TRUE(patched);
+  }
+  ASSERT_THROW(compiler::load_kernel(path), std::runtime_error);
+  // the counters of the kernel that failed to load are not left registered
+  ASSERT_TRUE(compiler::KernelRegistry::instance().find(options.name).empty());
+  unlink(path.c_str());
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
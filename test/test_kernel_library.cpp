@@ -0,0 +1,46 @@
+#include <cmath>
+#include <gtest/gtest.h>
+#include "test_kernels.hpp"
+#include "test_kernels_other.hpp"
+
+double scale(double x, double y) {
+  return 2.0 * x * y;
+}
+
+TEST(KernelLibrary, PolarToCartesian) {
+  static_assert(test_kernels::polar_to_cartesian_n_inputs == 2);
+  static_assert(test_kernels::polar_to_cartesian_n_outputs == 4);
+  double input[2] = {1.5, 0.3};
+  double output[4];
+  test_kernels::polar_to_cartesian(input, output, nullptr);
+  ASSERT_DOUBLE_EQ(output[0], 1.5 * std::cos(0.3));
+  ASSERT_DOUBLE_EQ(output[1], 1.5 * std::sin(0.3));
+  ASSERT_EQ(output[2], 1.5);
+  ASSERT_EQ(output[3], 2.0);
+}
+
+TEST(KernelLibrary, ExtCall) {
+  double input[2] = {0.5, 3.0};
+  double output[test_kernels::ext_kernel_n_outputs];
+  void* extfns[] = {reinterpret_cast<void*>(scale)};
+  test_kernels::ext_kernel(input, output, extfns);
+  ASSERT_DOUBLE_EQ(output[0], scale(0.5, 3.0) * 0.5 + 1.0);
+  ASSERT_DOUBLE_EQ(output[1], std::sqrt(scale(0.5, 3.0)));
+}
+
+TEST(KernelLibrary, SameKernelNames) {
+  double input[2] = {2.0, 0.5};
+  double output[4];
+  double output_other[4];
+  test_kernels::polar_to_cartesian(input, output, nullptr);
+  test_kernels_other::polar_to_cartesian(input, output_other, nullptr);
+  ASSERT_NE(&test_kernels::polar_to_cartesian, &test_kernels_other::polar_to_cartesian);
+  for (int i = 0; i < 4; i++) {
+    ASSERT_EQ(output[i], output_other[i]);
+  }
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,105 @@
+#include <gtest/gtest.h>
+#include "cg.hpp"
+#include "compile.hpp"
+#include "kinematics.hpp"
+#include "linalg.hpp"
+#include "operation_scheduler.hpp"
+#include "spatial.hpp"
+
+using namespace tenkai;
+
+// base -(rz)- shoulder -(rx)- elbow -(fixed)- hand
+//                     \-(prismatic y)- slider
+KinematicTree make_tree() {
+  KinematicTree tree;
+  auto base = tree.add_link(std::nullopt, JointType::REVOLUTE, Axis::Z,
+                            KinematicTree::make_offset({0.0, 0.0, 0.5}));
+  auto shoulder = tree.add_link(base, JointType::REVOLUTE, Axis::X,
+                                KinematicTree::make_offset({0.1, 0.0, 0.3}, {0.0, 0.2, 0.0}));
+  auto elbow = tree.add_link(shoulder, JointType::FIXED, Axis::X,
+                             KinematicTree::make_offset({0.0, 0.4, 0.0}, {0.3, 0.0, -0.1}));
+  tree.add_link(elbow, JointType::REVOLUTE, Axis::Y, KinematicTree::make_offset({0.2, 0.0, 0.0}));
+  tree.add_link(base, JointType::PRISMATIC, Axis::Y, KinematicTree::make_offset({0.0, 0.0, 0.1}));
+  return tree;
+}
+
+TEST(KinematicsTest, AllLinkPoses) {
+  auto tree = make_tree();
+  ASSERT_EQ(tree.n_links(), 5);
+  ASSERT_EQ(tree.n_joints(), 4);
+  ASSERT_THROW(tree.add_link(10, JointType::FIXED, Axis::X, KinematicTree::make_offset({0, 0, 0})),
+               std::runtime_error);
+
+  // reference by composing the transforms of each link by hand
+  auto q = Vector::Var(4).elements;
+  auto zero = Vector::Zero(3);
+  auto tf_base = KinematicTree::make_offset({0.0, 0.0, 0.5}) *
+                 SpatialTransform(Matrix::RotZ(q[0]), zero);
+  auto tf_shoulder = tf_base * KinematicTree::make_offset({0.1, 0.0, 0.3}, {0.0, 0.2, 0.0}) *
+                     SpatialTransform(Matrix::RotX(q[1]), zero);
+  auto tf_elbow = tf_shoulder * KinematicTree::make_offset({0.0, 0.4, 0.0}, {0.3, 0.0, -0.1});
+  auto tf_hand = tf_elbow * KinematicTree::make_offset({0.2, 0.0, 0.0}) *
+                 SpatialTransform(Matrix::RotY(q[2]), zero);
+  auto slide = Vector({Operation::make_zero(), q[3], Operation::make_zero()});
+  auto tf_slider = tf_base * KinematicTree::make_offset({0.0, 0.0, 0.1}) *
+                   SpatialTransform(Matrix::Identity(3), slide);
+  std::vector<Operation::Ptr> expected_outputs;
+  for (auto& tf : {tf_base, tf_shoulder, tf_elbow, tf_hand, tf_slider}) {
+    expected_outputs.insert(expected_outputs.end(), tf.rot.elements.begin(), tf.rot.elements.end());
+    expected_outputs.insert(expected_outputs.end(), tf.trans.elements.begin(),
+                            tf.trans.elements.end());
+  }
+  auto fn_expected = jit_compile<double>(q, expected_outputs);
+
+  double input[4] = {0.3, -0.7, 1.2, 0.25};
+  double expected[5 * 12];
+  fn_expected(input, expected, nullptr);
+  for (const auto& backend : {"native", "g++"}) {
+    auto fn = tree.compile(backend);
+    double output[5 * 12];
+    fn(input, output, nullptr);
+    for (size_t i = 0; i < 5 * 12; i++) {
+      ASSERT_NEAR(output[i], expected[i], 1e-12);
+    }
+  }
+}
+
+TEST(KinematicsTest, IdentityOffsetsFold) {
+  // offsets without rotation and with zero components add no operation: the folded 0.0 and
+  // 1.0 become ZERO and ONE, which the operators simplify away
+  KinematicTree tree;
+  std::optional<size_t> parent = std::nullopt;
+  for (size_t i = 0; i < 6; i++) {
+    parent = tree.add_link(parent, JointType::REVOLUTE, i % 2 == 0 ? Axis::Z : Axis::Y,
+                           KinematicTree::make_offset({0.0, 0.0, 0.3}));
+  }
+  auto q = Vector::Var(6).elements;
+  auto scheduled = compiler::DepthFirstScheduler().flatten(q, tree.pose_elements(q));
+
+  // the same chain composed from identity rotations
+  auto zero = Vector::Zero(3);
+  auto offset = SpatialTransform(
+      Matrix::Identity(3),
+      Vector({Operation::make_zero(), Operation::make_zero(), Operation::make_constant(0.3)}));
+  std::vector<Operation::Ptr> expected_outputs;
+  std::optional<SpatialTransform> tf;
+  for (size_t i = 0; i < 6; i++) {
+    auto motion = SpatialTransform(i % 2 == 0 ? Matrix::RotZ(q[i]) : Matrix::RotY(q[i]), zero);
+    tf = tf.has_value() ? *tf * offset * motion : offset * motion;
+    expected_outputs.insert(expected_outputs.end(), tf->rot.elements.begin(),
+                            tf->rot.elements.end());
+    expected_outputs.insert(expected_outputs.end(), tf->trans.elements.begin(),
+                            tf->trans.elements.end());
+  }
+  auto expected = compiler::DepthFirstScheduler().flatten(q, expected_outputs);
+  ASSERT_EQ(scheduled.size(), expected.size());
+  for (const auto& op : scheduled) {
+    ASSERT_FALSE(op->kind == OpKind::CONSTANT &&
+                 (*op->constant_value == 0.0 || *op->constant_value == 1.0));
+  }
+}
+
+int main(int argc, char **argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
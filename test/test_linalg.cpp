@@ -92,6 +92,32 @@ TEST(LinalgTest, Matrix) {
   }
 }
 
+TEST(LinalgTest, StructuralZeros) {
+  ASSERT_EQ(tenkai::Operation::make_zero(), tenkai::Operation::make_zero());
+  ASSERT_EQ(tenkai::Operation::make_one(), tenkai::Operation::make_one());
+  ASSERT_EQ(tenkai::Operation::make_constant(0.5), tenkai::Operation::make_constant(0.5));
+  ASSERT_NE(tenkai::Operation::make_constant(0.0), tenkai::Operation::make_constant(-0.0));
+
+  // identity product returns the very same nodes
+  auto mat = tenkai::Matrix::Var(3, 3);
+  auto prod = tenkai::Matrix::Identity(3) * mat;
+  for (size_t i = 0; i < 9; i++) {
+    ASSERT_EQ(prod.elements[i], mat.elements[i]);
+  }
+
+  // zero pattern of rotation products is propagated
+  auto rx = tenkai::Matrix::RotX(tenkai::Operation::make_var());
+  auto rx2 = rx * rx;
+  std::vector<bool> expected = {true, false, false, false, true, true, false, true, true};
+  ASSERT_EQ(rx2.nonzero, expected);
+  ASSERT_EQ(rx2(0, 0), tenkai::Operation::make_one());
+  ASSERT_EQ(rx2(1, 0), tenkai::Operation::make_zero());
+
+  auto v = rx2 * tenkai::Vector({tenkai::Operation::make_zero(), tenkai::Operation::make_var(),
+                                 tenkai::Operation::make_zero()});
+  ASSERT_EQ(v.nonzero, std::vector<bool>({false, true, true}));
+}
+
 int main(int argc, char **argv) {
   testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
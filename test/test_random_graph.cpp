@@ -0,0 +1,103 @@
+#include <gtest/gtest.h>
+#include <random>
+#include <unordered_set>
+#include "cg.hpp"
+#include "compile.hpp"
+#include "operation_scheduler.hpp"
+#include "random_graph.hpp"
+
+using namespace tenkai;
+
+TEST(RandomGraphTest, Deterministic) {
+  RandomGraphConfig config;
+  config.n_nodes = 300;
+  config.weight_extcall = 1.0;
+  auto kinds = [](const RandomGraph& graph) {
+    std::vector<OpKind> kinds;
+    for (const auto& op : compiler::DepthFirstScheduler().flatten(graph.inputs, graph.outputs)) {
+      kinds.push_back(op->kind);
+    }
+    return kinds;
+  };
+  auto graph1 = make_random_graph(config);
+  auto graph2 = make_random_graph(config);
+  ASSERT_EQ(graph1.inputs.size(), config.n_inputs);
+  ASSERT_EQ(graph1.outputs.size(), config.n_outputs);
+  ASSERT_EQ(kinds(graph1), kinds(graph2));
+  config.seed = 1;
+  ASSERT_NE(kinds(graph1), kinds(make_random_graph(config)));
+}
+
+TEST(RandomGraphTest, NativeMatchesGcc) {
+  // large enough to exercise spilling, calls with live values, and the nodes merged by the
+  // algebraic hash (e.g. (a + b) - b with a)
+  RandomGraphConfig config;
+  config.n_nodes = 3000;
+  config.depth = 50;
+  config.sharing = 0.2;
+  config.weight_extcall = 0.5;
+  void* extfns[] = {reinterpret_cast<void*>(&random_graph_ext_func)};
+  for (uint64_t seed = 0; seed < 3; seed++) {
+    config.seed = seed;
+    auto graph = make_random_graph(config);
+    auto f_native = compiler::compile(graph.inputs, graph.outputs);
+    auto f_gcc = jit_compile<double>(graph.inputs, graph.outputs);
+
+    std::mt19937 gen(seed);
+    std::uniform_real_distribution<double> dis(-1.0, 1.0);
+    std::vector<double> input(config.n_inputs);
+    for (auto& value : input) {
+      value = dis(gen);
+    }
+    std::vector<double> output_native(config.n_outputs);
+    std::vector<double> output_gcc(config.n_outputs);
+    f_native(input.data(), output_native.data(), extfns);
+    f_gcc(input.data(), output_gcc.data(), extfns);
+    for (size_t i = 0; i < config.n_outputs; i++) {
+      if (output_native[i] == output_gcc[i]) {
+        continue;  // including the same infinity
+      }
+      ASSERT_NEAR(output_native[i], output_gcc[i], 1e-9 * std::max(1.0, std::abs(output_gcc[i])));
+    }
+  }
+}
+
+TEST(RandomGraphTest, ListScheduler) {
+  RandomGraphConfig config;
+  config.n_nodes = 3000;
+  config.depth = 50;
+  config.sharing = 0.2;
+  config.weight_extcall = 0.5;
+  void* extfns[] = {reinterpret_cast<void*>(&random_graph_ext_func)};
+  for (auto model : {compiler::MachineModel(), compiler::MachineModel::zen4()}) {
+    auto graph = make_random_graph(config);
+    // the same operations as depth first, each after its operands
+    auto depth_first = compiler::DepthFirstScheduler().flatten(graph.inputs, graph.outputs);
+    auto scheduled = compiler::ListScheduler(model).flatten(graph.inputs, graph.outputs);
+    ASSERT_EQ(scheduled.size(), depth_first.size());
+    std::unordered_set<int32_t> emitted;
+    for (const auto& op : scheduled) {
+      for (const auto& arg : op->args) {
+        ASSERT_TRUE(emitted.contains(arg->hash_id));
+      }
+      ASSERT_TRUE(emitted.insert(op->hash_id).second);
+    }
+    ASSERT_NE(scheduled, depth_first);
+
+    compiler::CompileOptions options;
+    options.machine_model = model;
+    auto f_list = compiler::compile(graph.inputs, graph.outputs, options);
+    auto f_depth_first = compiler::compile(graph.inputs, graph.outputs);
+    std::vector<double> input(config.n_inputs, 0.25);
+    std::vector<double> output_list(config.n_outputs);
+    std::vector<double> output_depth_first(config.n_outputs);
+    f_list(input.data(), output_list.data(), extfns);
+    f_depth_first(input.data(), output_depth_first.data(), extfns);
+    ASSERT_EQ(output_list, output_depth_first);
+  }
+}
+
+int main(int argc, char **argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
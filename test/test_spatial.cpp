@@ -27,6 +27,57 @@ TEST(SpatialTest, MultInverse) {
   ASSERT_NEAR(output[5], 0, 1e-6);
 }
 
+TEST(SpatialTest, QuaternionMatchesMatrix) {
+  auto r = tenkai::Operation::make_var();
+  auto p = tenkai::Operation::make_var();
+  auto y = tenkai::Operation::make_var();
+  auto vec = tenkai::Vector::Var(3);
+  auto point = tenkai::Vector::Var(3);
+  auto tf = tenkai::SpatialTransform(
+      tenkai::Matrix::RotX(r) * tenkai::Matrix::RotY(p) * tenkai::Matrix::RotZ(y), vec);
+  auto qtf = tenkai::QuatTransform(
+      tenkai::Quaternion::RotX(r) * tenkai::Quaternion::RotY(p) * tenkai::Quaternion::RotZ(y), vec);
+
+  auto tf2 = tf * tf;
+  auto qtf2 = qtf * qtf;
+  auto converted = qtf2.to_spatial_transform();
+  auto roundtrip = tenkai::QuatTransform::FromSpatialTransform(tf2);
+  auto tf_point = tf2 * point;
+  auto qtf_point = qtf2 * point;
+  auto identity = qtf2 * qtf2.inverse();
+
+  std::vector<tenkai::Operation::Ptr> inputs = {r, p, y};
+  inputs.insert(inputs.end(), vec.elements.begin(), vec.elements.end());
+  inputs.insert(inputs.end(), point.elements.begin(), point.elements.end());
+  std::vector<tenkai::Operation::Ptr> outputs;
+  outputs.insert(outputs.end(), tf2.rot.elements.begin(), tf2.rot.elements.end());
+  outputs.insert(outputs.end(), converted.rot.elements.begin(), converted.rot.elements.end());
+  outputs.insert(outputs.end(), tf_point.elements.begin(), tf_point.elements.end());
+  outputs.insert(outputs.end(), qtf_point.elements.begin(), qtf_point.elements.end());
+  outputs.insert(outputs.end(), {qtf2.rot.w, qtf2.rot.x, qtf2.rot.y, qtf2.rot.z});
+  outputs.insert(outputs.end(), {roundtrip.rot.w, roundtrip.rot.x, roundtrip.rot.y, roundtrip.rot.z});
+  outputs.insert(outputs.end(), {identity.rot.w, identity.rot.x, identity.rot.y, identity.rot.z});
+  outputs.insert(outputs.end(), identity.trans.elements.begin(), identity.trans.elements.end());
+  auto fn = tenkai::jit_compile<double>(inputs, outputs);
+
+  double input[9] = {0.1, 0.2, 0.3, 1, 2, 3, -0.5, 0.4, 0.7};
+  double output[9 + 9 + 3 + 3 + 4 + 4 + 4 + 3];
+  fn(input, output, nullptr);
+  for (int i = 0; i < 9; i++) {
+    ASSERT_NEAR(output[i], output[9 + i], 1e-12);  // rotation matrix
+  }
+  for (int i = 0; i < 3; i++) {
+    ASSERT_NEAR(output[18 + i], output[21 + i], 1e-12);  // transformed point
+  }
+  for (int i = 0; i < 4; i++) {
+    ASSERT_NEAR(output[24 + i], output[28 + i], 1e-12);  // matrix to quaternion
+  }
+  ASSERT_NEAR(output[32], 1, 1e-12);
+  for (int i = 1; i < 7; i++) {
+    ASSERT_NEAR(output[32 + i], 0, 1e-12);  // composition with inverse
+  }
+}
+
 int main(int argc, char **argv) {
   testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
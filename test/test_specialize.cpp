@@ -0,0 +1,123 @@
+#include <gtest/gtest.h>
+#include <cmath>
+#include "cg.hpp"
+#include "compile.hpp"
+#include "linalg.hpp"
+#include "operation_scheduler.hpp"
+#include "specialize.hpp"
+#include "spatial.hpp"
+
+using namespace tenkai;
+
+// serial chain whose joint axes cycle through Z, X and Y
+std::vector<Operation::Ptr> chain_outputs(const std::vector<Operation::Ptr>& q) {
+  auto trans = Vector({Operation::make_constant(0.1), Operation::make_constant(0.2),
+                       Operation::make_constant(0.3)});
+  auto rotation = [](size_t i, const Operation::Ptr& angle) {
+    switch (i % 3) {
+      case 0:
+        return Matrix::RotZ(angle);
+      case 1:
+        return Matrix::RotX(angle);
+      default:
+        return Matrix::RotY(angle);
+    }
+  };
+  auto tf = SpatialTransform(rotation(0, q[0]), trans);
+  for (size_t i = 1; i < q.size(); i++) {
+    tf = tf * SpatialTransform(rotation(i, q[i]), trans);
+  }
+  auto outputs = tf.rot.elements;
+  outputs.insert(outputs.end(), tf.trans.elements.begin(), tf.trans.elements.end());
+  return outputs;
+}
+
+size_t count_operations(const std::vector<Operation::Ptr>& inputs,
+                        const std::vector<Operation::Ptr>& outputs) {
+  return compiler::DepthFirstScheduler().flatten(inputs, outputs).size();
+}
+
+TEST(Specialize, LockedJoints) {
+  auto q = Vector::Var(6).elements;
+  auto outputs = chain_outputs(q);
+  std::map<size_t, double> fixed = {{1, 0.4}, {3, -1.1}, {4, 0.0}};
+  auto specialized = specialize(q, outputs, fixed);
+  ASSERT_LT(count_operations(q, specialized), count_operations(q, outputs));
+
+  auto func = compiler::compile(q, outputs);
+  auto func_specialized = compiler::compile(q, specialized);
+  double input[6] = {0.3, 0.4, -0.5, -1.1, 0.0, 2.0};
+  double expected[12], output[12];
+  func(input, expected, nullptr);
+  // the fixed inputs are ignored by the specialized kernel
+  input[1] = input[3] = std::nan("");
+  func_specialized(input, output, nullptr);
+  for (size_t i = 0; i < 12; i++) {
+    ASSERT_NEAR(output[i], expected[i], 1e-12) << i;
+  }
+}
+
+TEST(Specialize, AllFixed) {
+  auto x = Operation::make_var();
+  auto y = Operation::make_var();
+  auto p = Operation::make_param(0);
+  auto outputs = specialize({x, y}, {sin(x) * cos(y), y + p, atan2(y, x), pow(x, y)},
+                            {{0, 0.0}, {1, 1.0}});
+  // sin(0) is ZERO and cos(1) a constant, so the product is folded to ZERO
+  ASSERT_EQ(outputs[0]->kind, OpKind::ZERO);
+  // a parameter is never folded
+  ASSERT_EQ(outputs[1]->kind, OpKind::ADD);
+  ASSERT_EQ(outputs[1]->args[1], p);
+  ASSERT_EQ(outputs[2]->constant_value, std::atan2(1.0, 0.0));
+  ASSERT_EQ(outputs[3]->kind, OpKind::ZERO);
+  ASSERT_THROW(specialize({x}, {x}, {{1, 0.0}}), std::runtime_error);
+}
+
+TEST(Specialize, Cache) {
+  auto q = Vector::Var(4).elements;
+  SpecializationCache cache(q, chain_outputs(q));
+  auto f1 = cache.get({{0, 0.5}});
+  auto f2 = cache.get({{0, 0.5}, {2, 1.0}});
+  ASSERT_EQ(cache.get({{0, 0.5}}), f1);
+  ASSERT_NE(f1, f2);
+  ASSERT_NE(cache.get({{0, -0.5}}), f1);
+  ASSERT_EQ(cache.size(), 3);
+
+  auto func = compiler::compile(q, chain_outputs(q));
+  double input[4] = {0.5, -0.2, 1.0, 0.7};
+  double expected[12], output[12];
+  func(input, expected, nullptr);
+  f2(input, output, nullptr);
+  for (size_t i = 0; i < 12; i++) {
+    ASSERT_NEAR(output[i], expected[i], 1e-12) << i;
+  }
+}
+
+TEST(Specialize, CacheCapacity) {
+  auto q = Vector::Var(4).elements;
+  SpecializationCache cache(q, chain_outputs(q), 2);
+  auto f1 = cache.get({{0, 0.1}});
+  auto f2 = cache.get({{0, 0.2}});
+  // full: the values not seen yet get the kernel of the original graph
+  auto f3 = cache.get({{0, 0.3}});
+  ASSERT_NE(f3, f1);
+  ASSERT_NE(f3, f2);
+  ASSERT_EQ(cache.get({{1, 0.3}}), f3);
+  ASSERT_EQ(cache.get({{0, 0.1}}), f1);
+  ASSERT_EQ(cache.size(), 2);
+  ASSERT_THROW(cache.get({{4, 0.0}}), std::runtime_error);
+
+  auto func = compiler::compile(q, chain_outputs(q));
+  double input[4] = {0.3, -0.2, 1.0, 0.7};
+  double expected[12], output[12];
+  func(input, expected, nullptr);
+  f3(input, output, nullptr);
+  for (size_t i = 0; i < 12; i++) {
+    ASSERT_NEAR(output[i], expected[i], 1e-12) << i;
+  }
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
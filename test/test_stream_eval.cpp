@@ -0,0 +1,89 @@
+#include <unistd.h>
+#include <cmath>
+#include <cstring>
+#include <format>
+#include <fstream>
+#include <gtest/gtest.h>
+#include "cg.hpp"
+#include "compile.hpp"
+#include "stream_eval.hpp"
+
+using namespace tenkai;
+
+std::string temp_path(const std::string& name) {
+  return std::format("/tmp/tenkai_{}_{}.bin", name, getpid());
+}
+
+void write_doubles(const std::string& path, const std::vector<double>& values) {
+  std::ofstream file(path, std::ios::binary | std::ios::trunc);
+  file.write(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(double));
+}
+
+std::vector<double> read_doubles(const std::string& path) {
+  std::ifstream file(path, std::ios::binary);
+  std::string content(std::istreambuf_iterator<char>(file), {});
+  std::vector<double> values(content.size() / sizeof(double));
+  std::memcpy(values.data(), content.data(), values.size() * sizeof(double));
+  return values;
+}
+
+TEST(StreamEval, MatchesDirectCalls) {
+  auto x = Operation::make_var();
+  auto y = Operation::make_var();
+  auto z = Operation::make_var();
+  std::vector<Operation::Ptr> outputs = {x * y + z, sin(x) - Operation::make_param(0), z};
+  auto func = compiler::compile({x, y, z}, outputs);
+
+  constexpr size_t n_points = 10007;
+  std::vector<double> input(3 * n_points);
+  for (size_t i = 0; i < input.size(); i++) {
+    input[i] = std::sin(i * 0.37);
+  }
+  auto input_path = temp_path("stream_input");
+  auto output_path = temp_path("stream_output");
+  write_doubles(input_path, input);
+  double params[1] = {0.25};
+  void* extfns[] = {params};
+
+  // chunks that are not a multiple of the page size nor of the staging block
+  for (bool non_temporal : {true, false}) {
+    StreamOptions options;
+    options.chunk_size = 5000;
+    options.non_temporal = non_temporal;
+    auto result = evaluate_stream(func, 3, 3, input_path, output_path, extfns, options);
+    ASSERT_EQ(result.n_points, n_points);
+    auto output = read_doubles(output_path);
+    ASSERT_EQ(output.size(), 3 * n_points);
+    for (size_t p = 0; p < n_points; p++) {
+      double expected[3];
+      func(input.data() + 3 * p, expected, extfns);
+      for (size_t k = 0; k < 3; k++) {
+        ASSERT_EQ(output[3 * p + k], expected[k]) << p << " " << k;
+      }
+    }
+  }
+  unlink(input_path.c_str());
+  unlink(output_path.c_str());
+}
+
+TEST(StreamEval, EmptyAndInvalid) {
+  auto x = Operation::make_var();
+  auto y = Operation::make_var();
+  auto func = compiler::compile({x, y}, {x + y});
+  auto input_path = temp_path("stream_empty");
+  auto output_path = temp_path("stream_empty_output");
+  write_doubles(input_path, {});
+  ASSERT_EQ(evaluate_stream(func, 2, 1, input_path, output_path).n_points, 0);
+  ASSERT_TRUE(read_doubles(output_path).empty());
+
+  write_doubles(input_path, {1.0, 2.0, 3.0});  // not a multiple of 2 inputs
+  ASSERT_THROW(evaluate_stream(func, 2, 1, input_path, output_path), std::runtime_error);
+  unlink(input_path.c_str());
+  ASSERT_THROW(evaluate_stream(func, 2, 1, input_path, output_path), std::runtime_error);
+  unlink(output_path.c_str());
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
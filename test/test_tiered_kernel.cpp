@@ -0,0 +1,52 @@
+#include <gtest/gtest.h>
+#include <cmath>
+#include "cg.hpp"
+#include "tiered_kernel.hpp"
+
+using namespace tenkai;
+
+TEST(TieredKernel, Promotion) {
+  auto x = Operation::make_var();
+  auto y = Operation::make_var();
+  TieredOptions options;
+  options.promote_after = 10;
+  TieredKernel kernel({x, y}, {sin(x) * y, x / y}, options);
+
+  double input[2] = {0.5, 4.0};
+  double output[2];
+  for (int i = 0; i < 9; i++) {
+    kernel(input, output, nullptr);
+  }
+  ASSERT_EQ(kernel.tier(), TieredKernel::Tier::NATIVE);
+  ASSERT_DOUBLE_EQ(output[0], std::sin(0.5) * 4.0);
+  kernel(input, output, nullptr);  // starts the optimized compilation
+  kernel(input, output, nullptr);  // does not wait for it
+  kernel.wait();
+  ASSERT_EQ(kernel.tier(), TieredKernel::Tier::OPTIMIZED);
+  ASSERT_TRUE(kernel.error().empty());
+  input[0] = -1.5;
+  kernel(input, output, nullptr);
+  ASSERT_DOUBLE_EQ(output[0], std::sin(-1.5) * 4.0);
+  ASSERT_DOUBLE_EQ(output[1], -1.5 / 4.0);
+}
+
+TEST(TieredKernel, FailedPromotion) {
+  auto x = Operation::make_var();
+  TieredOptions options;
+  options.promote_after = 1;
+  options.jit.compiler = "false";  // exits with failure
+  TieredKernel kernel({x}, {x * x}, options);
+  double input[1] = {3.0};
+  double output[1];
+  kernel(input, output, nullptr);
+  kernel.wait();
+  ASSERT_EQ(kernel.tier(), TieredKernel::Tier::NATIVE);
+  ASSERT_FALSE(kernel.error().empty());
+  kernel(input, output, nullptr);
+  ASSERT_EQ(output[0], 9.0);
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
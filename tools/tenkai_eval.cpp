@@ -0,0 +1,115 @@
+// Evaluates a kernel saved by compiler::save_kernel over a raw binary file of input points.
+//
+//   tenkai_eval <kernel file> <input file> <output file> [--params v0,v1,...] [--chunk-mb n]
+//
+// The input file holds n_inputs doubles per point and the output file receives n_outputs
+// doubles per point (see stream_eval.hpp). Parameters of make_param are given by --params,
+// which must list exactly as many values as the kernel reads.
+#include <sys/resource.h>
+#include <cstdint>
+#include <cstdlib>
+#include <format>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include "kernel_file.hpp"
+#include "stream_eval.hpp"
+
+using namespace tenkai;
+
+namespace {
+
+// the whole of `text` as a number, e.g. "1.5x" and "-1" are not a valid chunk size
+template <typename T>
+T parse_number(const std::string& option, const std::string& text) {
+  size_t end = 0;
+  try {
+    T value{};
+    if constexpr (std::is_floating_point_v<T>) {
+      value = std::stod(text, &end);
+    } else if (!text.empty() && text[0] != '-' && text[0] != '+') {
+      value = std::stoull(text, &end);
+    }
+    if (end != 0 && end == text.size()) {
+      return value;
+    }
+  } catch (const std::logic_error&) {  // invalid_argument or out_of_range
+  }
+  throw std::runtime_error(std::format("invalid value \"{}\" for {}", text, option));
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  if (argc < 4) {
+    std::cerr << "usage: " << argv[0]
+              << " <kernel file> <input file> <output file> [--params v0,v1,...] [--chunk-mb n]"
+              << std::endl;
+    return 1;
+  }
+  try {
+    std::vector<double> params;
+    StreamOptions options;
+    for (int i = 4; i < argc; i += 2) {
+      std::string option = argv[i];
+      if (i + 1 == argc) {
+        std::cerr << std::format("option {} has no value", option) << std::endl;
+        return 1;
+      }
+      if (option == "--params") {
+        std::stringstream values(argv[i + 1]);
+        std::string value;
+        while (std::getline(values, value, ',')) {
+          params.push_back(parse_number<double>(option, value));
+        }
+      } else if (option == "--chunk-mb") {
+        auto chunk_mb = parse_number<size_t>(option, argv[i + 1]);
+        if (chunk_mb > SIZE_MAX >> 20) {
+          throw std::runtime_error(std::format("--chunk-mb {} is too large", chunk_mb));
+        }
+        options.chunk_size = chunk_mb << 20;
+      } else {
+        std::cerr << "unknown option " << option << std::endl;
+        return 1;
+      }
+    }
+
+    auto kernel = compiler::load_kernel(argv[1]);
+    if (!kernel.ext_func_names.empty()) {
+      std::cerr << std::format("{} calls external function {}, which cannot be provided",
+                               kernel.name, kernel.ext_func_names[0])
+                << std::endl;
+      return 1;
+    }
+    if (!kernel.layout.is_dense()) {
+      std::cerr << std::format("{} was compiled for an I/O layout other than the dense arrays "
+                               "of the stream files",
+                               argv[1])
+                << std::endl;
+      return 1;
+    }
+    if (params.size() != kernel.n_params) {
+      std::cerr << std::format("{} reads {} parameters, but --params gives {}", argv[1],
+                               kernel.n_params, params.size())
+                << std::endl;
+      return 1;
+    }
+    // no external functions, so the parameter buffer is the first slot
+    void* extfns[] = {params.data()};
+    auto result = evaluate_stream(kernel.func, kernel.n_inputs, kernel.n_outputs, argv[2],
+                                  argv[3], extfns, options);
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    std::cout << std::format("{}: {} points in {:.3f} s ({:.1f} M points/s), peak RSS {} MiB",
+                             argv[1], result.n_points, result.seconds,
+                             result.n_points / result.seconds * 1e-6, usage.ru_maxrss / 1024)
+              << std::endl;
+  } catch (const std::exception& e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}